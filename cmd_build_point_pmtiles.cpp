@@ -4,12 +4,17 @@
 #include "qgenlib/qgen_error.h"
 #include "qgenlib/tsv_reader.h"
 #include "pmt_utils.h"
+#include "pmt_pts.h"
+#include "pt_zonemap.h"
+#include "pt_tile_index.h"
+#include "mlt_codec.h"
 #include "ext/PMTiles/pmtiles.hpp"
 
 #include <vector>
 #include <string>
 #include <map>
 #include <unordered_map>
+#include <unordered_set>
 #include <list>
 #include <iostream>
 #include <fcntl.h>
@@ -62,9 +67,9 @@ void epsg3857_to_wgs84(double x, double y, double& lon, double& lat) {
 }
 
 // Column type constants (ordered by specificity: INT > FLOAT > STRING)
-static const int COL_TYPE_STRING = 0;
-static const int COL_TYPE_FLOAT  = 1;
-static const int COL_TYPE_INT    = 2;
+static const int COL_TYPE_STRING = MLT_COL_STRING;
+static const int COL_TYPE_FLOAT  = MLT_COL_FLOAT;
+static const int COL_TYPE_INT    = MLT_COL_INT;
 
 // Returns true if the value is considered missing (absent)
 static bool is_missing(const std::string& v) {
@@ -76,309 +81,40 @@ struct PointFeature {
     std::vector<std::string> attrs; // one entry per non-coordinate column
 };
 
-// Encode a boolean array as byte RLE (ORC-style).
-// The PRESENT stream stores 1 bit per feature (1=present, 0=absent), packed into
-// bytes (LSB first), then encoded as byte RLE literal runs of up to 128 bytes each.
-static std::string encode_bool_rle(const std::vector<bool>& present) {
-    size_t n = present.size();
-    size_t numBytes = (n + 7) / 8;
-
-    // Pack bits into bytes
-    std::vector<uint8_t> packed(numBytes, 0);
-    for (size_t i = 0; i < n; ++i) {
-        if (present[i]) packed[i / 8] |= static_cast<uint8_t>(1 << (i % 8));
-    }
-
-    // Emit as byte-RLE literal runs (up to 128 packed bytes per run)
-    std::string result;
-    size_t offset = 0;
-    while (offset < numBytes) {
-        size_t chunk = std::min(static_cast<size_t>(128), numBytes - offset);
-        // Literal header: 256 - chunk  (unsigned; decoder reads 256-header literals)
-        result.push_back(static_cast<char>(static_cast<uint8_t>(256 - chunk)));
-        for (size_t i = 0; i < chunk; ++i) {
-            result.push_back(static_cast<char>(packed[offset + i]));
-        }
-        offset += chunk;
-    }
-    return result;
-}
-
-class MLTPointEncoder {
-    std::string out;
-
-    void write_varint(std::uint64_t value) {
-        do {
-            uint8_t byte = value & 0x7F;
-            value >>= 7;
-            if (value > 0) byte |= 0x80;
-            out.push_back(byte);
-        } while (value > 0);
-    }
-
-    uint32_t encode_zigzag32(int32_t v) {
-        return (v << 1) ^ (v >> 31);
-    }
-
-public:
-    // col_types:   0=STRING, 1=FLOAT, 2=INT_32
-    // col_nullable: true  → nullable typeCode (17/25/29) + PRESENT stream; DATA holds non-null values only
-    //               false → non-nullable typeCode (16/24/28); DATA holds all values
-    std::string encode(uint32_t extent, const std::string& layer_name,
-                       const std::vector<PointFeature>& features,
-                       const std::vector<std::string>& col_names,
-                       const std::vector<int>& col_types,
-                       const std::vector<bool>& col_nullable) {
-        out.clear();
-
-        std::string tmp_ft;
-
-        auto append_varint = [&](std::uint64_t value) {
-            do {
-                uint8_t byte = value & 0x7F;
-                value >>= 7;
-                if (value > 0) byte |= 0x80;
-                tmp_ft.push_back(byte);
-            } while (value > 0);
-        };
-
-        // === METADATA SECTION ===
-        // Layer name
-        append_varint(layer_name.size());
-        tmp_ft.append(layer_name);
-        // Extent
-        append_varint(extent);
-        // Number of columns: 1 geometry + N attribute columns
-        append_varint(1 + col_names.size());
-
-        // Column 0: GEOMETRY (typeCode=4, no name per spec)
-        append_varint(4);
-
-        // Attribute columns metadata: typeCode + name
-        // Non-nullable: INT_32=16, FLOAT=24, STRING=28
-        // Nullable:     INT_32=17, FLOAT=25, STRING=29
-        for (size_t c = 0; c < col_names.size(); ++c) {
-            int typeCode;
-            if (col_types[c] == COL_TYPE_INT)
-                typeCode = col_nullable[c] ? 17 : 16;
-            else if (col_types[c] == COL_TYPE_FLOAT)
-                typeCode = col_nullable[c] ? 25 : 24;
-            else
-                typeCode = col_nullable[c] ? 29 : 28;
-            append_varint(typeCode);
-            append_varint(col_names[c].size());
-            tmp_ft.append(col_names[c]);
-        }
-
-        // === DATA SECTION ===
-
-        // --- GEOMETRY column data ---
-        // numStreams = 2 (GeometryType stream + Vertex stream)
-        append_varint(2);
-
-        // Stream 0: GeometryType
-        // Header byte 1: (DATA=1 << 4) | (NONE=0) = 0x10
-        // Header byte 2: VARINT technique = 0x02
-        tmp_ft.push_back(0x10);
-        tmp_ft.push_back(0x02);
-        append_varint(features.size()); // numValues = numFeatures
-
-        std::string geom_type_data;
-        for (size_t i = 0; i < features.size(); ++i) {
-            geom_type_data.push_back(0); // 0 = POINT
-        }
-        append_varint(geom_type_data.size());
-        tmp_ft.append(geom_type_data);
-
-        // Stream 1: Vertices
-        // Header byte 1: (DATA=1 << 4) | (VERTEX=3) = 0x13
-        // Header byte 2: VARINT technique = 0x02
-        tmp_ft.push_back(0x13);
-        tmp_ft.push_back(0x02);
-        append_varint(features.size() * 2); // numValues = X and Y per point
-
-        std::string vertex_data;
-        auto append_v_varint = [&](std::uint64_t value) {
-            do {
-                uint8_t byte = value & 0x7F;
-                value >>= 7;
-                if (value > 0) byte |= 0x80;
-                vertex_data.push_back(byte);
-            } while (value > 0);
-        };
-        for (size_t i = 0; i < features.size(); ++i) {
-            append_v_varint(encode_zigzag32(features[i].x));
-            append_v_varint(encode_zigzag32(features[i].y));
-        }
-        append_varint(vertex_data.size());
-        tmp_ft.append(vertex_data);
-
-        // --- Attribute column data ---
+// MLT (MapLibre Tile) encoder
+// col_types:   0=STRING, 1=FLOAT, 2=INT_32 (same as mlt_col_type_t)
+// col_nullable: true  → nullable typeCode (17/25/29) + PRESENT stream; DATA holds non-null values only
+//               false → non-nullable typeCode (16/24/28); DATA holds all values
+std::string encode_mlt_tile(uint32_t extent, const std::string& layer_name,
+                            const std::vector<PointFeature>& features,
+                            const std::vector<std::string>& col_names,
+                            const std::vector<int>& col_types,
+                            const std::vector<bool>& col_nullable,
+                            const mlt_write_options& mlt_opts) {
+    mlt_layer_writer writer(layer_name, extent, mlt_opts);
+    for (size_t c = 0; c < col_names.size(); ++c)
+        writer.add_column(col_names[c], (mlt_col_type_t)col_types[c], col_nullable[c]);
+    for (size_t i = 0; i < features.size(); ++i) {
+        writer.add_point(features[i].x, features[i].y);
         for (size_t c = 0; c < col_names.size(); ++c) {
-            bool nullable = col_nullable[c];
-
-            // Build the presence bitmap and collect non-null raw values
-            std::vector<bool> present(features.size(), true);
-            if (nullable) {
-                for (size_t i = 0; i < features.size(); ++i) {
-                    const std::string& s = (c < features[i].attrs.size()) ? features[i].attrs[c] : "";
-                    present[i] = !is_missing(s);
-                }
-            }
-            size_t non_null_count = 0;
-            for (size_t i = 0; i < features.size(); ++i) {
-                if (present[i]) ++non_null_count;
-            }
-
-            if (col_types[c] == COL_TYPE_INT) {
-                // INT_32: non-nullable typeCode=16, nullable typeCode=17
-                // hasStreamCount=false: NO numStreams written.
-                // Streams: [PRESENT (if nullable)] + DATA(non-null values only)
-
-                // Encode non-null zigzag+varint int32 values
-                std::string int_data;
-                auto append_int_varint = [&](uint64_t value) {
-                    do {
-                        uint8_t byte = value & 0x7F;
-                        value >>= 7;
-                        if (value > 0) byte |= 0x80;
-                        int_data.push_back(byte);
-                    } while (value > 0);
-                };
-                for (size_t i = 0; i < features.size(); ++i) {
-                    if (!present[i]) continue;
-                    const std::string& s = (c < features[i].attrs.size()) ? features[i].attrs[c] : "";
-                    int32_t val = 0;
-                    try { val = (int32_t)std::stoi(s); } catch (...) {}
-                    uint32_t zigzag = ((uint32_t)val << 1) ^ (uint32_t)(val >> 31);
-                    append_int_varint(zigzag);
-                }
-
-                if (nullable) {
-                    // PRESENT stream:
-                    //   byte 1: (PRESENT=0 << 4) | 0 = 0x00
-                    //   byte 2: VARINT technique = 0x02
-                    //   numValues = total features; only non-null entries in DATA
-                    std::string rle = encode_bool_rle(present);
-                    tmp_ft.push_back(0x00);
-                    tmp_ft.push_back(0x02);
-                    append_varint(features.size()); // numValues = total features
-                    append_varint(rle.size());
-                    tmp_ft.append(rle);
-                }
-
-                // DATA stream
-                tmp_ft.push_back(0x10); // DATA, NONE dict
-                tmp_ft.push_back(0x02); // VARINT technique
-                append_varint(non_null_count); // numValues = non-null count
-                append_varint(int_data.size());
-                tmp_ft.append(int_data);
-
+            const std::string& s = (c < features[i].attrs.size()) ? features[i].attrs[c] : "";
+            if (col_nullable[c] && is_missing(s)) {
+                writer.add_null(c);
+            } else if (col_types[c] == COL_TYPE_INT) {
+                int32_t val = 0;
+                try { val = (int32_t)std::stoi(s); } catch (...) {}
+                writer.add_int(c, val);
             } else if (col_types[c] == COL_TYPE_FLOAT) {
-                // FLOAT: non-nullable typeCode=24, nullable typeCode=25
-                // hasStreamCount=false: NO numStreams written.
-                // Streams: [PRESENT (if nullable)] + DATA(non-null LE float32 values)
-
-                std::string float_data;
-                float_data.reserve(non_null_count * 4);
-                for (size_t i = 0; i < features.size(); ++i) {
-                    if (!present[i]) continue;
-                    const std::string& s = (c < features[i].attrs.size()) ? features[i].attrs[c] : "";
-                    float val = 0.0f;
-                    try { val = std::stof(s); } catch (...) {}
-                    uint32_t bits;
-                    memcpy(&bits, &val, sizeof(bits));
-                    float_data.push_back(static_cast<char>(bits & 0xFF));
-                    float_data.push_back(static_cast<char>((bits >> 8) & 0xFF));
-                    float_data.push_back(static_cast<char>((bits >> 16) & 0xFF));
-                    float_data.push_back(static_cast<char>((bits >> 24) & 0xFF));
-                }
-
-                if (nullable) {
-                    std::string rle = encode_bool_rle(present);
-                    tmp_ft.push_back(0x00); // PRESENT
-                    tmp_ft.push_back(0x02); // VARINT
-                    append_varint(features.size());
-                    append_varint(rle.size());
-                    tmp_ft.append(rle);
-                }
-
-                // DATA stream:
-                //   byte 1: (DATA=1 << 4) | (NONE=0) = 0x10
-                //   byte 2: NONE technique = 0x00 (raw LE float32)
-                tmp_ft.push_back(0x10);
-                tmp_ft.push_back(0x00);
-                append_varint(non_null_count); // numValues = non-null count
-                append_varint(float_data.size());
-                tmp_ft.append(float_data);
-
+                float val = 0.0f;
+                try { val = std::stof(s); } catch (...) {}
+                writer.add_float(c, val);
             } else {
-                // STRING: non-nullable typeCode=28, nullable typeCode=29
-                // hasStreamCount=true: numStreams is written.
-                // Streams: [PRESENT (if nullable)] + LENGTH + DATA
-                // LENGTH and DATA cover only non-null strings.
-                int numStreams = nullable ? 3 : 2;
-                append_varint(numStreams);
-
-                // Build lengths and bytes for non-null strings only
-                std::string lengths_data;
-                std::string strings_data;
-                auto append_len_varint = [&](uint64_t v) {
-                    do {
-                        uint8_t b = v & 0x7F;
-                        v >>= 7;
-                        if (v > 0) b |= 0x80;
-                        lengths_data.push_back(b);
-                    } while (v > 0);
-                };
-                for (size_t i = 0; i < features.size(); ++i) {
-                    if (!present[i]) continue;
-                    const std::string& s = (c < features[i].attrs.size()) ? features[i].attrs[c] : "";
-                    append_len_varint(s.size());
-                    strings_data.append(s);
-                }
-
-                if (nullable) {
-                    std::string rle = encode_bool_rle(present);
-                    tmp_ft.push_back(0x00); // PRESENT
-                    tmp_ft.push_back(0x02); // VARINT
-                    append_varint(features.size());
-                    append_varint(rle.size());
-                    tmp_ft.append(rle);
-                }
-
-                // LENGTH stream:
-                //   byte 1: (LENGTH=3 << 4) | (VAR_BINARY=0) = 0x30
-                //   byte 2: VARINT technique = 0x02
-                tmp_ft.push_back(0x30);
-                tmp_ft.push_back(0x02);
-                append_varint(non_null_count); // numValues = non-null string count
-                append_varint(lengths_data.size());
-                tmp_ft.append(lengths_data);
-
-                // DATA stream:
-                //   byte 1: (DATA=1 << 4) | (NONE=0) = 0x10
-                //   byte 2: NONE technique = 0x00 (raw UTF-8 bytes)
-                //   numValues = 0 (raw byte stream; byteLength is sufficient)
-                tmp_ft.push_back(0x10);
-                tmp_ft.push_back(0x00);
-                append_varint(0); // numValues = 0
-                append_varint(strings_data.size());
-                tmp_ft.append(strings_data);
+                writer.add_string(c, s.data(), s.size());
             }
         }
-
-        std::string layer_data = tmp_ft;
-
-        // Layer wrapper: varint(totalLength) | varint(tag=1) | layerData
-        // totalLength includes the 1-byte tag varint
-        write_varint(1 + layer_data.size());
-        out.push_back(1); // Layer Tag = 1
-        out.append(layer_data);
-
-        return out;
     }
-};
+    return writer.finish();
+}
 
 // MVT (Mapbox Vector Tile) encoder using protozero
 // Follows the Mapbox Vector Tile Specification v2:
@@ -510,6 +246,11 @@ int32_t cmd_build_point_pmtiles(int32_t argc, char **argv)
     std::string delim = ",";
     std::string format = "MLT"; 
     int32_t n_threads = 1;
+    std::string compression = "gzip";
+    int32_t compression_level = 0;
+    bool zone_maps_flag = false;
+    std::string index_column;
+    mlt_write_options mlt_opts;
 
     paramList pl;
     BEGIN_LONG_PARAMS(longParameters)
@@ -522,6 +263,12 @@ int32_t cmd_build_point_pmtiles(int32_t argc, char **argv)
     LONG_STRING_PARAM("delim", &delim, "Delimiter for input file")
     LONG_STRING_PARAM("tmp-dir", &tmp_dir, "Temporary directory")
     LONG_INT_PARAM("threads", &n_threads, "Number of threads for encoding [1]")
+    LONG_STRING_PARAM("compression", &compression, "Tile compression: gzip, zstd, or none (for intermediate files read only by pmpoint) [default: gzip]")
+    LONG_INT_PARAM("level", &compression_level, "Compression level (gzip 1-9, zstd 1-22); 0 uses the library default")
+    LONG_STRING_PARAM("index-column", &index_column, "Categorical column (e.g. gene) to build an inverted index of the tiles containing each value, written to [out].idx.gz")
+    LONG_PARAM("zone-maps", &zone_maps_flag, "Store per-tile min/max of numeric columns and Bloom filters of string columns in the metadata, to skip tiles in filtered exports")
+    LONG_PARAM("mlt-packed-ints", &mlt_opts.packed_ints, "Allow bit-packed MLT integer streams (smaller tiles, but a pmpoint extension that other MLT decoders cannot read)")
+    LONG_PARAM("mlt-front-coding", &mlt_opts.front_coding, "Allow front-coded MLT string dictionaries (smaller tiles, but a pmpoint extension that other MLT decoders cannot read)")
     END_LONG_PARAMS();
 
     pl.Add(new longParams("Available Options", longParameters));
@@ -533,6 +280,9 @@ int32_t cmd_build_point_pmtiles(int32_t argc, char **argv)
     if (format != "MLT" && format != "MVT")
         error("Unsupported format '%s'. Must be 'MLT' or 'MVT'.", format.c_str());
     if (n_threads < 1) n_threads = 1;
+    uint8_t tile_compression = pmt_pts::parse_compression(compression);
+    if (tile_compression == pmtiles::COMPRESSION_UNKNOWN)
+        error("Unsupported compression '%s'. Must be 'gzip', 'zstd' or 'none'.", compression.c_str());
 
     std::string base_name = in_csv;
     {
@@ -569,6 +319,12 @@ int32_t cmd_build_point_pmtiles(int32_t argc, char **argv)
         }
     }
     size_t n_attrs = attr_col_names.size();
+    int index_attr = -1;
+    if (!index_column.empty()) {
+        for (size_t i = 0; i < n_attrs; ++i)
+            if (attr_col_names[i] == index_column) index_attr = (int)i;
+        if (index_attr < 0) error("Could not find the --index-column %s in header.", index_column.c_str());
+    }
 
     // =========================================================
     // Phase 1: Read CSV → per-tile binary temp files
@@ -774,6 +530,54 @@ int32_t cmd_build_point_pmtiles(int32_t argc, char **argv)
     int out_fd = open(tmp_file.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0666);
     if (out_fd < 0) error("Failed to open temporary output file: %s", tmp_file.c_str());
 
+    // Per-tile statistics of each column, collected while encoding
+    pt_zone_maps zone_maps;
+    if (zone_maps_flag) {
+        std::vector<bool> attr_numeric(n_attrs);
+        for (size_t c = 0; c < n_attrs; ++c) attr_numeric[c] = (attr_col_types[c] != COL_TYPE_STRING);
+        zone_maps.init(attr_col_names, attr_numeric, sorted_tile_ids);
+    }
+    auto collect_zone_maps = [&](const std::vector<PointFeature>& feats, size_t tile_idx) {
+        std::unordered_set<std::string> distinct;
+        std::vector<std::string> distinct_values;
+        for (size_t c = 0; c < n_attrs; ++c) {
+            if (attr_col_types[c] == COL_TYPE_STRING) {
+                distinct.clear();
+                for (const auto& f : feats)
+                    if (!is_missing(f.attrs[c])) distinct.insert(f.attrs[c]);
+                distinct_values.assign(distinct.begin(), distinct.end());
+                zone_maps.set_strings(c, tile_idx, distinct_values);
+            } else {
+                double vmin = std::numeric_limits<double>::infinity();
+                double vmax = -std::numeric_limits<double>::infinity();
+                for (const auto& f : feats) {
+                    if (is_missing(f.attrs[c])) continue;
+                    double v = strtod(f.attrs[c].c_str(), NULL);
+                    vmin = std::min(vmin, v);
+                    vmax = std::max(vmax, v);
+                }
+                if (vmin > vmax) continue; // no values
+                if (attr_col_types[c] == COL_TYPE_FLOAT) {
+                    // floats are stored in 32 bits and compared with literals rounded to float,
+                    // so widen the range by one float step around the stored values
+                    vmin = std::nextafter((float)vmin, -std::numeric_limits<float>::infinity());
+                    vmax = std::nextafter((float)vmax, std::numeric_limits<float>::infinity());
+                }
+                zone_maps.set_numeric(c, tile_idx, vmin, vmax);
+            }
+        }
+    };
+
+    // Inverted index from the values of index_column to the tiles containing them
+    pt_tile_index tile_index;
+    tile_index.column = index_column;
+    auto count_index_values = [&](const std::vector<PointFeature>& feats, std::vector<std::pair<std::string, uint64_t>>& value_counts) {
+        std::unordered_map<std::string, uint64_t> counts;
+        for (const auto& f : feats)
+            if (!is_missing(f.attrs[index_attr])) ++counts[f.attrs[index_attr]];
+        value_counts.assign(counts.begin(), counts.end());
+    };
+
     std::vector<pmtiles::entryv3> final_entries;
     final_entries.reserve(sorted_tile_ids.size());
     uint64_t current_out_offset = 0;
@@ -794,30 +598,39 @@ int32_t cmd_build_point_pmtiles(int32_t argc, char **argv)
 
         // Encode + compress in parallel
         std::vector<std::string> batch_compressed(bs);
-        // Encode one tile's features into the chosen format
+        std::vector<std::vector<std::pair<std::string, uint64_t>>> batch_index(bs);
+        // Encode one tile's features into the chosen format and compress it
         auto encode_tile = [&](const std::vector<PointFeature>& feats) -> std::string {
+            std::string encoded;
             if (format == "MVT") {
-                return encode_mvt_tile(extent, base_name, feats,
-                                       attr_col_names, attr_col_types, attr_col_nullable);
+                encoded = encode_mvt_tile(extent, base_name, feats,
+                                          attr_col_names, attr_col_types, attr_col_nullable);
             } else {
-                MLTPointEncoder enc;
-                return enc.encode(extent, base_name, feats,
-                                  attr_col_names, attr_col_types, attr_col_nullable);
+                encoded = encode_mlt_tile(extent, base_name, feats,
+                                          attr_col_names, attr_col_types, attr_col_nullable, mlt_opts);
             }
+            if (tile_compression == pmtiles::COMPRESSION_NONE) return encoded;
+            std::string compressed;
+            pmt_pts::compress_bytes(encoded.data(), encoded.size(), tile_compression, compression_level, compressed);
+            return compressed;
         };
         if (n_threads > 1) {
             std::vector<std::thread> threads;
             threads.reserve(bs);
             for (size_t i = 0; i < bs; ++i) {
                 threads.emplace_back([&, i]() {
-                    batch_compressed[i] = mlt_gzip_compress(encode_tile(batch_data[i]));
+                    if (zone_maps_flag) collect_zone_maps(batch_data[i], batch_start + i);
+                    if (index_attr >= 0) count_index_values(batch_data[i], batch_index[i]);
+                    batch_compressed[i] = encode_tile(batch_data[i]);
                     std::vector<PointFeature>().swap(batch_data[i]);
                 });
             }
             for (auto& t : threads) t.join();
         } else {
             for (size_t i = 0; i < bs; ++i) {
-                batch_compressed[i] = mlt_gzip_compress(encode_tile(batch_data[i]));
+                if (zone_maps_flag) collect_zone_maps(batch_data[i], batch_start + i);
+                if (index_attr >= 0) count_index_values(batch_data[i], batch_index[i]);
+                batch_compressed[i] = encode_tile(batch_data[i]);
                 std::vector<PointFeature>().swap(batch_data[i]);
             }
         }
@@ -830,6 +643,9 @@ int32_t cmd_build_point_pmtiles(int32_t argc, char **argv)
             final_entries.emplace_back(tid, current_out_offset,
                                        (uint32_t)batch_compressed[i].size(), 1);
             current_out_offset += batch_compressed[i].size();
+            // tiles are processed in ascending order of tile ID
+            for (const auto& vc : batch_index[i])
+                tile_index.add(vc.first, tid, vc.second);
         }
 
         tiles_done += bs;
@@ -893,6 +709,7 @@ int32_t cmd_build_point_pmtiles(int32_t argc, char **argv)
     tstats["layers"] = tlayers;
 
     jmeta["tilestats"] = tstats;
+    if (zone_maps_flag) jmeta["zone_maps"] = zone_maps.to_json();
 
     std::string json_metadata = jmeta.dump();
     std::string compressed_json = mlt_gzip_compress(json_metadata);
@@ -910,8 +727,8 @@ int32_t cmd_build_point_pmtiles(int32_t argc, char **argv)
     header.tile_entries_count = final_entries.size();
     header.tile_contents_count = final_entries.size();
     header.clustered = true;
-    header.internal_compression = pmtiles::COMPRESSION_GZIP;
-    header.tile_compression = pmtiles::COMPRESSION_GZIP;
+    header.internal_compression = pmtiles::COMPRESSION_GZIP; // directories stay gzip for compatibility with other readers
+    header.tile_compression = tile_compression;
     header.tile_type = (format == "MVT") ? 0x01 : 0x06; // 0x01 = MVT, 0x06 = MLT
     header.min_zoom = zoom;
     header.max_zoom = zoom;
@@ -967,6 +784,16 @@ int32_t cmd_build_point_pmtiles(int32_t argc, char **argv)
     close(out_final);
 
     unlink(tmp_file.c_str());
+
+    if (index_attr >= 0) {
+        std::string index_path = pt_tile_index::default_path(out_pmtiles);
+        notice("Writing the index of %zu values of %s to %s...", tile_index.postings.size(), index_column.c_str(), index_path.c_str());
+        tile_index.set_archive(header);
+        tile_index.write(index_path);
+    }
+    else {
+        pt_tile_index::remove_default(out_pmtiles);
+    }
     notice("Done!");
     return 0;
 }
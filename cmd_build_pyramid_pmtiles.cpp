@@ -7,11 +7,13 @@
 #include <string>
 #include <cstring>
 #include <climits>
+#include <cerrno>
 #include <map>
 #include <mutex>
 #include <thread>
 #include <atomic>
 #include <queue>
+#include <deque>
 #include <condition_variable>
 #include <random>
 #include <fcntl.h>
@@ -20,6 +22,8 @@
 #include <sys/stat.h>
 
 #include "pmt_pts.h"
+#include "pt_tile_index.h"
+#include "mlt_codec.h"
 #include "pmt_utils.h"
 #include "polygon.h"
 #include "mvt_pts.h"
@@ -60,41 +64,12 @@ std::string gzip_compress(const std::string& data) {
     return outstring;
 }
 
-std::string gzip_decompress(const std::string& data) {
-    z_stream zs;
-    memset(&zs, 0, sizeof(zs));
-    if (inflateInit2(&zs, 15 | 32) != Z_OK) {
-        error("inflateInit2 failed");
-    }
-    zs.next_in = (Bytef*)data.data();
-    zs.avail_in = data.size();
-    
-    int ret;
-    char outbuffer[32768];
-    std::string outstring;
-    
-    do {
-        zs.next_out = reinterpret_cast<Bytef*>(outbuffer);
-        zs.avail_out = sizeof(outbuffer);
-        ret = inflate(&zs, 0);
-        if (outstring.size() < zs.total_out) {
-            outstring.append(outbuffer, zs.total_out - outstring.size());
-        }
-    } while (ret == Z_OK);
-    
-    inflateEnd(&zs);
-    if (ret != Z_STREAM_END && ret != Z_OK) {
-        error("inflate failed");
-    }
-    return outstring;
-}
-
 struct fast_feature {
     uint64_t id;
-    pmt_utils::pmt_pt_t pt;
+    pmt_utils::pmt_xy_t pt;
     std::vector<uint32_t> tags;
     
-    fast_feature(pmt_utils::pmt_pt_t p) : id(0), pt(p) {}
+    fast_feature() : id(0) {}
 };
 
 struct fast_mvt {
@@ -105,9 +80,7 @@ struct fast_mvt {
 
 void decode_mvt_raw(const std::string& buffer, uint8_t z, uint32_t x, uint32_t y, fast_mvt& out) {
     protozero::pbf_reader tile_reader(buffer);
-    double scale_factor = pmt_utils::epsg3857_scale_factor(z);
-    double offset_x, offset_y;
-    pmt_utils::tiletoepsg3857(x, y, z, &offset_x, &offset_y);
+    pmt_utils::pmt_tile_transform_t transform(z, x, y);
 
     while (tile_reader.next(3)) { // Layer
         protozero::pbf_reader layer_reader = tile_reader.get_message();
@@ -122,7 +95,7 @@ void decode_mvt_raw(const std::string& buffer, uint8_t z, uint32_t x, uint32_t y
                     break;
                 case 2: { // feature
                     protozero::pbf_reader feature_reader = layer_reader.get_message();
-                    fast_feature f(pmt_utils::pmt_pt_t(z, 0, 0));
+                    fast_feature f;
                     uint32_t geom_type = 0;
                     
                     int32_t cx = 0, cy = 0;
@@ -154,8 +127,8 @@ void decode_mvt_raw(const std::string& buffer, uint8_t z, uint32_t x, uint32_t y
                         }
                     }
                     if (geom_type == 1) { // Point
-                        f.pt.global_x = offset_x + scale_factor * cx;
-                        f.pt.global_y = offset_y - scale_factor * cy;
+                        f.pt.global_x = transform.global_x(cx);
+                        f.pt.global_y = transform.global_y(cy);
                         out.features.push_back(std::move(f));
                     }
                     break;
@@ -170,112 +143,31 @@ void decode_mvt_raw(const std::string& buffer, uint8_t z, uint32_t x, uint32_t y
 // MLT-specific types and helpers for pyramid building
 // ============================================================
 
-static const int MLT_TYPE_STRING = 0;
-static const int MLT_TYPE_FLOAT  = 1;
-static const int MLT_TYPE_INT    = 2;
-
-struct mlt_feature_pyr {
-    double global_x, global_y;
-    std::vector<std::string> attrs;
-};
-
+// Typed columns of the points of the child tiles merged into a parent tile
+// String values point into the uncompressed child tiles, which are kept in `tiles`.
 struct mlt_layer_pyr {
+    struct column_t {
+        std::vector<uint8_t> present; // per point
+        std::vector<int32_t> ints;    // per point for MLT_COL_INT, 0 if absent
+        std::vector<float> floats;    // per point for MLT_COL_FLOAT, 0 if absent
+        std::vector<std::pair<const char*, uint32_t>> strs; // per point for MLT_COL_STRING
+    };
     std::string name;
-    uint32_t extent;
+    uint32_t extent = 0;
     std::vector<std::string> col_names;
-    std::vector<int>  col_types;
+    std::vector<mlt_col_type_t> col_types;
     std::vector<bool> col_nullable;
-    std::vector<mlt_feature_pyr> features;
-};
-
-// ORC-style boolean RLE decoder (PRESENT stream)
-static std::vector<bool> decode_bool_rle_pyr(const uint8_t* data, size_t len, size_t count) {
-    std::vector<bool> result;
-    result.reserve(count);
-    size_t i = 0;
-    while (i < len && result.size() < count) {
-        uint8_t header = data[i++];
-        if (header >= 128) {
-            size_t run_len = 256 - header;
-            for (size_t j = 0; j < run_len && i < len && result.size() < count; ++j, ++i) {
-                uint8_t byte = data[i];
-                for (int b = 0; b < 8 && result.size() < count; ++b)
-                    result.push_back((byte >> b) & 1);
-            }
-        } else {
-            size_t run_len = header + 3;
-            if (i < len) {
-                uint8_t byte = data[i++];
-                for (size_t j = 0; j < run_len && result.size() < count; ++j)
-                    for (int b = 0; b < 8 && result.size() < count; ++b)
-                        result.push_back((byte >> b) & 1);
-            }
-        }
-    }
-    while (result.size() < count) result.push_back(true);
-    return result;
-}
+    std::vector<column_t> columns;
+    std::vector<double> xs, ys; // global coordinates (EPSG:3857)
+    std::deque<std::string> tiles; // a deque keeps the bytes of each tile in place as tiles are added
 
-// ORC-style boolean RLE encoder (PRESENT stream)
-static std::string encode_bool_rle_pyr(const std::vector<bool>& present) {
-    size_t n = present.size();
-    size_t numBytes = (n + 7) / 8;
-    std::vector<uint8_t> packed(numBytes, 0);
-    for (size_t i = 0; i < n; ++i)
-        if (present[i]) packed[i/8] |= static_cast<uint8_t>(1 << (i%8));
-    std::string result;
-    size_t offset = 0;
-    while (offset < numBytes) {
-        size_t chunk = std::min(static_cast<size_t>(128), numBytes - offset);
-        result.push_back(static_cast<char>(static_cast<uint8_t>(256 - chunk)));
-        for (size_t i = 0; i < chunk; ++i)
-            result.push_back(static_cast<char>(packed[offset + i]));
-        offset += chunk;
-    }
-    return result;
-}
+    size_t num_points() const { return xs.size(); }
+};
 
-// Quick feature count from compressed MLT tile (decompress + parse geometry header only)
+// Quick feature count from an uncompressed MLT tile (stream headers only)
 static size_t count_mlt_features_quick(const std::string& uncompressed) {
-    if (uncompressed.empty()) return 0;
-    const uint8_t* ptr = (const uint8_t*)uncompressed.data();
-    const uint8_t* end = ptr + uncompressed.size();
-    auto read_varint = [&]() -> uint64_t {
-        uint64_t val = 0; int shift = 0;
-        while (ptr < end) {
-            uint8_t b = *ptr++;
-            val |= (uint64_t)(b & 0x7F) << shift;
-            if ((b & 0x80) == 0) break;
-            shift += 7;
-        }
-        return val;
-    };
-    while (ptr < end) {
-        uint64_t layer_len = read_varint();
-        if (layer_len == 0 || ptr >= end) break;
-        uint8_t tag = *ptr++;
-        if (tag != 1) { ptr += layer_len - 1; continue; }
-        uint64_t name_len = read_varint();
-        ptr += name_len;
-        read_varint(); // extent
-        uint64_t num_columns = read_varint();
-        for (uint64_t c = 0; c < num_columns; ++c) {
-            uint64_t tc = read_varint();
-            if (tc >= 10) { uint64_t cl = read_varint(); ptr += cl; }
-        }
-        uint64_t geom_num_streams = read_varint();
-        for (uint64_t s = 0; s < geom_num_streams; ++s) {
-            if (ptr + 2 > end) return 0;
-            uint8_t h0 = *ptr++; ptr++;
-            uint64_t num_vals = read_varint();
-            uint64_t byte_len = read_varint();
-            ptr += byte_len;
-            if (((h0 >> 4) & 0x0F) == 1 && (h0 & 0x0F) == 3)
-                return (size_t)(num_vals / 2);
-        }
-        return 0;
-    }
-    return 0;
+    mlt_layer_reader reader;
+    return reader.parse(uncompressed) ? reader.num_features : 0;
 }
 
 static size_t count_mvt_features_quick(const std::string& uncompressed) {
@@ -291,315 +183,111 @@ static size_t count_mvt_features_quick(const std::string& uncompressed) {
     return count;
 }
 
-// Decode an MLT tile (new multi-column format) into mlt_layer_pyr
-void decode_mlt_layer(const std::string& buffer, uint8_t z, uint32_t x, uint32_t y, mlt_layer_pyr& layer) {
+// Decode an uncompressed MLT tile and append its points to layer, which keeps the tile bytes
+void decode_mlt_layer(std::string buffer, uint8_t z, uint32_t x, uint32_t y, mlt_layer_pyr& layer) {
     if (buffer.empty()) return;
-    double scale_factor = pmt_utils::epsg3857_scale_factor(z);
-    double offset_x, offset_y;
-    pmt_utils::tiletoepsg3857(x, y, z, &offset_x, &offset_y);
-
-    const uint8_t* ptr = (const uint8_t*)buffer.data();
-    const uint8_t* end = ptr + buffer.size();
-    auto read_varint = [&]() -> uint64_t {
-        uint64_t val = 0; int shift = 0;
-        while (ptr < end) {
-            uint8_t b = *ptr++;
-            val |= (uint64_t)(b & 0x7F) << shift;
-            if ((b & 0x80) == 0) break;
-            shift += 7;
-        }
-        return val;
-    };
-
-    while (ptr < end) {
-        uint64_t layer_len = read_varint();
-        if (layer_len == 0 || ptr >= end) break;
-        uint8_t tag = *ptr++;
-        if (tag != 1) { ptr += layer_len - 1; continue; }
-
-        // --- Layer header ---
-        uint64_t name_len = read_varint();
-        layer.name = std::string((char*)ptr, name_len);
-        ptr += name_len;
-        layer.extent = (uint32_t)read_varint();
-        uint64_t num_columns = read_varint();
-
-        // --- METADATA SECTION: read all column typeCodes + names ---
-        struct ColMeta { uint64_t typeCode; std::string name; };
-        std::vector<ColMeta> col_metas(num_columns);
-        for (uint64_t c = 0; c < num_columns; ++c) {
-            col_metas[c].typeCode = read_varint();
-            if (col_metas[c].typeCode >= 10) {
-                uint64_t cname_len = read_varint();
-                col_metas[c].name = std::string((char*)ptr, cname_len);
-                ptr += cname_len;
-            }
-        }
-
-        // Set up schema for attribute columns (column 0 is always GEOMETRY)
-        size_t num_attr = num_columns > 0 ? num_columns - 1 : 0;
+    layer.tiles.push_back(std::move(buffer));
+    mlt_layer_reader reader;
+    if (!reader.parse(layer.tiles.back()) || reader.num_features == 0) return;
+
+    size_t num_attr = reader.columns.size();
+    if (layer.xs.empty()) { // the schema is taken from the first tile with points
+        layer.name = reader.name;
+        layer.extent = reader.extent;
         layer.col_names.resize(num_attr);
         layer.col_types.resize(num_attr);
         layer.col_nullable.resize(num_attr);
         for (size_t c = 0; c < num_attr; ++c) {
-            uint64_t tc = col_metas[c + 1].typeCode;
-            layer.col_names[c] = col_metas[c + 1].name;
-            layer.col_nullable[c] = (tc % 2 == 1);
-            uint64_t base = tc - (tc % 2);
-            if      (base >= 16 && base <= 23) layer.col_types[c] = MLT_TYPE_INT;
-            else if (base >= 24 && base <= 27) layer.col_types[c] = MLT_TYPE_FLOAT;
-            else                               layer.col_types[c] = MLT_TYPE_STRING;
-        }
-
-        // --- DATA SECTION ---
-        // GEOMETRY column: has numStreams prefix
-        uint64_t geom_num_streams = read_varint();
-        size_t num_features = 0;
-        std::vector<int32_t> vx, vy;
-
-        for (uint64_t s = 0; s < geom_num_streams; ++s) {
-            if (ptr + 2 > end) break;
-            uint8_t h0 = *ptr++;
-            uint8_t h1 = *ptr++; (void)h1;
-            uint64_t num_vals = read_varint();
-            uint64_t byte_len = read_varint();
-            const uint8_t* sd = ptr;
-            ptr += byte_len;
-            uint8_t phys = (h0 >> 4) & 0x0F;
-            uint8_t dict = h0 & 0x0F;
-            if (phys == 1 && dict == 3) { // VERTEX stream
-                num_features = (size_t)(num_vals / 2);
-                vx.resize(num_features);
-                vy.resize(num_features);
-                const uint8_t* vp = sd;
-                for (size_t i = 0; i < num_features; ++i) {
-                    uint64_t zx = 0; int sh = 0;
-                    while (vp < sd+byte_len) { uint8_t b=*vp++; zx|=(uint64_t)(b&0x7F)<<sh; sh+=7; if(!(b&0x80)) break; }
-                    uint64_t zy = 0; sh = 0;
-                    while (vp < sd+byte_len) { uint8_t b=*vp++; zy|=(uint64_t)(b&0x7F)<<sh; sh+=7; if(!(b&0x80)) break; }
-                    vx[i] = (int32_t)((zx>>1) ^ -(int64_t)(zx&1));
-                    vy[i] = (int32_t)((zy>>1) ^ -(int64_t)(zy&1));
-                }
-            }
-        }
-
-        layer.features.resize(num_features);
-        for (size_t i = 0; i < num_features; ++i) {
-            layer.features[i].global_x = offset_x + scale_factor * vx[i];
-            layer.features[i].global_y = offset_y - scale_factor * vy[i];
-            layer.features[i].attrs.assign(num_attr, std::string());
+            layer.col_names[c] = reader.columns[c].name;
+            layer.col_types[c] = reader.columns[c].type;
+            layer.col_nullable[c] = reader.columns[c].nullable;
         }
-
-        // Attribute columns
-        for (size_t c = 0; c < num_attr; ++c) {
-            bool nullable = layer.col_nullable[c];
-            int ctype = layer.col_types[c];
-            bool is_str = (ctype == MLT_TYPE_STRING);
-            std::vector<bool> present(num_features, true);
-            std::vector<uint64_t> str_lens;
-            const uint8_t* str_data = nullptr;
-            uint64_t str_data_len = 0;
-
-            uint64_t ns = is_str ? read_varint() : (nullable ? 2 : 1);
-            for (uint64_t s = 0; s < ns; ++s) {
-                if (ptr + 2 > end) break;
-                uint8_t h0 = *ptr++;
-                uint8_t h1 = *ptr++; (void)h1;
-                uint64_t nv = read_varint();
-                uint64_t bl = read_varint();
-                const uint8_t* sd = ptr;
-                ptr += bl;
-                uint8_t phys = (h0 >> 4) & 0x0F;
-
-                if (phys == 0) { // PRESENT
-                    present = decode_bool_rle_pyr(sd, bl, num_features);
-                } else if (phys == 1) { // DATA
-                    if (ctype == MLT_TYPE_INT) {
-                        const uint8_t* dp = sd;
-                        size_t fi = 0;
-                        for (uint64_t vi = 0; vi < nv; ++vi) {
-                            uint64_t zig = 0; int sh = 0;
-                            while (dp < sd+bl) { uint8_t b=*dp++; zig|=(uint64_t)(b&0x7F)<<sh; sh+=7; if(!(b&0x80)) break; }
-                            int64_t val = (int64_t)((zig>>1) ^ -(int64_t)(zig&1));
-                            while (fi < num_features && !present[fi]) ++fi;
-                            if (fi < num_features) layer.features[fi++].attrs[c] = std::to_string(val);
-                        }
-                    } else if (ctype == MLT_TYPE_FLOAT) {
-                        const uint8_t* dp = sd;
-                        size_t fi = 0;
-                        for (uint64_t vi = 0; vi < nv; ++vi) {
-                            uint32_t bits = (uint32_t)dp[0]|((uint32_t)dp[1]<<8)|((uint32_t)dp[2]<<16)|((uint32_t)dp[3]<<24);
-                            dp += 4;
-                            float fval; memcpy(&fval, &bits, 4);
-                            while (fi < num_features && !present[fi]) ++fi;
-                            if (fi < num_features) {
-                                char buf[32]; snprintf(buf, sizeof(buf), "%.9g", (double)fval);
-                                layer.features[fi++].attrs[c] = buf;
-                            }
-                        }
-                    } else { // STRING DATA
-                        str_data = sd; str_data_len = bl; (void)nv;
-                    }
-                } else if (phys == 3) { // LENGTH (string lengths)
-                    const uint8_t* dp = sd;
-                    str_lens.reserve(nv);
-                    for (uint64_t vi = 0; vi < nv; ++vi) {
-                        uint64_t len = 0; int sh = 0;
-                        while (dp < sd+bl) { uint8_t b=*dp++; len|=(uint64_t)(b&0x7F)<<sh; sh+=7; if(!(b&0x80)) break; }
-                        str_lens.push_back(len);
-                    }
-                }
-            }
-
-            // Decode strings after all streams consumed
-            if (is_str && str_data && !str_lens.empty()) {
-                const uint8_t* dp = str_data;
-                size_t fi = 0;
-                for (size_t li = 0; li < str_lens.size(); ++li) {
-                    while (fi < num_features && !present[fi]) ++fi;
-                    if (fi < num_features) {
-                        layer.features[fi++].attrs[c] = std::string((char*)dp, str_lens[li]);
-                        dp += str_lens[li];
-                    }
-                }
-            }
-            (void)str_data_len;
+        layer.columns.assign(num_attr, mlt_layer_pyr::column_t());
+    } else {
+        if (num_attr != layer.col_names.size()) error("Inconsistent number of columns across MLT tiles");
+        for (size_t c = 0; c < num_attr; ++c)
+            if (reader.columns[c].name != layer.col_names[c] || reader.columns[c].type != layer.col_types[c])
+                error("Inconsistent column %s across MLT tiles", reader.columns[c].name.c_str());
+    }
+
+    size_t n = reader.num_features;
+    std::vector<int32_t> xy;
+    reader.decode_vertices(xy);
+    size_t first = layer.xs.size();
+    layer.xs.resize(first + n);
+    layer.ys.resize(first + n);
+    pmt_utils::pmt_tile_transform_t(z, x, y).to_global(xy.data(), n, &layer.xs[first], &layer.ys[first]);
+
+    // present values are stored densely; they are spread to one slot per point
+    std::vector<uint8_t> bits;
+    std::vector<int32_t> ivals;
+    std::vector<float> fvals;
+    std::vector<std::pair<const char*, uint32_t>> svals;
+    std::vector<std::string> entries;
+    for (size_t c = 0; c < num_attr; ++c) {
+        mlt_layer_pyr::column_t& col = layer.columns[c];
+        reader.decode_present(c, bits);
+        size_t nv = 0;
+        if      (layer.col_types[c] == MLT_COL_INT)   { reader.decode_ints(c, ivals);   nv = ivals.size(); }
+        else if (layer.col_types[c] == MLT_COL_FLOAT) { reader.decode_floats(c, fvals); nv = fvals.size(); }
+        else if (reader.columns[c].dictionary) {
+            // the entries are kept with the tiles, as front-coded entries are not contiguous in the tile
+            reader.decode_dictionary(c, entries, ivals);
+            std::string bytes;
+            for (const std::string& e : entries) bytes += e;
+            layer.tiles.push_back(std::move(bytes));
+            const char* p = layer.tiles.back().data();
+            std::vector<std::pair<const char*, uint32_t>> views;
+            for (const std::string& e : entries) { views.emplace_back(p, (uint32_t)e.size()); p += e.size(); }
+            svals.clear();
+            for (int32_t d : ivals) svals.push_back(views[d]);
+            nv = svals.size();
+        }
+        else                                          { reader.decode_strings(c, svals); nv = svals.size(); }
+        size_t vi = 0;
+        for (size_t i = 0; i < n; ++i) {
+            bool present = mlt_layer_reader::is_present(bits, i) && vi < nv;
+            col.present.push_back(present ? 1 : 0);
+            if (layer.col_types[c] == MLT_COL_INT)
+                col.ints.push_back(present ? ivals[vi] : 0);
+            else if (layer.col_types[c] == MLT_COL_FLOAT)
+                col.floats.push_back(present ? fvals[vi] : 0.0f);
+            else
+                col.strs.push_back(present ? svals[vi] : std::pair<const char*, uint32_t>("", 0));
+            if (present) ++vi;
         }
-
-        break; // only first layer
     }
 }
 
-// Encode an mlt_layer_pyr into MLT tile bytes
+// Encode the points of an mlt_layer_pyr at indices into MLT tile bytes
 std::string encode_mlt_layer(const mlt_layer_pyr& layer, const std::vector<int>& indices,
-                              uint8_t z, uint32_t x, uint32_t y) {
+                              uint8_t z, uint32_t x, uint32_t y, const mlt_write_options& mlt_opts) {
     double scale_factor = pmt_utils::epsg3857_scale_factor(z);
     double offset_x, offset_y;
     pmt_utils::tiletoepsg3857(x, y, z, &offset_x, &offset_y);
 
-    size_t n = indices.size();
+    mlt_layer_writer writer(layer.name, layer.extent > 0 ? layer.extent : 4096, mlt_opts);
     size_t num_attr = layer.col_names.size();
-    const std::string& lname = layer.name;
-    uint32_t extent = layer.extent > 0 ? layer.extent : 4096;
-
-    std::string tmp;
-    auto av = [&](uint64_t v) {
-        do { uint8_t b=v&0x7F; v>>=7; if(v) b|=0x80; tmp.push_back(b); } while(v);
-    };
-
-    // METADATA
-    av(lname.size()); tmp.append(lname);
-    av(extent);
-    av(1 + num_attr);
-    av(4); // GEOMETRY, no name
-    for (size_t c = 0; c < num_attr; ++c) {
-        int tc;
-        if      (layer.col_types[c] == MLT_TYPE_INT)   tc = layer.col_nullable[c] ? 17 : 16;
-        else if (layer.col_types[c] == MLT_TYPE_FLOAT)  tc = layer.col_nullable[c] ? 25 : 24;
-        else                                             tc = layer.col_nullable[c] ? 29 : 28;
-        av(tc);
-        av(layer.col_names[c].size()); tmp.append(layer.col_names[c]);
-    }
-
-    // DATA: GEOMETRY
-    av(2); // numStreams
-    // GeomType stream: 0x10=DATA/NONE, 0x02=VARINT, numValues=n, byteLen=n (each 0=varint POINT)
-    tmp.push_back(0x10); tmp.push_back(0x02);
-    av(n); av(n);
-    for (size_t i = 0; i < n; ++i) tmp.push_back(0);
-    // Vertex stream
-    std::string vdata;
-    auto vv = [&](uint64_t v) {
-        do { uint8_t b=v&0x7F; v>>=7; if(v) b|=0x80; vdata.push_back(b); } while(v);
-    };
-    for (size_t i = 0; i < n; ++i) {
+    for (size_t c = 0; c < num_attr; ++c)
+        writer.add_column(layer.col_names[c], layer.col_types[c], layer.col_nullable[c]);
+    for (size_t i = 0; i < indices.size(); ++i) {
         int fi = indices[i];
-        int32_t px = (int32_t)std::round((layer.features[fi].global_x - offset_x) / scale_factor);
-        int32_t py = (int32_t)std::round((offset_y - layer.features[fi].global_y) / scale_factor);
-        vv(((uint32_t)px << 1) ^ (uint32_t)(px >> 31));
-        vv(((uint32_t)py << 1) ^ (uint32_t)(py >> 31));
-    }
-    tmp.push_back(0x13); tmp.push_back(0x02);
-    av(n * 2); av(vdata.size()); tmp.append(vdata);
-
-    // DATA: attribute columns
-    for (size_t c = 0; c < num_attr; ++c) {
-        bool nullable = layer.col_nullable[c];
-        int ctype = layer.col_types[c];
-        std::vector<bool> present(n, true);
-        if (nullable) {
-            for (size_t i = 0; i < n; ++i) {
-                int fi = indices[i];
-                const std::string& v = (c < layer.features[fi].attrs.size()) ? layer.features[fi].attrs[c] : "";
-                present[i] = !v.empty();
-            }
-        }
-        size_t nn = 0;
-        for (size_t i = 0; i < n; ++i) if (present[i]) ++nn;
-
-        if (ctype == MLT_TYPE_INT) {
-            std::string idata;
-            auto iv = [&](uint64_t v) {
-                do { uint8_t b=v&0x7F; v>>=7; if(v) b|=0x80; idata.push_back(b); } while(v);
-            };
-            for (size_t i = 0; i < n; ++i) {
-                if (!present[i]) continue;
-                int fi = indices[i];
-                const std::string& s = (c < layer.features[fi].attrs.size()) ? layer.features[fi].attrs[c] : "0";
-                int32_t val = 0; try { val = std::stoi(s); } catch (...) {}
-                iv(((uint32_t)val << 1) ^ (uint32_t)(val >> 31));
-            }
-            if (nullable) {
-                std::string rle = encode_bool_rle_pyr(present);
-                tmp.push_back(0x00); tmp.push_back(0x02); av(n); av(rle.size()); tmp.append(rle);
-            }
-            tmp.push_back(0x10); tmp.push_back(0x02); av(nn); av(idata.size()); tmp.append(idata);
-        } else if (ctype == MLT_TYPE_FLOAT) {
-            std::string fdata;
-            for (size_t i = 0; i < n; ++i) {
-                if (!present[i]) continue;
-                int fi = indices[i];
-                const std::string& s = (c < layer.features[fi].attrs.size()) ? layer.features[fi].attrs[c] : "0";
-                float val = 0.0f; try { val = std::stof(s); } catch (...) {}
-                uint32_t bits; memcpy(&bits, &val, 4);
-                fdata.push_back(bits&0xFF); fdata.push_back((bits>>8)&0xFF);
-                fdata.push_back((bits>>16)&0xFF); fdata.push_back((bits>>24)&0xFF);
-            }
-            if (nullable) {
-                std::string rle = encode_bool_rle_pyr(present);
-                tmp.push_back(0x00); tmp.push_back(0x02); av(n); av(rle.size()); tmp.append(rle);
-            }
-            tmp.push_back(0x10); tmp.push_back(0x00); av(nn); av(fdata.size()); tmp.append(fdata);
-        } else { // STRING
-            std::string ldata, sdata;
-            auto lv = [&](uint64_t v) {
-                do { uint8_t b=v&0x7F; v>>=7; if(v) b|=0x80; ldata.push_back(b); } while(v);
-            };
-            for (size_t i = 0; i < n; ++i) {
-                if (!present[i]) continue;
-                int fi = indices[i];
-                const std::string& s = (c < layer.features[fi].attrs.size()) ? layer.features[fi].attrs[c] : "";
-                lv(s.size()); sdata.append(s);
-            }
-            av(nullable ? 3 : 2);
-            if (nullable) {
-                std::string rle = encode_bool_rle_pyr(present);
-                tmp.push_back(0x00); tmp.push_back(0x02); av(n); av(rle.size()); tmp.append(rle);
-            }
-            tmp.push_back(0x30); tmp.push_back(0x02); av(nn); av(ldata.size()); tmp.append(ldata);
-            tmp.push_back(0x10); tmp.push_back(0x00); av(0); av(sdata.size()); tmp.append(sdata);
+        int32_t px = (int32_t)std::round((layer.xs[fi] - offset_x) / scale_factor);
+        int32_t py = (int32_t)std::round((offset_y - layer.ys[fi]) / scale_factor);
+        writer.add_point(px, py);
+        for (size_t c = 0; c < num_attr; ++c) {
+            const mlt_layer_pyr::column_t& col = layer.columns[c];
+            if (!col.present[fi])
+                writer.add_null(c);
+            else if (layer.col_types[c] == MLT_COL_INT)
+                writer.add_int(c, col.ints[fi]);
+            else if (layer.col_types[c] == MLT_COL_FLOAT)
+                writer.add_float(c, col.floats[fi]);
+            else
+                writer.add_string(c, col.strs[fi].first, col.strs[fi].second);
         }
     }
-
-    // Layer wrapper
-    std::string out;
-    auto ov = [&](uint64_t v) {
-        do { uint8_t b=v&0x7F; v>>=7; if(v) b|=0x80; out.push_back(b); } while(v);
-    };
-    ov(1 + tmp.size());
-    out.push_back(1);
-    out.append(tmp);
-    return out;
+    return writer.finish();
 }
 
 std::string encode_mvt(const fast_mvt& df, const std::vector<int>& indices, uint8_t z, uint32_t x, uint32_t y, const std::string& layer_name) {
@@ -732,7 +420,7 @@ void get_subset_indices(const fast_mvt& df, uint64_t max_features, uint32_t seed
 }
 
 void get_subset_indices_mlt(const mlt_layer_pyr& layer, uint64_t max_features, uint32_t seed, std::vector<int>& indices) {
-    size_t total_points = layer.features.size();
+    size_t total_points = layer.num_points();
     indices.clear();
     if (total_points <= max_features) {
         indices.resize(total_points);
@@ -753,6 +441,40 @@ int out_fd = -1;
 uint64_t current_out_offset = 0;
 std::vector<pmtiles::entryv3> final_entries;
 std::string layer_name_global = "data";
+uint8_t tile_compression_global = pmtiles::COMPRESSION_GZIP; // compression of the tiles written to out_fd
+int32_t compression_level_global = 0;
+
+// compress an encoded tile with the output tile compression
+static std::string compress_tile(std::string data) {
+    if (tile_compression_global == pmtiles::COMPRESSION_NONE) return data;
+    std::string out;
+    pmt_pts::compress_bytes(data.data(), data.size(), tile_compression_global, compression_level_global, out);
+    return out;
+}
+
+// read exactly length bytes at offset of out_fd, as pread() may return fewer bytes than requested
+static void pread_fully(char* buf, size_t length, uint64_t offset) {
+    size_t got = 0;
+    while (got < length) {
+        ssize_t rc = pread(out_fd, buf + got, length - got, static_cast<off_t>(offset + got));
+        if (rc < 0 && errno == EINTR) continue;
+        if (rc <= 0)
+            error("Failed to read %zu bytes at offset %llu of the temporary tile file: %s", length, (unsigned long long)offset, rc < 0 ? strerror(errno) : "unexpected end of file");
+        got += static_cast<size_t>(rc);
+    }
+}
+
+// read a tile already written to out_fd and return its uncompressed bytes
+static void read_written_tile(const pmtiles::entryv3& e, std::string& out) {
+    if (tile_compression_global == pmtiles::COMPRESSION_NONE) {
+        out.resize(e.length);
+        pread_fully(&out[0], e.length, e.offset);
+        return;
+    }
+    std::string comp(e.length, '\0');
+    pread_fully(&comp[0], e.length, e.offset);
+    pmt_pts::decompress_bytes(comp.data(), comp.size(), tile_compression_global, out);
+}
 std::map<uint64_t, size_t> tile_feature_counts; // track feature counts for uniform subsampling
 
 class PyramidBuilderQueue {
@@ -824,9 +546,8 @@ void builder_worker_pass1(PyramidBuilderQueue& queue,
 
                 total_compressed += it->second.length;
 
-                std::string compressed(it->second.length, '\0');
-                pread(out_fd, &compressed[0], it->second.length, it->second.offset);
-                std::string uncompressed = gzip_decompress(compressed);
+                std::string uncompressed;
+                read_written_tile(it->second, uncompressed);
 
                 size_t nf = (tile_type == 0x06)
                     ? count_mlt_features_quick(uncompressed)
@@ -838,8 +559,12 @@ void builder_worker_pass1(PyramidBuilderQueue& queue,
         if (ptd.post_density_count == 0) continue;
 
         // Estimate uncompressed size: compressed child bytes * compression ratio.
-        // scale_factor_compression approximates the compression ratio (default 10x).
-        ptd.estimated_uncompressed = (size_t)(total_compressed * scale_factor_compression);
+        // scale_factor_compression approximates the compression ratio (default 10x);
+        // uncompressed children already give the size directly.
+        if (tile_compression_global == pmtiles::COMPRESSION_NONE)
+            ptd.estimated_uncompressed = total_compressed;
+        else
+            ptd.estimated_uncompressed = (size_t)(total_compressed * scale_factor_compression);
 
         {
             std::lock_guard<std::mutex> lock(results_mutex);
@@ -861,6 +586,10 @@ int32_t cmd_build_pyramid_pmtiles(int32_t argc, char **argv)
     double scale_factor_compression = 10.0;
     int32_t est_bytes_per_column = 8;
     int32_t est_offset_per_point = 20;
+    std::string compression;
+    int32_t compression_level = 0;
+    std::string in_index; // inverted tile index of the input
+    mlt_write_options mlt_opts;
 
     paramList pl;
     BEGIN_LONG_PARAMS(longParameters)
@@ -874,6 +603,11 @@ int32_t cmd_build_pyramid_pmtiles(int32_t argc, char **argv)
     LONG_DOUBLE_PARAM("scale-factor-compression", &scale_factor_compression, "Compression aggressiveness (higher means smaller tiles but more features dropped)")
     LONG_INT_PARAM("est-bytes-per-column", &est_bytes_per_column, "Estimated bytes per column")
     LONG_INT_PARAM("est-offset-per-point", &est_offset_per_point, "Estimated offset per point")
+    LONG_STRING_PARAM("compression", &compression, "Tile compression: gzip, zstd, or none (for intermediate files read only by pmpoint) [default: same as input]")
+    LONG_INT_PARAM("level", &compression_level, "Compression level (gzip 1-9, zstd 1-22); 0 uses the library default")
+    LONG_STRING_PARAM("index", &in_index, "Inverted tile index of the input, extended to all zoom levels in [out].idx.gz [default: [in].idx.gz if it exists]")
+    LONG_PARAM("mlt-packed-ints", &mlt_opts.packed_ints, "Allow bit-packed MLT integer streams (smaller tiles, but a pmpoint extension that other MLT decoders cannot read)")
+    LONG_PARAM("mlt-front-coding", &mlt_opts.front_coding, "Allow front-coded MLT string dictionaries (smaller tiles, but a pmpoint extension that other MLT decoders cannot read)")
 
     END_LONG_PARAMS();
 
@@ -900,6 +634,19 @@ int32_t cmd_build_pyramid_pmtiles(int32_t argc, char **argv)
         error("Unsupported PMTiles format: tile_type=%d", tile_type);
     }
 
+    uint8_t in_compression = pmt.hdr.tile_compression;
+    if (compression.empty()) {
+        tile_compression_global = in_compression;
+    } else {
+        tile_compression_global = pmt_pts::parse_compression(compression);
+        if (tile_compression_global == pmtiles::COMPRESSION_UNKNOWN)
+            error("Unsupported compression '%s'. Must be 'gzip', 'zstd' or 'none'.", compression.c_str());
+    }
+    compression_level_global = compression_level;
+    // z_max tiles are copied verbatim only if they are already in the output compression at the requested level
+    bool recompress_zmax = (tile_compression_global != in_compression) || (compression_level > 0 && tile_compression_global != pmtiles::COMPRESSION_NONE);
+    notice("Tile compression: %s -> %s", pmt_pts::compression_name(in_compression), pmt_pts::compression_name(tile_compression_global));
+
     uint8_t z_max = pmt.hdr.max_zoom;
     if (min_zoom > z_max) min_zoom = z_max;
     notice("Constructing pyramid from zoom %d down to %d", z_max, min_zoom);
@@ -909,29 +656,9 @@ int32_t cmd_build_pyramid_pmtiles(int32_t argc, char **argv)
         std::string buffer;
         pmt.fetch_tile_to_buffer(pmt.tile_entries[0].z, pmt.tile_entries[0].x, pmt.tile_entries[0].y, buffer);
         if (tile_type == 0x06) {
-            const char* ptr = buffer.data();
-            const char* end = buffer.data() + buffer.size();
-            auto read_varint = [&]() -> uint64_t {
-                uint64_t val = 0; int shift = 0;
-                while (ptr < end) {
-                    uint8_t b = *ptr++;
-                    val |= (uint64_t)(b & 0x7F) << shift;
-                    if ((b & 0x80) == 0) break;
-                    shift += 7;
-                }
-                return val;
-            };
-            while (ptr < end) {
-                uint64_t layer_len = read_varint();
-                if (layer_len == 0 || ptr >= end) break;
-                uint8_t tag = *ptr++;
-                if (tag == 1) {
-                    uint64_t name_len = read_varint();
-                    layer_name_global = std::string(ptr, name_len);
-                    break;
-                }
-                ptr += layer_len - 1;
-            }
+            mlt_layer_reader reader;
+            if (reader.parse(buffer))
+                layer_name_global = reader.name;
         } else {
             mapbox::vector_tile::buffer* p_tile = new mapbox::vector_tile::buffer(buffer);
             if (p_tile && p_tile->layerNames().size() > 0) {
@@ -950,30 +677,34 @@ int32_t cmd_build_pyramid_pmtiles(int32_t argc, char **argv)
 
     size_t zmax_total_features = 0;
     notice("Copying z_max tiles...");
-    for(size_t i=0; i<pmt.tile_entries.size(); ++i) {
+    std::pair<uint32_t, uint32_t> zmax_range = pmt.zoom_range(z_max);
+    for(size_t i=zmax_range.first; i<zmax_range.second; ++i) {
         const auto& entry = pmt.tile_entries[i];
-        if (entry.z == z_max) {
-            std::string buffer;
-            pmt.flex_reader_ptr->read_at(entry.offset, entry.length, buffer);
-
-            // Count features for uniform subsampling tracking
-            std::string uncompressed = gzip_decompress(buffer);
-            size_t nf = 0;
-            if (tile_type == 0x06)
-                nf = count_mlt_features_quick(uncompressed);
-            else
-                nf = count_mvt_features_quick(uncompressed);
-            zmax_total_features += nf;
-
-            pwrite(out_fd, buffer.data(), buffer.size(), current_out_offset);
-
-            uint64_t tile_id = pmtiles::zxy_to_tileid(entry.z, entry.x, entry.y);
-            pmtiles::entryv3 e(tile_id, current_out_offset, buffer.size(), 1);
-            final_entries.push_back(e);
-            level_entries[tile_id] = e;
-            tile_feature_counts[tile_id] = nf;
-            current_out_offset += buffer.size();
-        }
+        std::string buffer;
+        pmt.flex_reader_ptr->read_at(entry.offset, entry.length, buffer);
+
+        // Count features for uniform subsampling tracking
+        std::string uncompressed;
+        if (in_compression != pmtiles::COMPRESSION_NONE)
+            pmt_pts::decompress_bytes(buffer.data(), buffer.size(), in_compression, uncompressed);
+        const std::string& raw = (in_compression == pmtiles::COMPRESSION_NONE) ? buffer : uncompressed;
+        size_t nf = 0;
+        if (tile_type == 0x06)
+            nf = count_mlt_features_quick(raw);
+        else
+            nf = count_mvt_features_quick(raw);
+        if (recompress_zmax)
+            buffer = compress_tile(raw);
+        zmax_total_features += nf;
+
+        pwrite(out_fd, buffer.data(), buffer.size(), current_out_offset);
+
+        uint64_t tile_id = pmtiles::zxy_to_tileid(entry.z, entry.x, entry.y);
+        pmtiles::entryv3 e(tile_id, current_out_offset, buffer.size(), 1);
+        final_entries.push_back(e);
+        level_entries[tile_id] = e;
+        tile_feature_counts[tile_id] = nf;
+        current_out_offset += buffer.size();
     }
     notice("  z%d: %zu tiles, %zu total features", z_max, level_entries.size(), zmax_total_features);
 
@@ -1056,7 +787,7 @@ int32_t cmd_build_pyramid_pmtiles(int32_t argc, char **argv)
                 threads.emplace_back([&pass1_results, &level_entries, &new_level_entries,
                                       s, e, max_tile_bytes,
                                       tile_type, level_ratio, scale_factor_compression,
-                                      est_offset_per_point, est_bytes_per_column]() {
+                                      est_offset_per_point, est_bytes_per_column, &mlt_opts]() {
                     for (size_t ti = s; ti < e; ++ti) {
                         const parent_tile_data& ptd = pass1_results[ti];
                         uint32_t tz = ptd.z, tx = ptd.x, ty = ptd.y;
@@ -1071,35 +802,22 @@ int32_t cmd_build_pyramid_pmtiles(int32_t argc, char **argv)
                         if (tile_type == 0x06) {
                             // Decode child tiles inline — memory freed at end of this block
                             mlt_layer_pyr combined;
-                            bool schema_set = false;
                             for (int dy = 0; dy < 2; ++dy) {
                                 for (int dx = 0; dx < 2; ++dx) {
                                     uint32_t cz = tz+1, cx = 2*tx+dx, cy = 2*ty+dy;
                                     uint64_t c_id = pmtiles::zxy_to_tileid(cz, cx, cy);
                                     auto it = level_entries.find(c_id);
                                     if (it == level_entries.end()) continue;
-                                    std::string comp(it->second.length, '\0');
-                                    pread(out_fd, &comp[0], it->second.length, it->second.offset);
-                                    std::string uncomp = gzip_decompress(comp);
-                                    mlt_layer_pyr child;
-                                    decode_mlt_layer(uncomp, cz, cx, cy, child);
-                                    if (!schema_set && !child.features.empty()) {
-                                        combined.name = child.name;
-                                        combined.extent = child.extent;
-                                        combined.col_names = child.col_names;
-                                        combined.col_types = child.col_types;
-                                        combined.col_nullable = child.col_nullable;
-                                        schema_set = true;
-                                    }
-                                    for (auto& f : child.features)
-                                        combined.features.push_back(std::move(f));
+                                    std::string uncomp;
+                                    read_written_tile(it->second, uncomp);
+                                    decode_mlt_layer(std::move(uncomp), cz, cx, cy, combined);
                                 }
                             }
-                            if (combined.features.empty()) continue;
+                            if (combined.num_points() == 0) continue;
 
                             uint64_t current_max = tile_cap;
-                            if (current_max > combined.features.size())
-                                current_max = combined.features.size();
+                            if (current_max > combined.num_points())
+                                current_max = combined.num_points();
                             while (current_max > 0) {
                                 get_subset_indices_mlt(combined, current_max, seed, indices);
                                 size_t est = indices.size() * (est_offset_per_point + combined.col_names.size() * est_bytes_per_column);
@@ -1110,8 +828,8 @@ int32_t cmd_build_pyramid_pmtiles(int32_t argc, char **argv)
                                 else current_max = next_max;
                             }
                             if (current_max > 0 && !indices.empty()) {
-                                std::string encoded = encode_mlt_layer(combined, indices, tz, tx, ty);
-                                std::string compressed = gzip_compress(encoded);
+                                std::string encoded = encode_mlt_layer(combined, indices, tz, tx, ty, mlt_opts);
+                                std::string compressed = compress_tile(std::move(encoded));
                                 std::lock_guard<std::mutex> lock(out_mutex);
                                 pwrite(out_fd, compressed.data(), compressed.size(), current_out_offset);
                                 pmtiles::entryv3 new_entry(tile_id, current_out_offset, compressed.size(), 1);
@@ -1131,9 +849,8 @@ int32_t cmd_build_pyramid_pmtiles(int32_t argc, char **argv)
                                     uint64_t c_id = pmtiles::zxy_to_tileid(cz, cx, cy);
                                     auto it = level_entries.find(c_id);
                                     if (it == level_entries.end()) continue;
-                                    std::string comp(it->second.length, '\0');
-                                    pread(out_fd, &comp[0], it->second.length, it->second.offset);
-                                    std::string uncomp = gzip_decompress(comp);
+                                    std::string uncomp;
+                                    read_written_tile(it->second, uncomp);
                                     fast_mvt child;
                                     decode_mvt_raw(uncomp, cz, cx, cy, child);
                                     std::vector<uint32_t> k_remap(child.keys.size());
@@ -1179,7 +896,7 @@ int32_t cmd_build_pyramid_pmtiles(int32_t argc, char **argv)
                             }
                             if (current_max_features > 0 && !indices.empty()) {
                                 std::string encoded = encode_mvt(combined, indices, tz, tx, ty, layer_name_global);
-                                std::string final_compressed = gzip_compress(encoded);
+                                std::string final_compressed = compress_tile(std::move(encoded));
                                 std::lock_guard<std::mutex> lock(out_mutex);
                                 pwrite(out_fd, final_compressed.data(), final_compressed.size(), current_out_offset);
                                 pmtiles::entryv3 new_entry(tile_id, current_out_offset, final_compressed.size(), 1);
@@ -1255,8 +972,8 @@ int32_t cmd_build_pyramid_pmtiles(int32_t argc, char **argv)
     header.tile_entries_count = final_entries.size();
     header.tile_contents_count = final_entries.size();
     header.clustered = false; 
-    header.internal_compression = pmtiles::COMPRESSION_GZIP;
-    header.tile_compression = pmtiles::COMPRESSION_GZIP;
+    header.internal_compression = pmtiles::COMPRESSION_GZIP; // directories stay gzip for compatibility with other readers
+    header.tile_compression = tile_compression_global;
     header.tile_type = tile_type;
     header.min_zoom = min_zoom;
     
@@ -1284,6 +1001,22 @@ int32_t cmd_build_pyramid_pmtiles(int32_t argc, char **argv)
     close(out_final);
     
     unlink(tmp_file.c_str());
+
+    // extend the inverted tile index to the lower zoom levels; their counts are of the z_max points under each tile
+    // the default sidecar of the input is skipped if it belongs to another version of the input
+    bool index_given = !in_index.empty();
+    if (!index_given) in_index = pt_tile_index::find_default(in_pmtiles);
+    pt_tile_index tile_index;
+    if (!in_index.empty() && tile_index.read(in_index, pmt.hdr, index_given)) {
+        tile_index.add_parent_zooms(z_max, (uint8_t)min_zoom);
+        std::string out_index = pt_tile_index::default_path(out_pmtiles);
+        notice("Writing the index of %zu values of %s to %s...", tile_index.postings.size(), tile_index.column.c_str(), out_index.c_str());
+        tile_index.set_archive(header);
+        tile_index.write(out_index);
+    }
+    else {
+        pt_tile_index::remove_default(out_pmtiles);
+    }
     notice("Done!");
     return 0;
 }
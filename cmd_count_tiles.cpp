@@ -22,6 +22,9 @@
 int32_t cmd_count_tiles(int32_t argc, char **argv)
 {
     std::string pmtilesf;
+    std::string cache_dir; // local cache for remote inputs
+    int32_t cache_max_mb = 10240;
+    int32_t max_connections = 8; // requests in flight to remote inputs
     int32_t zoom = -1;             // -1 represents the max zoom level available
     int32_t verbose_freq = 100000; // not a parameter
 
@@ -34,6 +37,9 @@ int32_t cmd_count_tiles(int32_t argc, char **argv)
     BEGIN_LONG_PARAMS(longParameters)
     LONG_PARAM_GROUP("Input options", NULL)
     LONG_STRING_PARAM("in", &pmtilesf, "Input PMTiles file")
+    LONG_STRING_PARAM("cache-dir", &cache_dir, "Directory to persist data downloaded from remote (http/https/s3) inputs across runs")
+    LONG_INT_PARAM("cache-max-mb", &cache_max_mb, "Maximum size of --cache-dir in MB (default: 10240)")
+    LONG_INT_PARAM("max-connections", &max_connections, "Maximum number of concurrent requests to remote (http/https/s3) inputs (default: 8)")
 
     LONG_PARAM_GROUP("Output options", NULL)
     LONG_STRING_PARAM("out-tsv", &out_tsvf, "Output TSV file")
@@ -63,6 +69,12 @@ int32_t cmd_count_tiles(int32_t argc, char **argv)
     //     error("Missing required options --out-tsv or --out-json (at least 1 required)");
     // }
 
+    FlexReaderFactory::set_max_connections(max_connections);
+    if (!cache_dir.empty())
+    {
+        FlexReaderFactory::set_disk_cache(cache_dir.c_str(), (uint64_t)cache_max_mb << 20);
+    }
+
     // Open a PMTiles file
     pmt_pts pmt(pmtilesf.c_str());
 
@@ -118,29 +130,31 @@ int32_t cmd_count_tiles(int32_t argc, char **argv)
     std::vector<std::map<uint64_t, uint64_t> > zoom2tile2count(pmt.hdr.max_zoom + 1);
     std::vector<std::map<uint64_t, uint64_t> > zoom2tile2sum(pmt.hdr.max_zoom + 1);
 
-    std::string buffer;
-    for (int32_t i = 0; i < pmt.tile_entries.size(); ++i)
+    // visit only the tiles at the selected zoom level, if specified
+    std::pair<uint32_t, uint32_t> zoom_range = zoom >= 0 ? pmt.zoom_range(zoom) : std::make_pair((uint32_t)0, (uint32_t)pmt.tile_entries.size());
+    std::vector<pmtiles::zxy> tiles;
+    for (int32_t i = zoom_range.first; i < zoom_range.second; ++i)
     {
-        pmtiles::entry_zxy &entry = pmt.tile_entries[i];
-
-        if ( zoom >= 0 && entry.z != zoom )
-        {
-            continue;
-        }
+        const pmtiles::entry_zxy &entry = pmt.tile_entries[i];
+        tiles.push_back(pmtiles::zxy(entry.z, entry.x, entry.y));
+    }
 
-        if ( i % 100 == 0 ) {
-            notice("Processing %d-th tile %d/%d/%d", i+1, entry.z, entry.x, entry.y);
+    // fetch the tiles in file order
+    uint64_t n_processed = 0;
+    pmt.fetch_tiles(tiles, [&](size_t k, const pmtiles::entry_zxy &entry, std::string &buffer)
+    {
+        if ( n_processed % 100 == 0 ) {
+            notice("Processing %llu-th tile %d/%d/%d", n_processed+1, entry.z, entry.x, entry.y);
         }
+        ++n_processed;
 
-        // notice("Fetching tile %d/%d/%d that intersects with the region", entry.z, entry.x, entry.y);
-        pmt.fetch_tile_to_buffer(entry.z, entry.x, entry.y, buffer);
         uint64_t n_points = mvt.count_points(buffer); //, entry.z, entry.x, entry.y);
         //uint64_t n_points = mvt.count_points(pmt.tile_data_str, entry.z, entry.x, entry.y);
         //notice("Tile %d/%d/%d has %llu points", entry.z, entry.x, entry.y, n_points);
 
         uint64_t xy = (((uint64_t)entry.x) << 32 | (uint64_t)entry.y);
         zoom2tile2count[entry.z][xy] = n_points;
-    }
+    });
 
     // build hierarchical counts
     if ( zoom < 0 ) {
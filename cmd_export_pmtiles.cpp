@@ -1,248 +1,233 @@
 #include "pmpoint.h"
 #include "qgenlib/tsv_reader.h"
 #include "qgenlib/qgen_error.h"
+#include "qgenlib/qgen_utils.h"
 
 #include <vector>
 #include <string>
 #include <cstring>
 #include <climits>
 #include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
 
 #include "pmt_pts.h"
 #include "pmt_utils.h"
 #include "polygon.h"
 #include "mvt_pts.h"
+#include "pt_predicate.h"
+#include "pt_zonemap.h"
+#include "pt_tile_index.h"
+#include "mlt_codec.h"
 #include "htslib/hts.h"
 #include "ext/nlohmann/json.hpp"
 
 // ---- MLT tile decoding helpers ----
 
 
-static std::vector<bool> mlt_export_decode_bool_rle(const uint8_t* data, size_t len, size_t count) {
-    std::vector<bool> result;
-    result.reserve(count);
-    size_t i = 0;
-    while (i < len && result.size() < count) {
-        uint8_t header = data[i++];
-        if (header >= 128) {
-            size_t run_len = 256 - header;
-            for (size_t j = 0; j < run_len && i < len && result.size() < count; ++j, ++i) {
-                uint8_t byte = data[i];
-                for (int b = 0; b < 8 && result.size() < count; ++b)
-                    result.push_back((byte >> b) & 1);
-            }
-        } else {
-            size_t run_len = header + 3;
-            if (i < len) {
-                uint8_t byte = data[i++];
-                for (size_t j = 0; j < run_len && result.size() < count; ++j)
-                    for (int b = 0; b < 8 && result.size() < count; ++b)
-                        result.push_back((byte >> b) & 1);
-            }
+// Per-tile dictionary of a string column, keyed by the bytes in the tile buffer
+struct mlt_export_str_dict {
+    struct key_t {
+        const char* p;
+        uint32_t n;
+        bool operator==(const key_t& o) const { return n == o.n && memcmp(p, o.p, n) == 0; }
+    };
+    struct key_hash {
+        size_t operator()(const key_t& k) const {
+            uint64_t h = 1469598103934665603ULL; // FNV-1a
+            for (uint32_t i = 0; i < k.n; ++i) { h ^= (uint8_t)k.p[i]; h *= 1099511628211ULL; }
+            return (size_t)h;
         }
+    };
+    std::unordered_map<key_t, uint32_t, key_hash> codes;
+
+    // dictionary code of the string, adding it to the column dictionary on first use
+    uint32_t code(pt_column& col, const char* p, uint32_t n) {
+        auto it = codes.find(key_t{p, n});
+        if (it != codes.end()) return it->second;
+        uint32_t c = col.add_dict(p, n);
+        codes.emplace(key_t{p, n}, c);
+        return c;
     }
-    while (result.size() < count) result.push_back(true);
-    return result;
-}
+};
 
 // Decode an MLT tile and populate pt_dataframe, applying the same
 // bounding-box and polygon filters used by the MVT path.
+// If `columns` is not empty, only those columns are decoded, in that order;
+// the other columns are not decoded, unless p_predicate needs them.
+// p_predicate (if not NULL) is evaluated column-at-a-time before any row is added,
+// once per distinct string of a string column.
 // NOTE: fetch_tile_to_buffer already decompresses, so `tile_buf` is raw MLT bytes.
 static void decode_mlt_tile_to_df(const std::string& tile_buf, uint8_t zoom,
                                    int64_t tile_x, int64_t tile_y, pt_dataframe& df,
                                    pmt_utils::pmt_pt_t* p_min_pt,
                                    pmt_utils::pmt_pt_t* p_max_pt,
-                                   const std::vector<Polygon*>& polygons) {
+                                   const PolygonIndex* p_polygons,
+                                   const std::vector<std::string>& columns,
+                                   const pt_predicate* p_predicate) {
     const std::string& buf = tile_buf;
     if (buf.empty()) return;
 
-    double scale_factor = pmt_utils::epsg3857_scale_factor(zoom);
-    double offset_x, offset_y;
-    pmt_utils::tiletoepsg3857(tile_x, tile_y, zoom, &offset_x, &offset_y);
-
-    const uint8_t* ptr = (const uint8_t*)buf.data();
-    const uint8_t* end = ptr + buf.size();
-    auto rv = [&]() -> uint64_t {
-        uint64_t val = 0; int shift = 0;
-        while (ptr < end) {
-            uint8_t b = *ptr++;
-            val |= (uint64_t)(b & 0x7F) << shift;
-            if ((b & 0x80) == 0) break;
-            shift += 7;
-        }
-        return val;
-    };
-
-    while (ptr < end) {
-        uint64_t layer_len = rv();
-        if (layer_len == 0 || ptr >= end) break;
-        uint8_t tag = *ptr++;
-        if (tag != 1) { ptr += layer_len - 1; continue; }
-
-        // Layer header: name, extent, num_columns
-        uint64_t name_len = rv();
-        ptr += name_len;
-        rv(); // extent (unused here)
-        uint64_t num_columns = rv();
-
-        // Read all column metadata first (metadata section)
-        struct ColMeta { uint64_t typeCode; std::string name; };
-        std::vector<ColMeta> col_metas(num_columns);
-        for (uint64_t c = 0; c < num_columns; ++c) {
-            col_metas[c].typeCode = rv();
-            if (col_metas[c].typeCode >= 10) {
-                uint64_t cname_len = rv();
-                col_metas[c].name = std::string((char*)ptr, cname_len);
-                ptr += cname_len;
-            }
-        }
-
-        size_t num_attr = num_columns > 0 ? num_columns - 1 : 0;
-        // col_types: 2=INT, 1=FLOAT, 0=STRING
-        std::vector<int>  col_types(num_attr);
-        std::vector<bool> col_nullable(num_attr);
-        for (size_t c = 0; c < num_attr; ++c) {
-            uint64_t tc = col_metas[c + 1].typeCode;
-            col_nullable[c] = (tc % 2 == 1);
-            uint64_t base = tc - (tc % 2);
-            if      (base >= 20 && base <= 23) col_types[c] = 2;
-            else if (base >= 24 && base <= 27) col_types[c] = 1;
-            else                               col_types[c] = 0;
-        }
+    mlt_layer_reader reader;
+    if (!reader.parse(buf)) return;
+    size_t num_attr = reader.columns.size();
+    size_t num_features = reader.num_features;
+
+    // Output column of each attribute (-1 if not selected)
+    std::vector<int32_t> col_out(num_attr, -1);
+    for (size_t c = 0; c < num_attr; ++c) {
+        if (columns.empty()) { col_out[c] = (int32_t)c; continue; }
+        for (size_t j = 0; j < columns.size(); ++j)
+            if (columns[j] == reader.columns[c].name) { col_out[c] = (int32_t)j; break; }
+    }
+    std::vector<int32_t> out_attr(columns.empty() ? num_attr : columns.size(), -1); // inverse of col_out
+    for (size_t c = 0; c < num_attr; ++c)
+        if (col_out[c] >= 0 && out_attr[col_out[c]] < 0) out_attr[col_out[c]] = (int32_t)c;
+
+    // Attribute referred by each predicate clause, which must be decoded even if not selected
+    size_t n_clauses = p_predicate ? p_predicate->clauses.size() : 0;
+    std::vector<int32_t> clause_attr(n_clauses, -1);
+    std::vector<bool> col_need(num_attr);
+    for (size_t c = 0; c < num_attr; ++c) col_need[c] = (col_out[c] >= 0);
+    for (size_t k = 0; k < n_clauses; ++k) {
+        for (size_t c = 0; c < num_attr; ++c)
+            if (p_predicate->clauses[k].column == reader.columns[c].name) { clause_attr[k] = (int32_t)c; col_need[c] = true; break; }
+        if (clause_attr[k] < 0) return; // no point has a value for the column
+    }
 
-        // Data section — GEOMETRY first
-        uint64_t geom_num_streams = rv();
-        size_t num_features = 0;
-        std::vector<double> feat_gx, feat_gy;
-
-        for (uint64_t s = 0; s < geom_num_streams; ++s) {
-            if (ptr + 2 > end) break;
-            uint8_t h0 = *ptr++;
-            uint8_t h1 = *ptr++; (void)h1;
-            uint64_t num_vals = rv();
-            uint64_t byte_len = rv();
-            const uint8_t* sd = ptr;
-            ptr += byte_len;
-            uint8_t phys = (h0 >> 4) & 0x0F;
-            uint8_t dict = h0 & 0x0F;
-            if (phys == 1 && dict == 3) { // VERTEX stream
-                num_features = (size_t)(num_vals / 2);
-                feat_gx.resize(num_features);
-                feat_gy.resize(num_features);
-                const uint8_t* vp = sd;
-                for (size_t i = 0; i < num_features; ++i) {
-                    uint64_t zx=0; int sh=0;
-                    while(vp<sd+byte_len){uint8_t b=*vp++;zx|=(uint64_t)(b&0x7F)<<sh;sh+=7;if(!(b&0x80))break;}
-                    uint64_t zy=0; sh=0;
-                    while(vp<sd+byte_len){uint8_t b=*vp++;zy|=(uint64_t)(b&0x7F)<<sh;sh+=7;if(!(b&0x80))break;}
-                    int32_t px=(int32_t)((zx>>1)^-(int64_t)(zx&1));
-                    int32_t py=(int32_t)((zy>>1)^-(int64_t)(zy&1));
-                    feat_gx[i] = offset_x + scale_factor * px;
-                    feat_gy[i] = offset_y - scale_factor * py;
-                }
-            }
+    std::vector<int32_t> vxy;
+    reader.decode_vertices(vxy);
+
+    // Decode the needed attribute columns into typed arrays of their present values
+    // Absent values are written as "NA"
+    std::vector<std::vector<uint8_t>> attr_present(num_attr);
+    std::vector<std::vector<int32_t>> attr_ints(num_attr);
+    std::vector<std::vector<float>> attr_floats(num_attr);
+    std::vector<std::vector<std::pair<const char*, uint32_t>>> attr_strs(num_attr); // (pointer into tile_buf or attr_dict_entries, length)
+    std::vector<std::vector<std::string>> attr_dict_entries(num_attr); // dictionary-encoded string columns
+    std::vector<std::vector<int32_t>> attr_dict_idx(num_attr);
+    for (size_t c = 0; c < num_attr; ++c) {
+        if (!col_need[c]) continue; // not selected
+        reader.decode_present(c, attr_present[c]);
+        if      (reader.columns[c].type == MLT_COL_INT)   reader.decode_ints(c, attr_ints[c]);
+        else if (reader.columns[c].type == MLT_COL_FLOAT) reader.decode_floats(c, attr_floats[c]);
+        else if (reader.columns[c].dictionary) {
+            reader.decode_dictionary(c, attr_dict_entries[c], attr_dict_idx[c]);
+            attr_strs[c].reserve(attr_dict_idx[c].size());
+            for (int32_t d : attr_dict_idx[c])
+                attr_strs[c].emplace_back(attr_dict_entries[c][d].data(), (uint32_t)attr_dict_entries[c][d].size());
         }
+        else                                              reader.decode_strings(c, attr_strs[c]);
+    }
 
-        // Decode attribute columns into per-column string arrays
-        // Missing values stay as empty strings ("NA" for nullable columns is natural output)
-        std::vector<std::vector<std::string>> attr_vals(num_attr,
-            std::vector<std::string>(num_features));
-
-        for (size_t c = 0; c < num_attr; ++c) {
-            bool nullable = col_nullable[c];
-            int ctype = col_types[c];
-            bool is_str = (ctype == 0);
-            std::vector<bool> present(num_features, true);
-            std::vector<uint64_t> str_lens;
-            const uint8_t* str_data = nullptr;
-            uint64_t str_data_len = 0;
-
-            uint64_t ns = is_str ? rv() : (nullable ? 2 : 1);
-            for (uint64_t s = 0; s < ns; ++s) {
-                if (ptr + 2 > end) break;
-                uint8_t h0 = *ptr++;
-                uint8_t h1 = *ptr++; (void)h1;
-                uint64_t nv = rv();
-                uint64_t bl = rv();
-                const uint8_t* sd = ptr;
-                ptr += bl;
-                uint8_t phys = (h0 >> 4) & 0x0F;
-
-                if (phys == 0) { // PRESENT
-                    present = mlt_export_decode_bool_rle(sd, bl, num_features);
-                } else if (phys == 1) { // DATA
-                    if (ctype == 2) { // INT
-                        const uint8_t* dp = sd;
-                        size_t fi = 0;
-                        for (uint64_t vi = 0; vi < nv; ++vi) {
-                            uint64_t zig=0; int sh=0;
-                            while(dp<sd+bl){uint8_t b=*dp++;zig|=(uint64_t)(b&0x7F)<<sh;sh+=7;if(!(b&0x80))break;}
-                            int64_t val=(int64_t)((zig>>1)^-(int64_t)(zig&1));
-                            while(fi<num_features&&!present[fi])++fi;
-                            if(fi<num_features) attr_vals[c][fi++]=std::to_string(val);
-                        }
-                    } else if (ctype == 1) { // FLOAT
-                        const uint8_t* dp = sd;
-                        size_t fi = 0;
-                        for (uint64_t vi = 0; vi < nv; ++vi) {
-                            uint32_t bits=(uint32_t)dp[0]|((uint32_t)dp[1]<<8)|
-                                          ((uint32_t)dp[2]<<16)|((uint32_t)dp[3]<<24);
-                            dp+=4;
-                            float fval; memcpy(&fval,&bits,4);
-                            while(fi<num_features&&!present[fi])++fi;
-                            if(fi<num_features){
-                                char tmp[32]; snprintf(tmp,sizeof(tmp),"%.9g",(double)fval);
-                                attr_vals[c][fi++]=tmp;
-                            }
-                        }
-                    } else { // STRING DATA
-                        str_data=sd; str_data_len=bl; (void)nv;
-                    }
-                } else if (phys == 3) { // LENGTH (string lengths)
-                    const uint8_t* dp = sd;
-                    str_lens.reserve(nv);
-                    for (uint64_t vi = 0; vi < nv; ++vi) {
-                        uint64_t len=0; int sh=0;
-                        while(dp<sd+bl){uint8_t b=*dp++;len|=(uint64_t)(b&0x7F)<<sh;sh+=7;if(!(b&0x80))break;}
-                        str_lens.push_back(len);
-                    }
-                }
+    // Evaluate the predicate column by column; string values are evaluated once per distinct string,
+    // or once per entry of dictionary-encoded columns
+    std::vector<uint8_t> row_pass;
+    if (n_clauses > 0) {
+        row_pass.assign(num_features, 1);
+        std::unordered_map<mlt_export_str_dict::key_t, uint8_t, mlt_export_str_dict::key_hash> str_pass;
+        std::vector<uint8_t> entry_pass;
+        for (size_t k = 0; k < n_clauses; ++k) {
+            int32_t c = clause_attr[k];
+            mlt_col_type_t ctype = reader.columns[c].type;
+            bool is_dict = ctype == MLT_COL_STRING && reader.columns[c].dictionary;
+            str_pass.clear();
+            if (is_dict) {
+                const std::vector<std::string>& entries = attr_dict_entries[c];
+                entry_pass.resize(entries.size());
+                for (size_t d = 0; d < entries.size(); ++d) // empty strings are missing
+                    entry_pass[d] = !entries[d].empty() && p_predicate->eval_text(k, entries[d].data(), entries[d].size()) ? 1 : 0;
             }
-
-            if (is_str && str_data && !str_lens.empty()) {
-                const uint8_t* dp = str_data;
-                size_t fi = 0;
-                for (size_t li = 0; li < str_lens.size(); ++li) {
-                    while (fi < num_features && !present[fi]) ++fi;
-                    if (fi < num_features) {
-                        attr_vals[c][fi++] = std::string((char*)dp, str_lens[li]);
-                        dp += str_lens[li];
-                    }
+            size_t vi = 0;
+            for (size_t i = 0; i < num_features; ++i) {
+                if (!mlt_layer_reader::is_present(attr_present[c], i)) { row_pass[i] = 0; continue; }
+                size_t v = vi++;
+                if (!row_pass[i]) continue;
+                bool pass = false;
+                if (ctype == MLT_COL_INT) {
+                    pass = v < attr_ints[c].size() && p_predicate->eval_number(k, (double)attr_ints[c][v]);
+                } else if (ctype == MLT_COL_FLOAT) {
+                    pass = v < attr_floats[c].size() && p_predicate->eval_float(k, attr_floats[c][v]);
+                } else if (is_dict) {
+                    pass = v < attr_dict_idx[c].size() && entry_pass[attr_dict_idx[c][v]] != 0;
+                } else if (v < attr_strs[c].size() && attr_strs[c][v].second > 0) { // empty strings are missing
+                    mlt_export_str_dict::key_t key{attr_strs[c][v].first, attr_strs[c][v].second};
+                    auto it = str_pass.find(key);
+                    if (it == str_pass.end())
+                        it = str_pass.emplace(key, p_predicate->eval_text(k, key.p, key.n) ? 1 : 0).first;
+                    pass = it->second != 0;
                 }
+                if (!pass) row_pass[i] = 0;
             }
-            (void)str_data_len;
         }
+    }
 
-        // Apply filters and add passing features to df
-        for (size_t i = 0; i < num_features; ++i) {
-            double gx = feat_gx[i], gy = feat_gy[i];
-            if (p_min_pt && (gx < p_min_pt->global_x || gy < p_min_pt->global_y)) continue;
-            if (p_max_pt && (gx > p_max_pt->global_x || gy > p_max_pt->global_y)) continue;
-            if (!polygons.empty()) {
-                bool found = false;
-                for (auto* p : polygons)
-                    if (p->contains_point(gx, gy)) { found = true; break; }
-                if (!found) continue;
+    // Apply the bounding box in tile-local coordinates, and transform only the remaining points
+    pmt_utils::pmt_tile_transform_t transform(zoom, tile_x, tile_y);
+    if (p_min_pt || p_max_pt) {
+        if (row_pass.empty()) row_pass.assign(num_features, 1);
+        transform.to_local(p_min_pt, p_max_pt).mask_outside(vxy.data(), num_features, row_pass.data());
+    }
+    const int32_t* p_xy = vxy.data();
+    size_t n_kept = num_features;
+    std::vector<int32_t> kept_xy;
+    if (!row_pass.empty()) {
+        for (size_t i = 0; i < num_features; ++i)
+            if (row_pass[i]) { kept_xy.push_back(vxy[2*i]); kept_xy.push_back(vxy[2*i+1]); }
+        p_xy = kept_xy.data();
+        n_kept = kept_xy.size() / 2;
+    }
+    std::vector<double> gxs(n_kept), gys(n_kept); // global coordinates of the remaining points
+    transform.to_global(p_xy, n_kept, gxs.data(), gys.data());
+
+    // Resolve the output column of each attribute, with a per-tile dictionary for string columns
+    // Selected columns absent from the tile are NA for all of its points, as in the MVT path
+    std::vector<mlt_export_str_dict> dicts(num_attr);
+    for (size_t j = 0; j < out_attr.size(); ++j) {
+        int32_t c = out_attr[j];
+        if (c < 0) { df.declare_column((int32_t)j, columns[j]); continue; }
+        mlt_col_type_t ctype = reader.columns[c].type;
+        pt_col_type_t t = ctype == MLT_COL_INT ? PT_COL_INT64 : (ctype == MLT_COL_FLOAT ? PT_COL_FLOAT : PT_COL_STRING);
+        df.column_at((int32_t)j, reader.columns[c].name, t);
+    }
+    // pointers into df.columns stay valid below, since all columns already exist
+    std::vector<pt_column*> cols(num_attr, NULL);
+    for (size_t c = 0; c < num_attr; ++c)
+        if (col_out[c] >= 0 && out_attr[col_out[c]] == (int32_t)c) cols[c] = &df.columns[col_out[c]];
+    std::vector<size_t> next_val(num_attr, 0); // index of the next present value in each column
+
+    // Apply the polygon filter and add passing features to df
+    size_t next_kept = 0;
+    for (size_t i = 0; i < num_features; ++i) {
+        bool pass = row_pass.empty() || row_pass[i];
+        double gx = 0, gy = 0;
+        if (pass) { gx = gxs[next_kept]; gy = gys[next_kept]; ++next_kept; }
+        if (pass && p_polygons && !p_polygons->contains_point(gx, gy)) pass = false;
+        for (size_t c = 0; c < num_attr; ++c) {
+            if (cols[c] == NULL) continue; // not selected
+            // present values are stored densely, so advance past this feature's value even if it is filtered out
+            if (!mlt_layer_reader::is_present(attr_present[c], i)) {
+                if (pass) cols[c]->append_null();
+                continue;
             }
-            pmt_utils::pmt_pt_t pt(zoom, gx, gy);
-            df.points.push_back(pt);
-            for (size_t c = 0; c < num_attr; ++c) {
-                const std::string& v = attr_vals[c][i];
-                df.add_feature((int32_t)c, col_metas[c+1].name, v.empty() ? "NA" : v);
+            size_t vi = next_val[c]++;
+            if (!pass) continue;
+            pt_column* col = cols[c];
+            if (col->type == PT_COL_INT64) {
+                if (vi < attr_ints[c].size()) col->append_int64(attr_ints[c][vi]);
+                else col->append_null();
+            } else if (col->type == PT_COL_FLOAT) {
+                if (vi < attr_floats[c].size()) col->append_float(attr_floats[c][vi]);
+                else col->append_null();
+            } else {
+                if (vi < attr_strs[c].size() && attr_strs[c][vi].second > 0)
+                    col->append_code(dicts[c].code(*col, attr_strs[c][vi].first, attr_strs[c][vi].second));
+                else
+                    col->append_null(); // empty strings were written as NA
             }
         }
-
-        break; // only first layer
+        if (pass) df.add_point(gx, gy);
     }
 }
 
@@ -252,6 +237,9 @@ static void decode_mlt_tile_to_df(const std::string& tile_buf, uint8_t zoom,
 int32_t cmd_export_pmtiles(int32_t argc, char **argv)
 {
     std::string pmtilesf;
+    std::string cache_dir; // local cache for remote inputs
+    int32_t cache_max_mb = 10240;
+    int32_t max_connections = 8; // requests in flight to remote inputs
     int32_t zoom = -1;             // -1 represents the max zoom level available
     int32_t verbose_freq = 100000; // not a parameter
 
@@ -269,16 +257,25 @@ int32_t cmd_export_pmtiles(int32_t argc, char **argv)
     std::string out_jsonf;
 
     int32_t precision = 3; // precision of the output
+    std::string columns_str; // columns to export
+    std::string where_expr;  // attribute predicate
+    std::string index_path;  // inverted tile index
+    bool lazy_dirs = false; // load leaf directories on demand
 
     paramList pl;
 
     BEGIN_LONG_PARAMS(longParameters)
     LONG_PARAM_GROUP("Input options", NULL)
     LONG_STRING_PARAM("in", &pmtilesf, "Input PMTiles file")
+    LONG_STRING_PARAM("cache-dir", &cache_dir, "Directory to persist data downloaded from remote (http/https/s3) inputs across runs")
+    LONG_INT_PARAM("cache-max-mb", &cache_max_mb, "Maximum size of --cache-dir in MB (default: 10240)")
+    LONG_INT_PARAM("max-connections", &max_connections, "Maximum number of concurrent requests to remote (http/https/s3) inputs (default: 8)")
+    LONG_STRING_PARAM("index", &index_path, "Inverted tile index to fetch only the tiles containing the values required by --where (default: [in].idx.gz if it exists)")
 
     LONG_PARAM_GROUP("Output options", NULL)
     LONG_STRING_PARAM("out-tsv", &out_tsvf, "Output TSV file")
     LONG_STRING_PARAM("out-json", &out_jsonf, "Output JSON file")
+    LONG_STRING_PARAM("columns", &columns_str, "Columns to export (comma-separated, default: all columns). Other columns are not decoded")
 
     LONG_PARAM_GROUP("Filtering options", NULL)
     LONG_INT_PARAM("zoom", &zoom, "Zoom level (default: -1 -- maximum zoom level)")
@@ -287,9 +284,11 @@ int32_t cmd_export_pmtiles(int32_t argc, char **argv)
     LONG_DOUBLE_PARAM("ymin", &ymin, "Minimum y-axis value")
     LONG_DOUBLE_PARAM("ymax", &ymax, "Maximum y-axis value")
     LONG_STRING_PARAM("polygon", &geojsonf, "GeoJSON file (in EPSG:3857) for polygon-based filtering")
+    LONG_STRING_PARAM("where", &where_expr, "Attribute predicate, as clauses joined by 'and' (e.g. \"gene in (Actb,Gapdh) and count>=2\")")
 
     LONG_PARAM_GROUP("Additional options", NULL)
     LONG_INT_PARAM("precision", &precision, "Precision of the output of X/Y coordinates (default: 3)")
+    LONG_PARAM("lazy-dirs", &lazy_dirs, "Read only the header and root directory, and load leaf directories on demand for the tiles overlapping --xmin/--xmax/--ymin/--ymax or --polygon")
     END_LONG_PARAMS();
 
     pl.Add(new longParams("Available Options", longParameters));
@@ -307,12 +306,37 @@ int32_t cmd_export_pmtiles(int32_t argc, char **argv)
         error("Missing required options --out-tsv or --out-json (at least 1 required)");
     }
 
+    FlexReaderFactory::set_max_connections(max_connections);
+    if (!cache_dir.empty())
+    {
+        FlexReaderFactory::set_disk_cache(cache_dir.c_str(), (uint64_t)cache_max_mb << 20);
+    }
+
+    std::vector<std::string> columns;
+    if (!columns_str.empty())
+    {
+        split(columns, ",", columns_str);
+    }
+    pt_predicate predicate;
+    if (!where_expr.empty())
+    {
+        predicate.parse(where_expr);
+    }
+
     // Open a PMTiles file
     pmt_pts pmt(pmtilesf.c_str());
 
+    // lazy directory loading needs a bounded region to enumerate tiles from
+    bool bounded_region = std::isfinite(xmin) && std::isfinite(xmax) && std::isfinite(ymin) && std::isfinite(ymax);
+    if (lazy_dirs && !bounded_region && geojsonf.empty())
+    {
+        notice("--lazy-dirs requires a full bounding box or --polygon; loading all directories instead");
+        lazy_dirs = false;
+    }
+
     // Open the header and tile entries
     notice("Reading header and tile entries...");
-    if (!pmt.read_header_meta_entries())
+    if (!(lazy_dirs ? pmt.read_header_meta_root() : pmt.read_header_meta_entries()))
     {
         error("This pmtiles file is malformed or incompatible with pmpoints, which requires collection of points in MVT format");
     }
@@ -373,6 +397,84 @@ int32_t cmd_export_pmtiles(int32_t argc, char **argv)
         Rectangle& r = bounding_boxes.back();
         notice("BBox %d = ll(%lf, %lf) - ur(%lf,%lf)", i, r.p_min.x, r.p_min.y, r.p_max.x, r.p_max.y);
     }
+    // R-tree over the polygons, for selecting the tiles and testing the points
+    PolygonIndex polygon_index(polygons);
+
+    // resolve only the tiles overlapping the query region through the directories
+    if (lazy_dirs)
+    {
+        double rxmin = xmin, rxmax = xmax, rymin = ymin, rymax = ymax;
+        if (!bounding_boxes.empty())
+        {
+            double pxmin = bounding_boxes[0].p_min.x, pxmax = bounding_boxes[0].p_max.x;
+            double pymin = bounding_boxes[0].p_min.y, pymax = bounding_boxes[0].p_max.y;
+            for (size_t i = 1; i < bounding_boxes.size(); ++i)
+            {
+                pxmin = std::min(pxmin, bounding_boxes[i].p_min.x);
+                pxmax = std::max(pxmax, bounding_boxes[i].p_max.x);
+                pymin = std::min(pymin, bounding_boxes[i].p_min.y);
+                pymax = std::max(pymax, bounding_boxes[i].p_max.y);
+            }
+            rxmin = std::max(rxmin, pxmin);
+            rxmax = std::min(rxmax, pxmax);
+            rymin = std::max(rymin, pymin);
+            rymax = std::min(rymax, pymax);
+        }
+        pmt_utils::pmt_pt_t r_ul(zoom, rxmin, rymax);
+        pmt_utils::pmt_pt_t r_lr(zoom, rxmax, rymin);
+        int64_t max_tile = (1LL << zoom) - 1;
+        int64_t tx0 = r_ul.tile_x, ty0 = r_ul.tile_y, tx1 = r_lr.tile_x, ty1 = r_lr.tile_y;
+        tx0 = std::max((int64_t)0, std::min(tx0, max_tile));
+        tx1 = std::max((int64_t)0, std::min(tx1, max_tile));
+        ty0 = std::max((int64_t)0, std::min(ty0, max_tile));
+        ty1 = std::max((int64_t)0, std::min(ty1, max_tile));
+        // squares of tiles outside all polygons are pruned without resolving their tiles
+        std::function<bool(uint32_t, uint32_t, uint32_t)> may_overlap;
+        if (!polygon_index.empty())
+        {
+            may_overlap = [&](uint32_t x, uint32_t y, uint32_t size)
+            {
+                point_t sq_min_pt(0, 0), sq_max_pt(0, 0);
+                pmt_utils::tiletoepsg3857(x, y, zoom, &sq_min_pt.x, &sq_max_pt.y);
+                pmt_utils::tiletoepsg3857((int64_t)x + size, (int64_t)y + size, zoom, &sq_max_pt.x, &sq_min_pt.y);
+                return polygon_index.classify_rectangle(Rectangle(sq_min_pt.x, sq_min_pt.y, sq_max_pt.x, sq_max_pt.y)) != RECT_OUTSIDE;
+            };
+        }
+        if (rxmin <= rxmax && rymin <= rymax)
+        {
+            pmt.load_tile_entries(zoom, (uint32_t)tx0, (uint32_t)tx1, (uint32_t)ty0, (uint32_t)ty1, may_overlap);
+        }
+    }
+
+    // per-tile statistics to skip the tiles that cannot satisfy --where
+    pt_zone_maps zone_maps;
+    bool use_zone_maps = !predicate.empty() && zone_maps.load(pmt.jmeta);
+    if (use_zone_maps)
+    {
+        notice("Using the zone maps of %zu tiles to skip tiles for --where", zone_maps.tile_ids.size());
+    }
+
+    // tiles containing the values required by --where, from the inverted tile index
+    std::unordered_set<uint64_t> index_tiles;
+    bool use_index = false;
+    if (!predicate.empty())
+    {
+        // the default sidecar is skipped if it belongs to another version of the file
+        bool index_given = !index_path.empty();
+        if (!index_given)
+        {
+            index_path = pt_tile_index::find_default(pmtilesf);
+        }
+        if (!index_path.empty())
+        {
+            pt_tile_index tile_index;
+            use_index = tile_index.read(index_path, pmt.hdr, index_given) && tile_index.select_tiles(predicate, index_tiles);
+            if (use_index)
+            {
+                notice("The tile index %s selected %zu tiles containing the values of %s", index_path.c_str(), index_tiles.size(), tile_index.column.c_str());
+            }
+        }
+    }
 
     // create/open the output files
     htsFile *tsv_wh = NULL;
@@ -415,27 +517,31 @@ int32_t cmd_export_pmtiles(int32_t argc, char **argv)
     // (d) (aEY-bE only) pass
     pt_dataframe df;
     mvt_pts_filt mvtfilt(&df);
+    mvtfilt.set_column_filt(columns);
+    mvtfilt.set_predicate_filt(predicate.empty() ? NULL : &predicate);
 
     bool tsv_hdr_written = false;
     uint64_t n_written = 0;
-    std::vector<Polygon *> tile_polygons;
-    std::string tile_buffer;
     uint64_t n_skipped_tiles = 0;
-    for (int32_t i = 0; i < pmt.tile_entries.size(); ++i)
+    uint64_t n_inside_tiles = 0;        // tiles inside a polygon, whose points are not tested
+    uint64_t n_zone_skipped_tiles = 0; // tiles skipped by zone maps
+    uint64_t n_index_skipped_tiles = 0; // tiles skipped by the tile index
+
+    // first pass: select the tiles to fetch and record the filters needed for each
+    std::vector<pmtiles::zxy> sel_tiles;
+    std::vector<uint8_t> sel_pt_filts; // bit 0: min point filter, bit 1: max point filter, bit 2: polygon filter
+    // visit only the tiles at the selected zoom level
+    std::pair<uint32_t, uint32_t> zoom_range = pmt.zoom_range(zoom);
+    for (int32_t i = zoom_range.first; i < zoom_range.second; ++i)
     {
         pmtiles::entry_zxy &entry = pmt.tile_entries[i];
 
-        // skip if the zoom level is not the same
-        if (entry.z != zoom)
-        {
-            continue;
-        }
-
         // get the global coordinates of the tile. Note that the y-axis is inverted
         point_t tile_min_pt(0,0), tile_max_pt(0,0);
         pmt_utils::tiletoepsg3857(entry.x, entry.y, entry.z, &tile_min_pt.x, &tile_max_pt.y);
         pmt_utils::tiletoepsg3857(entry.x+1, entry.y+1, entry.z, &tile_max_pt.x, &tile_min_pt.y);
         Rectangle tile_bbox(tile_min_pt.x, tile_min_pt.y, tile_max_pt.x, tile_max_pt.y);
+        uint8_t pt_filt = 0;
 
         //notice("Checking tile %d/%d/%d, bbox = [(%.5lf, %.5lf) (%.5lf, %.5lf)]", pmt.tile_entries[i].z, pmt.tile_entries[i].x, pmt.tile_entries[i].y, tile_min_pt.x, tile_min_pt.y, tile_max_pt.x, tile_max_pt.y);
 
@@ -462,46 +568,25 @@ int32_t cmd_export_pmtiles(int32_t argc, char **argv)
             // if the min/max point is located at the tile, boundary, then we need to check the points
             if (entry.x == min_pt.tile_x || entry.y == min_pt.tile_y)
             {
-                mvtfilt.set_min_filt(&min_pt);
-            }
-            else
-            {
-                // mvtfilt.set_min_filt(&min_pt);
-                mvtfilt.set_min_filt(NULL);
+                pt_filt |= 1;
             }
             if (entry.x == max_pt.tile_x || entry.y == max_pt.tile_y)
             {
-                mvtfilt.set_max_filt(&max_pt);
-            }
-            else
-            {
-                // mvtfilt.set_max_filt(&max_pt);
-                mvtfilt.set_max_filt(NULL);
+                pt_filt |= 2;
             }
         }
 
         // if polygons exists
-        if (polygons.size() > 0)
+        if (!polygon_index.empty())
         {
-            // check if the polygon is contained in the bounding box
-            // check if the bounding 
-            tile_polygons.clear();
-
             //notice("global_min_pt = (%lg, %lg)", min_pt.global_x, min_pt.global_y);
             //notice("global_max_pt = (%lg, %lg)", max_pt.global_x, max_pt.global_y);
             //notice("tile_min_pt = (%lg, %lg)", tile_bbox.p_min.x, tile_bbox.p_min.y);
             //notice("tile_max_pt = (%lg, %lg)", tile_bbox.p_max.x, tile_bbox.p_max.y);
 
-            for (int32_t j = 0; j < bounding_boxes.size(); ++j)
-            {
-                // if any of the bounding boxes of the polygon intersects with the tile,
-                // then we need to include the polygon
-                if ( bounding_boxes[j].intersects_rectangle(tile_bbox) )
-                {
-                    tile_polygons.push_back(&polygons[j]);
-                }
-            }
-            if (tile_polygons.size() == 0)
+            // tiles outside all polygons are skipped, and only the points of boundary tiles are tested
+            RectangleRelation rel = polygon_index.classify_rectangle(tile_bbox);
+            if (rel == RECT_OUTSIDE)
             {
                 //notice("Skipping (%lu, %lu) as it does not intersect with any of the polygons", entry.x, entry.y);
                 n_skipped_tiles++;
@@ -510,47 +595,88 @@ int32_t cmd_export_pmtiles(int32_t argc, char **argv)
                 }
                 continue;
             }
-            mvtfilt.set_polygon_filt(tile_polygons);
+            if (rel == RECT_BOUNDARY)
+            {
+                pt_filt |= 4;
+            }
+            else
+            {
+                n_inside_tiles++;
+            }
         }
         else
         {
             // do not set any filter, automatic pass
-            // mvtfilt.set_polygon_filt(tile_polygons);
         }
 
-        // notice("Fetching tile %d/%d/%d that intersects with the region", entry.z, entry.x, entry.y);
-        pmt.fetch_tile_to_buffer(entry.z, entry.x, entry.y, tile_buffer);
+        // skip the tiles without the values required by the attribute predicate, or whose statistics rule it out
+        uint64_t tile_id = pmtiles::zxy_to_tileid(entry.z, entry.x, entry.y);
+        if (use_index && index_tiles.count(tile_id) == 0)
+        {
+            n_index_skipped_tiles++;
+            continue;
+        }
+        if (use_zone_maps && !zone_maps.may_match(tile_id, predicate))
+        {
+            n_zone_skipped_tiles++;
+            continue;
+        }
+
+        sel_tiles.push_back(pmtiles::zxy(entry.z, entry.x, entry.y));
+        sel_pt_filts.push_back(pt_filt);
+    }
+    if (!polygon_index.empty())
+    {
+        notice("%llu tiles are inside the polygons", n_inside_tiles);
+    }
+    if (use_index)
+    {
+        notice("Skipped %llu tiles by the tile index", n_index_skipped_tiles);
+    }
+    if (use_zone_maps)
+    {
+        notice("Skipped %llu tiles by the zone maps", n_zone_skipped_tiles);
+    }
+    notice("Selected %zu tiles to fetch", sel_tiles.size());
+
+    // second pass: fetch the selected tiles in file order and write the points
+    uint64_t n_fetched = 0;
+    pmt.fetch_tiles(sel_tiles, [&](size_t k, const pmtiles::entry_zxy &entry, std::string &tile_buffer)
+    {
+        mvtfilt.set_min_filt((sel_pt_filts[k] & 1) ? &min_pt : NULL);
+        mvtfilt.set_max_filt((sel_pt_filts[k] & 2) ? &max_pt : NULL);
+        mvtfilt.set_polygon_filt((sel_pt_filts[k] & 4) ? &polygon_index : NULL);
+
         if (pmt.hdr.tile_type == 0x06) {
             decode_mlt_tile_to_df(tile_buffer, entry.z, entry.x, entry.y, df,
-                                  mvtfilt.p_min_pt, mvtfilt.p_max_pt, mvtfilt.polygons);
+                                  mvtfilt.p_min_pt, mvtfilt.p_max_pt, mvtfilt.p_polygons, columns, mvtfilt.p_predicate);
         } else {
             mvtfilt.decode_points_df(tile_buffer, entry.z, entry.x, entry.y, df);
         }
 
+        size_t n_pts = df.num_points();
+        char valbuf[64];
         if (tsv_wh != NULL)
         {
             if (!tsv_hdr_written)
             {
-                if (df.points.size() > 0)
+                if (n_pts > 0)
                 {
-                    if (df.points.size() > 0)
+                    hprintf(tsv_wh, "X\tY");
+                    for (size_t j = 0; j < df.columns.size(); ++j)
                     {
-                        hprintf(tsv_wh, "X\tY");
-                        for (int32_t i = 0; i < df.feature_names.size(); ++i)
-                        {
-                            hprintf(tsv_wh, "\t%s", df.feature_names[i].c_str());
-                        }
-                        hprintf(tsv_wh, "\n");
-                        tsv_hdr_written = true;
+                        hprintf(tsv_wh, "\t%s", df.columns[j].name.c_str());
                     }
+                    hprintf(tsv_wh, "\n");
+                    tsv_hdr_written = true;
                 }
             }
-            for (int32_t i = 0; i < df.points.size(); ++i)
+            for (size_t i = 0; i < n_pts; ++i)
             {
-                hprintf(tsv_wh, "%.*f\t%.*f", precision, df.points[i].global_x, precision, df.points[i].global_y);
-                for (int32_t j = 0; j < df.feature_matrix.size(); ++j)
+                hprintf(tsv_wh, "%.*f\t%.*f", precision, df.xs[i], precision, df.ys[i]);
+                for (size_t j = 0; j < df.columns.size(); ++j)
                 {
-                    hprintf(tsv_wh, "\t%s", df.feature_matrix[j][i].c_str());
+                    hprintf(tsv_wh, "\t%s", df.columns[j].format(i, valbuf, sizeof(valbuf)));
                 }
                 hprintf(tsv_wh, "\n");
                 if ((n_written + i + 1) % verbose_freq == 0)
@@ -561,33 +687,31 @@ int32_t cmd_export_pmtiles(int32_t argc, char **argv)
         }
         if (json_wh != NULL)
         {
-            if (df.points.size() > 0)
+            for (size_t i = 0; i < n_pts; ++i)
             {
-                for (int32_t i = 0; i < df.points.size(); ++i)
+                hprintf(json_wh, "{\"type\":\"Feature\",\"properties\": {");
+                for (size_t j = 0; j < df.columns.size(); ++j)
                 {
-                    hprintf(json_wh, "{\"type\":\"Feature\",\"properties\": {");
-                    for (int32_t j = 0; j < df.feature_matrix.size(); ++j)
+                    hprintf(json_wh, "\"%s\":\"%s\"", df.columns[j].name.c_str(), df.columns[j].format(i, valbuf, sizeof(valbuf)));
+                    if (j + 1 < df.columns.size())
                     {
-                        hprintf(json_wh, "\"%s\":\"%s\"", df.feature_names[j].c_str(), df.feature_matrix[j][i].c_str());
-                        if (j < df.feature_matrix.size() - 1)
-                        {
-                            hprintf(json_wh, ",");
-                        }
-                    }
-                    hprintf(json_wh, "},\"geometry\":{\"type\":\"Point\",\"coordinates\":[%.*f,%.*f]}}\n", precision, df.points[i].global_x, precision, df.points[i].global_y);
-                    if ((n_written + i + 1) % verbose_freq == 0)
-                    {
-                        notice("Writing %llu points to %s", n_written + i + 1, out_jsonf.c_str());
+                        hprintf(json_wh, ",");
                     }
                 }
+                hprintf(json_wh, "},\"geometry\":{\"type\":\"Point\",\"coordinates\":[%.*f,%.*f]}}\n", precision, df.xs[i], precision, df.ys[i]);
+                if ((n_written + i + 1) % verbose_freq == 0)
+                {
+                    notice("Writing %llu points to %s", n_written + i + 1, out_jsonf.c_str());
+                }
             }
         }
-        n_written += df.points.size();
-        if ( i % 100 == 0 ) {
-            notice("Finished writing %zu additional points in tile %d / %zu -- %llu points total", df.points.size(), i, pmt.tile_entries.size(), n_written);
+        n_written += n_pts;
+        if ( n_fetched % 100 == 0 ) {
+            notice("Finished writing %zu additional points in tile %llu / %zu -- %llu points total", n_pts, n_fetched, sel_tiles.size(), n_written);
         }
+        ++n_fetched;
         df.clear_values();
-    }
+    });
 
     if (json_wh != NULL)
     {
@@ -23,6 +23,9 @@
 int32_t cmd_export_polygon_pmtiles(int32_t argc, char **argv)
 {
     std::string pmtilesf;
+    std::string cache_dir; // local cache for remote inputs
+    int32_t cache_max_mb = 10240;
+    int32_t max_connections = 8; // requests in flight to remote inputs
     int32_t zoom = -1;             // -1 represents the max zoom level available
     int32_t verbose_freq = 10000; // not a parameter
 
@@ -54,6 +57,9 @@ int32_t cmd_export_polygon_pmtiles(int32_t argc, char **argv)
     BEGIN_LONG_PARAMS(longParameters)
     LONG_PARAM_GROUP("Input options", NULL)
     LONG_STRING_PARAM("in", &pmtilesf, "Input PMTiles file")
+    LONG_STRING_PARAM("cache-dir", &cache_dir, "Directory to persist data downloaded from remote (http/https/s3) inputs across runs")
+    LONG_INT_PARAM("cache-max-mb", &cache_max_mb, "Maximum size of --cache-dir in MB (default: 10240)")
+    LONG_INT_PARAM("max-connections", &max_connections, "Maximum number of concurrent requests to remote (http/https/s3) inputs (default: 8)")
     LONG_STRING_PARAM("columns", &columns_str, "Columns to extract from the metadata (comma-separated)")
     LONG_STRING_PARAM("layer-name", &meta_layer_name, "Layer name in the metadata (default: vector_layers)")
     LONG_STRING_PARAM("remove-columns", &remove_columns, "Columns to remove from the output (comma-separated, default: lat,lon)")
@@ -91,6 +97,12 @@ int32_t cmd_export_polygon_pmtiles(int32_t argc, char **argv)
         error("Missing required options --out-tsv");
     }
 
+    FlexReaderFactory::set_max_connections(max_connections);
+    if (!cache_dir.empty())
+    {
+        FlexReaderFactory::set_disk_cache(cache_dir.c_str(), (uint64_t)cache_max_mb << 20);
+    }
+
     // Open a PMTiles file
     pmt_pts pmt(pmtilesf.c_str());
 
@@ -188,6 +200,8 @@ int32_t cmd_export_polygon_pmtiles(int32_t argc, char **argv)
         Rectangle& r = bounding_boxes.back();
         notice("BBox %d = ll(%lf, %lf) - ur(%lf,%lf)", i, r.p_min.x, r.p_min.y, r.p_max.x, r.p_max.y);
     }
+    // R-tree over the polygons, for selecting the tiles and testing the features
+    PolygonIndex polygon_index(polygons);
 
     // create/open the output files
     htsFile *tsv_wh = NULL;
@@ -234,21 +248,16 @@ int32_t cmd_export_polygon_pmtiles(int32_t argc, char **argv)
 
     bool tsv_hdr_written = false;
     uint64_t n_written = 0;
-    std::vector<Polygon *> tile_polygons;
     //std::vector<pmt_utils::pmt_polygon_t> tile_polygons;
     std::string tile_buffer;
     uint64_t n_skipped_tiles = 0;
     uint64_t n_tiles_processed = 0;
-    for (int32_t i = 0; i < pmt.tile_entries.size(); ++i)
+    // visit only the tiles at the selected zoom level
+    std::pair<uint32_t, uint32_t> zoom_range = pmt.zoom_range(zoom);
+    for (int32_t i = zoom_range.first; i < zoom_range.second; ++i)
     {
         pmtiles::entry_zxy &entry = pmt.tile_entries[i];
 
-        // skip if the zoom level is not the same
-        if (entry.z != zoom)
-        {
-            continue;
-        }
-
         // get the global coordinates of the tile. Note that the y-axis is inverted
         point_t tile_min_pt(0,0), tile_max_pt(0,0);
         pmt_utils::tiletoepsg3857(entry.x, entry.y, entry.z, &tile_min_pt.x, &tile_max_pt.y);
@@ -299,27 +308,16 @@ int32_t cmd_export_polygon_pmtiles(int32_t argc, char **argv)
         }
 
         // if polygons exists
-        if (polygons.size() > 0)
+        if (!polygon_index.empty())
         {
-            // check if the polygon is contained in the bounding box
-            // check if the bounding 
-            tile_polygons.clear();
-
             //notice("global_min_pt = (%lg, %lg)", min_pt.global_x, min_pt.global_y);
             //notice("global_max_pt = (%lg, %lg)", max_pt.global_x, max_pt.global_y);
             //notice("tile_min_pt = (%lg, %lg)", tile_bbox.p_min.x, tile_bbox.p_min.y);
             //notice("tile_max_pt = (%lg, %lg)", tile_bbox.p_max.x, tile_bbox.p_max.y);
 
-            for (int32_t j = 0; j < bounding_boxes.size(); ++j)
-            {
-                // if any of the bounding boxes of the polygon intersects with the tile,
-                // then we need to include the polygon
-                if ( bounding_boxes[j].intersects_rectangle(tile_bbox) )
-                {
-                    tile_polygons.push_back(&polygons[j]);
-                }
-            }
-            if (tile_polygons.size() == 0)
+            // tiles outside all polygons are skipped, and only the features of boundary tiles are tested
+            RectangleRelation rel = polygon_index.classify_rectangle(tile_bbox);
+            if (rel == RECT_OUTSIDE)
             {
                 //notice("Skipping (%lu, %lu) as it does not intersect with any of the polygons", entry.x, entry.y);
                 n_skipped_tiles++;
@@ -328,12 +326,11 @@ int32_t cmd_export_polygon_pmtiles(int32_t argc, char **argv)
                 }
                 continue;
             }
-            mvtfilt.set_polygon_filt(tile_polygons);
+            mvtfilt.set_polygon_filt(rel == RECT_BOUNDARY ? &polygon_index : NULL);
         }
         else
         {
             // do not set any filter, automatic pass
-            // mvtfilt.set_polygon_filt(tile_polygons);
         }
 
         // notice("Fetching tile %d/%d/%d that intersects with the region", entry.z, entry.x, entry.y);
@@ -364,7 +361,7 @@ int32_t cmd_export_polygon_pmtiles(int32_t argc, char **argv)
             for (int32_t i = 0; i < df.polygons.size(); ++i)
             {
                 //notice("i = %d", i);
-                std::vector<pmt_utils::pmt_pt_t>& pts = df.polygons[i].points;
+                std::vector<pmt_utils::pmt_xy_t>& pts = df.polygons[i].points;
                 double gx = 0, gy = 0;
                 for(int32_t j=0; j < pts.size()-1; ++j)
                 {
@@ -15,6 +15,9 @@
 ////////////////////////////////////////////////////////////////////////
 int32_t cmd_summarize_pmtiles(int32_t argc, char** argv) {
   std::string pmtilesf;
+  std::string cache_dir; // local cache for remote inputs
+  int32_t cache_max_mb = 10240;
+  int32_t max_connections = 8; // requests in flight to remote inputs
   int32_t z = -1, x = -1, y = -1;
   bool show_hdr = false;
   bool show_meta = false;
@@ -26,6 +29,9 @@ int32_t cmd_summarize_pmtiles(int32_t argc, char** argv) {
   BEGIN_LONG_PARAMS(longParameters)
     LONG_PARAM_GROUP("Input options", NULL)
     LONG_STRING_PARAM("in", &pmtilesf, "Input PMTiles file")
+    LONG_STRING_PARAM("cache-dir", &cache_dir, "Directory to persist data downloaded from remote (http/https/s3) inputs across runs")
+    LONG_INT_PARAM("cache-max-mb", &cache_max_mb, "Maximum size of --cache-dir in MB (default: 10240)")
+    LONG_INT_PARAM("max-connections", &max_connections, "Maximum number of concurrent requests to remote (http/https/s3) inputs (default: 8)")
 
     LONG_PARAM_GROUP("Items to show", NULL)
     LONG_PARAM("all", &show_all, "Show all information (equivalent to --hdr --meta --tile)")
@@ -51,6 +57,11 @@ int32_t cmd_summarize_pmtiles(int32_t argc, char** argv) {
     error("No items to show. Please specify --hdr, --meta, --tile, (or --all)");
   }
 
+  FlexReaderFactory::set_max_connections(max_connections);
+  if ( !cache_dir.empty() ) {
+    FlexReaderFactory::set_disk_cache(cache_dir.c_str(), (uint64_t)cache_max_mb << 20);
+  }
+
   // open a PMTiles file
   pmt_pts pmt(pmtilesf.c_str());
 
@@ -7,11 +7,14 @@
 #include <cstring>
 #include <climits>
 #include <map>
+#include <unordered_set>
 
 #include "pmt_pts.h"
 #include "pmt_utils.h"
 #include "polygon.h"
 #include "mvt_pts.h"
+#include "pt_predicate.h"
+#include "pt_tile_index.h"
 #include "htslib/hts.h"
 #include "ext/nlohmann/json.hpp"
 
@@ -54,6 +57,9 @@ public:
 int32_t cmd_tile_density_stats(int32_t argc, char **argv)
 {
     std::string pmtilesf;
+    std::string cache_dir; // local cache for remote inputs
+    int32_t cache_max_mb = 10240;
+    int32_t max_connections = 8; // requests in flight to remote inputs
     int32_t zoom = -1;             // -1 represents the max zoom level
     int32_t verbose_freq = 100000; // not a parameter
 
@@ -61,6 +67,8 @@ int32_t cmd_tile_density_stats(int32_t argc, char **argv)
     std::string out_tsvf;
     std::string count_field("count");
     std::string feature_field("gene");
+    std::string where_expr; // attribute predicate
+    std::string index_path; // inverted tile index
     bool compact = false;
 
     paramList pl;
@@ -68,8 +76,12 @@ int32_t cmd_tile_density_stats(int32_t argc, char **argv)
     BEGIN_LONG_PARAMS(longParameters)
     LONG_PARAM_GROUP("Input options", NULL)
     LONG_STRING_PARAM("in", &pmtilesf, "Input PMTiles file")
+    LONG_STRING_PARAM("cache-dir", &cache_dir, "Directory to persist data downloaded from remote (http/https/s3) inputs across runs")
+    LONG_INT_PARAM("cache-max-mb", &cache_max_mb, "Maximum size of --cache-dir in MB (default: 10240)")
+    LONG_INT_PARAM("max-connections", &max_connections, "Maximum number of concurrent requests to remote (http/https/s3) inputs (default: 8)")
     LONG_STRING_PARAM("count", &count_field, "Field name for transcript counts")
     LONG_STRING_PARAM("feature", &feature_field, "Field name for feature name")
+    LONG_STRING_PARAM("index", &index_path, "Inverted tile index to visit only the tiles containing the values required by --where (default: [in].idx.gz if it exists)")
 
     LONG_PARAM_GROUP("Output options", NULL)
     LONG_PARAM("compact", &compact, "Skip writing each tile")
@@ -77,6 +89,7 @@ int32_t cmd_tile_density_stats(int32_t argc, char **argv)
 
     LONG_PARAM_GROUP("Filtering options", NULL)
     LONG_INT_PARAM("zoom", &zoom, "Zoom level (default: -1 -- maximum zoom level)")
+    LONG_STRING_PARAM("where", &where_expr, "Attribute predicate for the points to include, as clauses joined by 'and' (e.g. \"gene in (Actb,Gapdh) and count>=2\")")
     END_LONG_PARAMS();
 
     pl.Add(new longParams("Available Options", longParameters));
@@ -94,6 +107,18 @@ int32_t cmd_tile_density_stats(int32_t argc, char **argv)
         error("Missing required options --out");
     }
 
+    pt_predicate predicate;
+    if (!where_expr.empty())
+    {
+        predicate.parse(where_expr);
+    }
+
+    FlexReaderFactory::set_max_connections(max_connections);
+    if (!cache_dir.empty())
+    {
+        FlexReaderFactory::set_disk_cache(cache_dir.c_str(), (uint64_t)cache_max_mb << 20);
+    }
+
     // Open a PMTiles file
     pmt_pts pmt(pmtilesf.c_str());
 
@@ -117,6 +142,24 @@ int32_t cmd_tile_density_stats(int32_t argc, char **argv)
         error("Zoom level %d is unavailable in %s", zoom, pmtilesf.c_str());
     }
 
+    // tiles containing the values required by --where, from the inverted tile index
+    std::unordered_set<uint64_t> index_tiles;
+    bool use_index = false;
+    if (!predicate.empty())
+    {
+        // the default sidecar is skipped if it belongs to another version of the file
+        bool index_given = !index_path.empty();
+        if (!index_given)
+        {
+            index_path = pt_tile_index::find_default(pmtilesf);
+        }
+        if (!index_path.empty())
+        {
+            pt_tile_index tile_index;
+            use_index = tile_index.read(index_path, pmt.hdr, index_given) && tile_index.select_tiles(predicate, index_tiles);
+        }
+    }
+
     // create/open the output files
     htsFile *tsv_wh = NULL;
     if (out_tsvf.compare(out_tsvf.size() - 3, 3, ".gz", 3) == 0)
@@ -133,23 +176,29 @@ int32_t cmd_tile_density_stats(int32_t argc, char **argv)
 
     uint64_t n_total = 0;
     std::vector< std::map<uint64_t, uint64_t> > res2pts2nbins(MAX_BITS);
-    std::string tile_buffer;
-    for (int32_t i = 0; i < pmt.tile_entries.size(); ++i)
+    // visit only the tiles at the selected zoom level
+    std::pair<uint32_t, uint32_t> zoom_range = pmt.zoom_range(zoom);
+    std::vector<pmtiles::zxy> tiles;
+    for (int32_t i = zoom_range.first; i < zoom_range.second; ++i)
     {
-        pmtiles::entry_zxy &entry = pmt.tile_entries[i];
-
-        // skip if the zoom level is not the same
-        if (entry.z != zoom)
-        {
+        const pmtiles::entry_zxy &entry = pmt.tile_entries[i];
+        if (use_index && index_tiles.count(pmtiles::zxy_to_tileid(entry.z, entry.x, entry.y)) == 0)
             continue;
-        }
-        // notice("Fetching tile %d/%d/%d that intersects with the region", entry.z, entry.x, entry.y);
-        //pmt.fetch_tile(entry.z, entry.x, entry.y);
-        pmt.fetch_tile_to_buffer(entry.z, entry.x, entry.y, tile_buffer);
+        tiles.push_back(pmtiles::zxy(entry.z, entry.x, entry.y));
+    }
+    if (use_index)
+    {
+        notice("Visiting %zu tiles selected by the tile index %s", tiles.size(), index_path.c_str());
+    }
+
+    // fetch the tiles in file order
+    uint64_t n_processed = 0;
+    pmt.fetch_tiles(tiles, [&](size_t k, const pmtiles::entry_zxy &entry, std::string &tile_buffer)
+    {
         std::vector<int32_t> xs, ys, cnts;
         std::vector<std::string> features;
         //int32_t n_pts = mvt.decode_points_xycnt(pmt.tile_data_str, count_field, xs, ys, cnts);
-        int32_t n_pts = mvt.decode_points_xycnt_feature(tile_buffer, count_field, feature_field, xs, ys, cnts, features);
+        int32_t n_pts = mvt.decode_points_xycnt_feature(tile_buffer, count_field, feature_field, xs, ys, cnts, features, predicate.empty() ? NULL : &predicate);
 
         tile_density_stats tds;
         for (int32_t j = 0; j < n_pts; ++j)
@@ -171,9 +220,10 @@ int32_t cmd_tile_density_stats(int32_t argc, char **argv)
             }
         }
 
-        notice("Tile #%d/%zu %d/%d/%d , %d points", i, pmt.tile_entries.size(), entry.z, entry.x, entry.y, n_pts);
+        notice("Tile #%llu/%zu %d/%d/%d , %d points", n_processed, tiles.size(), entry.z, entry.x, entry.y, n_pts);
+        ++n_processed;
         n_total += n_pts;
-    }
+    });
 
     for(int32_t i=0; i<MAX_BITS; ++i) {
         std::map<uint64_t, uint64_t> &pts2nbins = res2pts2nbins[i];
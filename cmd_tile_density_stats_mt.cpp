@@ -7,6 +7,7 @@
 #include <cstring>
 #include <climits>
 #include <map>
+#include <unordered_set>
 #include <mutex>
 #include <thread>
 #include <atomic>
@@ -17,6 +18,8 @@
 #include "pmt_utils.h"
 #include "polygon.h"
 #include "mvt_pts.h"
+#include "pt_predicate.h"
+#include "pt_tile_index.h"
 #include "htslib/hts.h"
 #include "ext/nlohmann/json.hpp"
 
@@ -177,7 +180,7 @@ public:
 };
 
 // Worker thread function
-void process_tiles(TileQueue& queue, pmt_pts& pmt, ThreadSafeResults& results, const std::string& count_field, const std::string& feature_field, std::atomic<int32_t>& processed_count) {
+void process_tiles(TileQueue& queue, pmt_pts& pmt, ThreadSafeResults& results, const std::string& count_field, const std::string& feature_field, const pt_predicate* p_predicate, std::atomic<int32_t>& processed_count) {
     pmtiles::entry_zxy entry(0,0,0,0,0);
     mvt_pts mvt;
     std::string buffer;
@@ -189,7 +192,7 @@ void process_tiles(TileQueue& queue, pmt_pts& pmt, ThreadSafeResults& results, c
         std::vector<int32_t> xs, ys, cnts;
         std::vector<std::string> features;
         //int32_t n_pts = mvt.decode_points_xycnt(local_pmt.tile_data_str, count_field, xs, ys, cnts);
-        int32_t n_pts = mvt.decode_points_xycnt_feature(buffer, count_field, feature_field, xs, ys, cnts, features);
+        int32_t n_pts = mvt.decode_points_xycnt_feature(buffer, count_field, feature_field, xs, ys, cnts, features, p_predicate);
 
         notice("Processing tile %d/%d/%d with %d points", entry.z, entry.x, entry.y, n_pts);
         
@@ -219,6 +222,9 @@ void process_tiles(TileQueue& queue, pmt_pts& pmt, ThreadSafeResults& results, c
 int32_t cmd_tile_density_stats_mt(int32_t argc, char **argv)
 {
     std::string pmtilesf;
+    std::string cache_dir; // local cache for remote inputs
+    int32_t cache_max_mb = 10240;
+    int32_t max_connections = 8; // requests in flight to remote inputs
     int32_t zoom = -1;             // -1 represents the max zoom level
     int32_t verbose_freq = 100000; // not a parameter
     int32_t num_threads = 0;       // Default: use number of hardware threads
@@ -227,6 +233,8 @@ int32_t cmd_tile_density_stats_mt(int32_t argc, char **argv)
     std::string out_tsvf;
     std::string count_field("count");
     std::string feature_field("gene");
+    std::string where_expr; // attribute predicate
+    std::string index_path; // inverted tile index
     bool compact = false;
 
     paramList pl;
@@ -234,8 +242,12 @@ int32_t cmd_tile_density_stats_mt(int32_t argc, char **argv)
     BEGIN_LONG_PARAMS(longParameters)
     LONG_PARAM_GROUP("Input options", NULL)
     LONG_STRING_PARAM("in", &pmtilesf, "Input PMTiles file")
+    LONG_STRING_PARAM("cache-dir", &cache_dir, "Directory to persist data downloaded from remote (http/https/s3) inputs across runs")
+    LONG_INT_PARAM("cache-max-mb", &cache_max_mb, "Maximum size of --cache-dir in MB (default: 10240)")
+    LONG_INT_PARAM("max-connections", &max_connections, "Maximum number of concurrent requests to remote (http/https/s3) inputs (default: 8)")
     LONG_STRING_PARAM("count", &count_field, "Field name for transcript counts")
     LONG_STRING_PARAM("feature", &feature_field, "Field name for feature name")
+    LONG_STRING_PARAM("index", &index_path, "Inverted tile index to visit only the tiles containing the values required by --where (default: [in].idx.gz if it exists)")
 
     LONG_PARAM_GROUP("Output options", NULL)
     LONG_PARAM("compact", &compact, "Skip writing each tile")
@@ -243,6 +255,7 @@ int32_t cmd_tile_density_stats_mt(int32_t argc, char **argv)
 
     LONG_PARAM_GROUP("Filtering options", NULL)
     LONG_INT_PARAM("zoom", &zoom, "Zoom level (default: -1 -- maximum zoom level)")
+    LONG_STRING_PARAM("where", &where_expr, "Attribute predicate for the points to include, as clauses joined by 'and' (e.g. \"gene in (Actb,Gapdh) and count>=2\")")
     
     LONG_PARAM_GROUP("Performance options", NULL)
     LONG_INT_PARAM("threads", &num_threads, "Number of threads (default: hardware concurrency)")
@@ -263,6 +276,12 @@ int32_t cmd_tile_density_stats_mt(int32_t argc, char **argv)
         error("Missing required options --out");
     }
     
+    pt_predicate predicate;
+    if (!where_expr.empty())
+    {
+        predicate.parse(where_expr);
+    }
+
     // Set number of threads if not specified
     if (num_threads <= 0) {
         num_threads = std::thread::hardware_concurrency();
@@ -272,6 +291,12 @@ int32_t cmd_tile_density_stats_mt(int32_t argc, char **argv)
     }
     notice("Using %d threads", num_threads);
 
+    FlexReaderFactory::set_max_connections(max_connections);
+    if (!cache_dir.empty())
+    {
+        FlexReaderFactory::set_disk_cache(cache_dir.c_str(), (uint64_t)cache_max_mb << 20);
+    }
+
     // Open a PMTiles file
     pmt_pts pmt(pmtilesf.c_str());
 
@@ -282,6 +307,24 @@ int32_t cmd_tile_density_stats_mt(int32_t argc, char **argv)
         error("This pmtiles file is malformed or incompatible with pmpoints, which requires collection of points in MVT format");
     }
 
+    // tiles containing the values required by --where, from the inverted tile index
+    std::unordered_set<uint64_t> index_tiles;
+    bool use_index = false;
+    if (!predicate.empty())
+    {
+        // the default sidecar is skipped if it belongs to another version of the file
+        bool index_given = !index_path.empty();
+        if (!index_given)
+        {
+            index_path = pt_tile_index::find_default(pmtilesf);
+        }
+        if (!index_path.empty())
+        {
+            pt_tile_index tile_index;
+            use_index = tile_index.read(index_path, pmt.hdr, index_given) && tile_index.select_tiles(predicate, index_tiles);
+        }
+    }
+
     // Identify tiles that intersect with the region
     if (zoom == -1)
     {
@@ -313,14 +356,13 @@ int32_t cmd_tile_density_stats_mt(int32_t argc, char **argv)
     
     // Fill the queue with tiles at the specified zoom level
     int32_t num_tiles = 0;
-    for (int32_t i = 0; i < pmt.tile_entries.size(); ++i)
+    // visit only the tiles at the selected zoom level
+    std::pair<uint32_t, uint32_t> zoom_range = pmt.zoom_range(zoom);
+    for (int32_t i = zoom_range.first; i < zoom_range.second; ++i)
     {
         pmtiles::entry_zxy &entry = pmt.tile_entries[i];
-        // skip if the zoom level is not the same
-        if (entry.z != zoom)
-        {
+        if (use_index && index_tiles.count(pmtiles::zxy_to_tileid(entry.z, entry.x, entry.y)) == 0)
             continue;
-        }
         tile_queue.add_tile(entry);
         num_tiles++;
     }
@@ -335,7 +377,7 @@ int32_t cmd_tile_density_stats_mt(int32_t argc, char **argv)
     
     for (int32_t i = 0; i < num_threads; ++i) {
         threads.emplace_back(process_tiles, std::ref(tile_queue), std::ref(pmt), 
-                             std::ref(results), std::ref(count_field), std::ref(feature_field), std::ref(processed_count));
+                             std::ref(results), std::ref(count_field), std::ref(feature_field), predicate.empty() ? NULL : &predicate, std::ref(processed_count));
     }
     
     // Wait for all threads to complete
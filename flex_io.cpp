@@ -1,7 +1,33 @@
 #include "flex_io.h"
 #include "qgenlib/qgen_error.h"
 
-std::unique_ptr<FlexReader> FlexReaderFactory::create_reader(const char* path) {
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <strings.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <map>
+#include <algorithm>
+#include <dirent.h>
+#include <sys/file.h>
+
+std::string FlexReaderFactory::disk_cache_dir_;
+uint64_t FlexReaderFactory::disk_cache_max_bytes_ = 0;
+int32_t FlexReaderFactory::max_connections_ = 0;
+
+void FlexReaderFactory::set_disk_cache(const char* dir, uint64_t max_bytes) {
+    disk_cache_dir_.assign(dir);
+    disk_cache_max_bytes_ = max_bytes;
+}
+
+void FlexReaderFactory::set_max_connections(int32_t n) {
+    max_connections_ = n;
+}
+
+std::unique_ptr<FlexReader> FlexReaderFactory::create_reader(const char* path, uint64_t remote_cache_bytes) {
     std::unique_ptr<FlexReader> reader;
     std::string path_str(path);
 
@@ -19,10 +45,30 @@ std::unique_ptr<FlexReader> FlexReaderFactory::create_reader(const char* path) {
     else if (path_str.rfind("http://", 0) == 0 || path_str.rfind("https://", 0) == 0) {
         reader = std::make_unique<FlexHttpReader>();
     } else {
+        // map local files for zero-copy access; fall back to positional reads if mapping fails
+        reader = std::make_unique<FlexMmapReader>();
+        if ( reader->open(path_str.c_str()) ) {
+            return reader;
+        }
         reader = std::make_unique<FlexFileReader>();
+        if ( reader->open(path_str.c_str()) ) {
+            return reader;
+        }
+        error("Failed to open reader for path: %s", path_str.c_str());
+        return nullptr;
     }
 
     if (reader && reader->open(path_str.c_str())) {
+        if ( max_connections_ > 0 ) {
+            reader->set_max_concurrency(max_connections_);
+        }
+        // remote readers are wrapped in block caches so that repeated reads are served locally
+        if ( !disk_cache_dir_.empty() ) {
+            reader.reset(new FlexDiskCacheReader(std::move(reader), path_str, disk_cache_dir_, disk_cache_max_bytes_));
+        }
+        if ( remote_cache_bytes > 0 ) {
+            reader.reset(new FlexCachedReader(std::move(reader), remote_cache_bytes));
+        }
         return reader;
     }
     else {
@@ -36,26 +82,90 @@ FlexFileReader::~FlexFileReader() { close(); }
 
 bool FlexFileReader::open(const char* uri) {
     path_.assign(uri);
-    fp_ = std::fopen(path_.c_str(), "rb");
-    if ( !fp_ ) {
+    fd_ = ::open(path_.c_str(), O_RDONLY);
+    if ( fd_ < 0 ) {
         error("Failed to open file %s", uri);
         return false;
     }
-    std::fseek(fp_, 0, SEEK_END);
-    size_ = std::ftell(fp_);
-    std::fseek(fp_, 0, SEEK_SET);
+    struct stat st;
+    if ( fstat(fd_, &st) != 0 ) {
+        close();
+        error("Failed to stat file %s", uri);
+        return false;
+    }
+    size_ = static_cast<uint64_t>(st.st_size);
     return true;
 }
 
+void FlexFileReader::close() {
+    if ( is_open() ) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+}
+
 bool FlexFileReader::read_at(uint64_t offset, uint64_t length, std::string& buffer)  {
     if ( !is_open() ) return false;
-    if (std::fseek(fp_, static_cast<long>(offset), SEEK_SET) != 0) return false;
     buffer.resize(length);
-    size_t got = std::fread((void*)buffer.c_str(), 1, length, fp_);
-    if ( got != length ) {
+    // pread() may return fewer bytes than requested, so keep reading until done
+    uint64_t got = 0;
+    while ( got < length ) {
+        ssize_t rc = pread(fd_, &buffer[got], length - got, static_cast<off_t>(offset + got));
+        if ( rc < 0 && errno == EINTR ) continue;
+        if ( rc <= 0 ) {
+            buffer.clear();
+            return false;
+        }
+        got += static_cast<uint64_t>(rc);
+    }
+    return true;
+}
+
+FlexMmapReader::FlexMmapReader() {}
+FlexMmapReader::~FlexMmapReader() { close(); }
+
+bool FlexMmapReader::open(const char* uri) {
+    path_.assign(uri);
+    fd_ = ::open(path_.c_str(), O_RDONLY);
+    if ( fd_ < 0 ) {
+        error("Failed to open file %s", uri);
+        return false;
+    }
+    struct stat st;
+    if ( fstat(fd_, &st) != 0 || st.st_size <= 0 ) {
+        close();
+        return false;
+    }
+    size_ = static_cast<uint64_t>(st.st_size);
+    void* p = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd_, 0);
+    if ( p == MAP_FAILED ) {
+        notice("Failed to mmap file %s, using regular reads instead", uri);
+        close();
+        return false;
+    }
+    map_ = static_cast<const char*>(p);
+    return true;
+}
+
+void FlexMmapReader::close() {
+    if ( map_ != nullptr ) {
+        munmap(const_cast<char*>(map_), size_);
+        map_ = nullptr;
+    }
+    if ( fd_ >= 0 ) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+    size_ = 0;
+}
+
+bool FlexMmapReader::read_at(uint64_t offset, uint64_t length, std::string& buffer) {
+    const char* p = view_at(offset, length);
+    if ( p == nullptr ) {
         buffer.clear();
         return false;
     }
+    buffer.assign(p, length);
     return true;
 }
 
@@ -87,6 +197,17 @@ size_t FlexHttpReader::write_to_string(void* p, size_t sz, size_t nm, void* ud)
     // return new_length;
 }    
 
+// header callback that records the ETag of the HEAD response
+size_t FlexHttpReader::parse_etag_header(char* p, size_t sz, size_t nm, void* ud) {
+    std::string line(p, sz * nm);
+    if ( line.size() > 5 && strncasecmp(line.c_str(), "etag:", 5) == 0 ) {
+        size_t b = line.find_first_not_of(" \t", 5);
+        size_t e = line.find_last_not_of(" \t\r\n");
+        if ( b != std::string::npos && e >= b ) static_cast<std::string*>(ud)->assign(line, b, e - b + 1);
+    }
+    return sz * nm;
+}
+
 FlexHttpReader::FlexHttpReader() {
     curl_global_init(CURL_GLOBAL_DEFAULT);
     curl_ = curl_easy_init();
@@ -97,6 +218,21 @@ FlexHttpReader::~FlexHttpReader() {
     curl_global_cleanup();
 }
 
+void FlexHttpReader::close() {
+    // a running read_ranges() batch holds multi_mtx_, and handles checked out by read_at()
+    // are waited for, so that no handle is released into the pool after it is cleaned up
+    std::lock_guard<std::mutex> multi_lock(multi_mtx_);
+    std::unique_lock<std::mutex> lock(pool_mtx_);
+    is_open_ = false;
+    pool_cv_.notify_all();
+    pool_cv_.wait(lock, [this] { return (int32_t)idle_handles_.size() >= n_handles_; });
+    for (CURL* c : idle_handles_) curl_easy_cleanup(c);
+    idle_handles_.clear();
+    n_handles_ = 0;
+    if (multi_) { curl_multi_cleanup(multi_); multi_ = nullptr; }
+    curl_ = nullptr;
+}
+
 bool FlexHttpReader::open(const char* uri) {
     //curl_ = curl_easy_init();
     // if (!curl_) return false;
@@ -113,6 +249,8 @@ bool FlexHttpReader::open(const char* uri) {
     curl_easy_setopt(curl_, CURLOPT_FOLLOWLOCATION, 1L);
     curl_easy_setopt(curl_, CURLOPT_UNRESTRICTED_AUTH, 1L); 
     curl_easy_setopt(curl_, CURLOPT_NOBODY, 1L); // HEAD request
+    curl_easy_setopt(curl_, CURLOPT_HEADERFUNCTION, parse_etag_header);
+    curl_easy_setopt(curl_, CURLOPT_HEADERDATA, &etag_);
     if (curl_easy_perform(curl_) == CURLE_OK) {
         curl_off_t length = -1;
         curl_easy_getinfo(curl_, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &length);
@@ -122,32 +260,506 @@ bool FlexHttpReader::open(const char* uri) {
         }
     }
     curl_easy_setopt(curl_, CURLOPT_NOBODY, 0L); // Reset for future GETs
+    curl_easy_setopt(curl_, CURLOPT_HEADERFUNCTION, nullptr);
+    curl_easy_setopt(curl_, CURLOPT_HEADERDATA, nullptr);
+    curl_easy_setopt(curl_, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(curl_, CURLOPT_NOSIGNAL, 1L);
+
+    // the handle used for HEAD becomes the first pooled handle, keeping its connection alive
+    std::lock_guard<std::mutex> lock(pool_mtx_);
+    idle_handles_.push_back(curl_);
+    n_handles_ = 1;
     return is_open_;
 }
 
+void FlexHttpReader::set_max_concurrency(int32_t n) {
+    std::lock_guard<std::mutex> lock(pool_mtx_);
+    max_connections_ = n > 0 ? n : 1;
+}
+
+CURL* FlexHttpReader::new_handle() const {
+    CURL* c = curl_easy_init();
+    if (!c) return nullptr;
+    curl_easy_setopt(c, CURLOPT_URL, url_.c_str());
+    curl_easy_setopt(c, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(c, CURLOPT_UNRESTRICTED_AUTH, 1L);
+    curl_easy_setopt(c, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(c, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(c, CURLOPT_WRITEFUNCTION, write_to_string);
+    return c;
+}
+
+// take an idle handle, creating one if under the connection limit, or wait for one to be released
+CURL* FlexHttpReader::acquire_handle() {
+    std::unique_lock<std::mutex> lock(pool_mtx_);
+    while (is_open_ && idle_handles_.empty() && n_handles_ >= max_connections_) {
+        pool_cv_.wait(lock);
+    }
+    if (!is_open_) return nullptr;
+    if (!idle_handles_.empty()) {
+        CURL* c = idle_handles_.back();
+        idle_handles_.pop_back();
+        return c;
+    }
+    ++n_handles_;
+    lock.unlock();
+    CURL* c = new_handle();
+    if (!c) {
+        lock.lock();
+        --n_handles_;
+        pool_cv_.notify_all();
+    }
+    return c;
+}
+
+void FlexHttpReader::release_handle(CURL* c) {
+    std::lock_guard<std::mutex> lock(pool_mtx_);
+    if (n_handles_ > max_connections_) {
+        // the limit was lowered while this handle was in use
+        curl_easy_cleanup(c);
+        --n_handles_;
+    }
+    else {
+        idle_handles_.push_back(c);
+    }
+    // wakes both readers waiting for a handle and close() waiting for all handles to return
+    pool_cv_.notify_all();
+}
+
 bool FlexHttpReader::read_at(uint64_t offset, uint64_t length, std::string& buffer) {
-    if (!curl_) return false;
+    if (!is_open_) return false;
+    CURL* c = acquire_handle();
+    if (!c) return false;
     //std::string range = "bytes=" + std::to_string(offset) + "-" + std::to_string(offset + length - 1);
     std::string range = std::to_string(offset) + "-" + std::to_string(offset + length - 1);
     //notice("Requesting url: %s", url_.c_str());
     //notice("Requesting range: %s", range.c_str());
     buffer.clear();
-    curl_easy_setopt(curl_, CURLOPT_URL, url_.c_str());
-    curl_easy_setopt(curl_, CURLOPT_RANGE, range.c_str());
-    curl_easy_setopt(curl_, CURLOPT_WRITEFUNCTION, write_to_string);
-    curl_easy_setopt(curl_, CURLOPT_WRITEDATA, &buffer);
+    curl_easy_setopt(c, CURLOPT_URL, url_.c_str());
+    curl_easy_setopt(c, CURLOPT_RANGE, range.c_str());
+    curl_easy_setopt(c, CURLOPT_WRITEFUNCTION, write_to_string);
+    curl_easy_setopt(c, CURLOPT_WRITEDATA, &buffer);
 
+    bool ok = false;
     int32_t max_attempt = 4;
     for (int32_t attempt = 0; attempt < max_attempt; ++attempt) {
-        auto rc = curl_easy_perform(curl_);
+        buffer.clear();
+        auto rc = curl_easy_perform(c);
         long code = 0; 
-        curl_easy_getinfo(curl_, CURLINFO_RESPONSE_CODE, &code);
+        curl_easy_getinfo(c, CURLINFO_RESPONSE_CODE, &code);
         //notice("attempt %d: code = %ld", attempt, code);
-        if (rc == CURLE_OK && (code == 206 || (code == 200 && length == buffer.size())) && buffer.size() == length) return true;
+        if (rc == CURLE_OK && (code == 206 || (code == 200 && length == buffer.size())) && buffer.size() == length) { ok = true; break; }
         //notice("buffer.size() = %zu, expected length = %zu", buffer.size(), length);
         if (code == 429 || code == 503) { std::this_thread::sleep_for(std::chrono::milliseconds(150 << attempt)); continue; }
         break;
     }
-    buffer.clear();
-    return false;
-}
\ No newline at end of file
+    curl_easy_setopt(c, CURLOPT_WRITEDATA, nullptr);
+    release_handle(c);
+    if (!ok) buffer.clear();
+    return ok;
+}
+
+bool FlexHttpReader::read_ranges(const std::vector<std::pair<uint64_t, uint64_t> >& ranges, std::vector<std::string>& buffers) {
+    if (!is_open_) return false;
+    buffers.assign(ranges.size(), std::string());
+    if (ranges.size() < 2) {
+        return ranges.empty() || read_at(ranges[0].first, ranges[0].second, buffers[0]);
+    }
+
+    // one batch at a time shares the multi handle, whose connection cache persists across calls
+    std::lock_guard<std::mutex> multi_lock(multi_mtx_);
+    if (!multi_) {
+        multi_ = curl_multi_init();
+        if (!multi_) return FlexReader::read_ranges(ranges, buffers);
+    }
+    int32_t max_inflight;
+    {
+        std::lock_guard<std::mutex> lock(pool_mtx_);
+        max_inflight = max_connections_;
+    }
+    curl_multi_setopt(multi_, CURLMOPT_MAX_TOTAL_CONNECTIONS, (long)max_inflight);
+
+    std::vector<CURL*> handles;           // handles used by this batch
+    std::vector<std::string> range_strs(ranges.size());
+    std::vector<bool> done(ranges.size(), false);
+    size_t next = 0;
+    int32_t inflight = 0;
+    auto start_transfer = [&](size_t i, CURL* c) {
+        range_strs[i] = std::to_string(ranges[i].first) + "-" + std::to_string(ranges[i].first + ranges[i].second - 1);
+        buffers[i].clear();
+        curl_easy_setopt(c, CURLOPT_URL, url_.c_str());
+        curl_easy_setopt(c, CURLOPT_RANGE, range_strs[i].c_str());
+        curl_easy_setopt(c, CURLOPT_WRITEFUNCTION, write_to_string);
+        curl_easy_setopt(c, CURLOPT_WRITEDATA, &buffers[i]);
+        curl_easy_setopt(c, CURLOPT_PRIVATE, (void*)&range_strs[i]);
+        curl_multi_add_handle(multi_, c);
+        ++inflight;
+    };
+    while (next < ranges.size() && inflight < max_inflight) {
+        CURL* c = acquire_handle();
+        if (!c) break;
+        handles.push_back(c);
+        start_transfer(next, c);
+        ++next;
+    }
+
+    while (inflight > 0) {
+        int running = 0;
+        curl_multi_perform(multi_, &running);
+        int msgs_left = 0;
+        CURLMsg* msg;
+        while ((msg = curl_multi_info_read(multi_, &msgs_left)) != nullptr) {
+            if (msg->msg != CURLMSG_DONE) continue;
+            CURL* c = msg->easy_handle;
+            CURLcode rc = msg->data.result;
+            char* p_priv = nullptr;
+            curl_easy_getinfo(c, CURLINFO_PRIVATE, &p_priv);
+            size_t i = reinterpret_cast<std::string*>(p_priv) - range_strs.data();
+            long code = 0;
+            curl_easy_getinfo(c, CURLINFO_RESPONSE_CODE, &code);
+            curl_multi_remove_handle(multi_, c);
+            --inflight;
+            // failed transfers are retried below with read_at()
+            done[i] = (rc == CURLE_OK && (code == 206 || code == 200) && buffers[i].size() == ranges[i].second);
+            if (next < ranges.size()) {
+                start_transfer(next, c);
+                ++next;
+            }
+        }
+        if (inflight > 0) {
+            curl_multi_poll(multi_, nullptr, 0, 1000, nullptr);
+        }
+    }
+    for (CURL* c : handles) {
+        curl_easy_setopt(c, CURLOPT_WRITEDATA, nullptr);
+        curl_easy_setopt(c, CURLOPT_PRIVATE, nullptr);
+        release_handle(c);
+    }
+
+    for (size_t i = 0; i < ranges.size(); ++i) {
+        if (!done[i] && !read_at(ranges[i].first, ranges[i].second, buffers[i])) return false;
+    }
+    return true;
+}
+
+FlexBlockCacheReader::FlexBlockCacheReader(std::unique_ptr<FlexReader> inner, uint64_t block_size)
+    : inner_(std::move(inner)), block_size_(block_size), hits_(0), misses_(0) {}
+
+bool FlexBlockCacheReader::read_at(uint64_t offset, uint64_t length, std::string& buffer) {
+    std::vector<std::pair<uint64_t, uint64_t> > ranges(1, std::make_pair(offset, length));
+    std::vector<std::string> buffers;
+    if ( !read_ranges(ranges, buffers) ) {
+        buffer.clear();
+        return false;
+    }
+    buffer.swap(buffers[0]);
+    return true;
+}
+
+bool FlexBlockCacheReader::read_ranges(const std::vector<std::pair<uint64_t, uint64_t> >& ranges, std::vector<std::string>& buffers) {
+    uint64_t size = inner_->size_hint();
+    // pass 1: serve cached blocks and collect the runs of missing blocks
+    std::vector<std::vector<std::string> > pieces(ranges.size()); // per range, per block
+    std::vector<std::vector<bool> > missing(ranges.size());
+    std::vector<std::pair<uint64_t, uint64_t> > runs; // (first block, last block) of missing runs
+    for (size_t r = 0; r < ranges.size(); ++r) {
+        uint64_t offset = ranges[r].first, length = ranges[r].second;
+        if ( length == 0 ) continue;
+        uint64_t b0 = offset / block_size_, b1 = (offset + length - 1) / block_size_;
+        pieces[r].resize(b1 - b0 + 1);
+        missing[r].assign(b1 - b0 + 1, false);
+        for (uint64_t b = b0; b <= b1; ++b) {
+            uint64_t beg = (b == b0) ? offset - b * block_size_ : 0;
+            uint64_t end = (b == b1) ? offset + length - b * block_size_ : block_size_;
+            if ( copy_from_block(b, beg, end - beg, pieces[r][b - b0]) ) {
+                ++hits_;
+            }
+            else {
+                ++misses_;
+                missing[r][b - b0] = true;
+                if ( !runs.empty() && runs.back().second + 1 == b ) runs.back().second = b;
+                else runs.push_back(std::make_pair(b, b));
+            }
+        }
+    }
+
+    // pass 2: fetch the missing runs in one batch and populate the cache
+    std::map<uint64_t, std::string> fetched; // first block of a run -> data
+    if ( !runs.empty() ) {
+        std::sort(runs.begin(), runs.end());
+        std::vector<std::pair<uint64_t, uint64_t> > merged, spans;
+        for (auto& run : runs) {
+            if ( !merged.empty() && run.first <= merged.back().second + 1 ) merged.back().second = std::max(merged.back().second, run.second);
+            else merged.push_back(run);
+        }
+        for (auto& run : merged) {
+            uint64_t beg = run.first * block_size_;
+            uint64_t end = (run.second + 1) * block_size_;
+            if ( size > 0 && end > size ) end = size;
+            spans.push_back(std::make_pair(beg, end - beg));
+        }
+        std::vector<std::string> span_bufs;
+        {
+            std::unique_lock<std::mutex> lock(inner_mtx_, std::defer_lock);
+            if ( !inner_->is_thread_safe() ) lock.lock();
+            if ( !inner_->read_ranges(spans, span_bufs) ) return false;
+        }
+        for (size_t i = 0; i < merged.size(); ++i) {
+            const std::string& data = span_bufs[i];
+            for (uint64_t b = merged[i].first; b <= merged[i].second; ++b) {
+                uint64_t beg = (b - merged[i].first) * block_size_;
+                if ( beg >= data.size() ) break;
+                insert_block(b, data.data() + beg, std::min(block_size_, (uint64_t)data.size() - beg));
+            }
+            fetched[merged[i].first].swap(span_bufs[i]);
+        }
+    }
+
+    // pass 3: fill the missing pieces from the fetched runs and assemble the outputs
+    buffers.resize(ranges.size());
+    for (size_t r = 0; r < ranges.size(); ++r) {
+        uint64_t offset = ranges[r].first, length = ranges[r].second;
+        buffers[r].clear();
+        if ( length == 0 ) continue;
+        buffers[r].reserve(length);
+        uint64_t b0 = offset / block_size_;
+        for (size_t k = 0; k < pieces[r].size(); ++k) {
+            if ( missing[r][k] ) {
+                uint64_t b = b0 + k;
+                auto it = fetched.upper_bound(b);
+                --it;
+                uint64_t beg = (b == b0) ? offset : b * block_size_;
+                uint64_t end = std::min(offset + length, (b + 1) * block_size_);
+                uint64_t run_beg = it->first * block_size_;
+                if ( end - run_beg > it->second.size() ) return false;
+                buffers[r].append(it->second, beg - run_beg, end - beg);
+            }
+            else {
+                buffers[r].append(pieces[r][k]);
+            }
+        }
+    }
+    return true;
+}
+
+FlexCachedReader::FlexCachedReader(std::unique_ptr<FlexReader> inner, uint64_t capacity_bytes, uint64_t block_size, int32_t n_shards)
+    : FlexBlockCacheReader(std::move(inner), block_size) {
+    if ( n_shards < 1 ) n_shards = 1;
+    shard_capacity_ = capacity_bytes / n_shards;
+    for (int32_t i = 0; i < n_shards; ++i) {
+        shards_.emplace_back(new Shard());
+    }
+}
+
+FlexCachedReader::~FlexCachedReader() {
+    if ( hits_ + misses_ > 0 ) {
+        notice("Block cache: %llu hits, %llu misses (%.1f%% hit rate)", (unsigned long long)hits_.load(), (unsigned long long)misses_.load(), 100.0 * hits_ / (hits_ + misses_));
+    }
+}
+
+bool FlexCachedReader::copy_from_block(uint64_t block, uint64_t beg, uint64_t len, std::string& out) {
+    Shard& sh = shard_of(block);
+    std::lock_guard<std::mutex> lock(sh.mtx);
+    auto it = sh.blocks.find(block);
+    if ( it == sh.blocks.end() || it->second.first.size() < beg + len ) return false;
+    sh.lru.splice(sh.lru.begin(), sh.lru, it->second.second);
+    out.append(it->second.first, beg, len);
+    return true;
+}
+
+void FlexCachedReader::insert_block(uint64_t block, const char* data, uint64_t len) {
+    Shard& sh = shard_of(block);
+    std::lock_guard<std::mutex> lock(sh.mtx);
+    auto it = sh.blocks.find(block);
+    if ( it != sh.blocks.end() ) return; // another thread got here first
+    sh.lru.push_front(block);
+    sh.blocks.emplace(block, std::make_pair(std::string(data, len), sh.lru.begin()));
+    sh.bytes += len;
+    while ( sh.bytes > shard_capacity_ && sh.lru.size() > 1 ) {
+        auto old = sh.blocks.find(sh.lru.back());
+        sh.bytes -= old->second.first.size();
+        sh.blocks.erase(old);
+        sh.lru.pop_back();
+    }
+}
+
+// FNV-1a hash used to name cache subdirectories
+static uint64_t fnv1a64(const std::string& s) {
+    uint64_t h = 14695981039346656037ULL;
+    for (unsigned char c : s) { h ^= c; h *= 1099511628211ULL; }
+    return h;
+}
+
+static bool make_dirs(const std::string& path) {
+    for (size_t pos = path.find('/', 1); ; pos = path.find('/', pos + 1)) {
+        std::string sub = path.substr(0, pos);
+        if ( !sub.empty() && mkdir(sub.c_str(), 0777) != 0 && errno != EEXIST ) return false;
+        if ( pos == std::string::npos ) break;
+    }
+    return true;
+}
+
+// temporary files start with this prefix, so they never look like block files ("b<N>") to trim()
+static const char DISK_CACHE_TMP_PREFIX[] = ".tmp.";
+// temporary files older than this are left over from crashed writers and removed by trim()
+static const time_t DISK_CACHE_STALE_TMP_SECONDS = 3600;
+
+// write a file under a temporary name and rename it into place, so other processes never see partial contents
+static bool write_file_atomic(const std::string& path, const char* data, uint64_t len) {
+    size_t slash = path.rfind('/');
+    size_t base = (slash == std::string::npos) ? 0 : slash + 1;
+    std::string tmp = path.substr(0, base) + DISK_CACHE_TMP_PREFIX + path.substr(base) + "." + std::to_string(getpid()) + "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+    int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if ( fd < 0 ) return false;
+    uint64_t done = 0;
+    while ( done < len ) {
+        ssize_t rc = ::write(fd, data + done, len - done);
+        if ( rc < 0 && errno == EINTR ) continue;
+        if ( rc <= 0 ) break;
+        done += static_cast<uint64_t>(rc);
+    }
+    ::close(fd);
+    if ( done != len || rename(tmp.c_str(), path.c_str()) != 0 ) {
+        unlink(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+FlexDiskCacheReader::FlexDiskCacheReader(std::unique_ptr<FlexReader> inner, const std::string& url, const std::string& cache_dir, uint64_t max_bytes, uint64_t block_size)
+    : FlexBlockCacheReader(std::move(inner), block_size), root_dir_(cache_dir), max_bytes_(max_bytes), bytes_since_trim_(0) {
+    std::string key = url + "\n" + inner_->version_tag() + "\n" + std::to_string(inner_->size_hint()) + "\n" + std::to_string(block_size_) + "\n";
+    char hex[17];
+    snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)fnv1a64(key));
+    std::string dir = root_dir_ + "/" + hex;
+    if ( !make_dirs(dir) ) {
+        notice("Cannot create cache directory %s; disk cache disabled", dir.c_str());
+        return;
+    }
+    // the key file guards against hash collisions between different archives
+    std::string key_path = dir + "/key";
+    FILE* fp = fopen(key_path.c_str(), "rb");
+    if ( fp == NULL ) {
+        write_file_atomic(key_path, key.data(), key.size());
+        fp = fopen(key_path.c_str(), "rb");
+    }
+    std::string stored;
+    if ( fp != NULL ) {
+        char buf[4096];
+        size_t n;
+        while ( (n = fread(buf, 1, sizeof(buf), fp)) > 0 ) stored.append(buf, n);
+        fclose(fp);
+    }
+    if ( stored != key ) {
+        notice("Cache directory %s belongs to another archive; disk cache disabled", dir.c_str());
+        return;
+    }
+    if ( inner_->version_tag().empty() ) {
+        notice("No ETag is available for %s; cached blocks are validated by file size only", url.c_str());
+    }
+    dir_ = dir;
+    trim();
+}
+
+FlexDiskCacheReader::~FlexDiskCacheReader() {
+    if ( hits_ + misses_ > 0 ) {
+        notice("Disk cache: %llu hits, %llu misses (%.1f%% hit rate)", (unsigned long long)hits_.load(), (unsigned long long)misses_.load(), 100.0 * hits_ / (hits_ + misses_));
+    }
+}
+
+std::string FlexDiskCacheReader::block_path(uint64_t block) const {
+    return dir_ + "/b" + std::to_string(block);
+}
+
+bool FlexDiskCacheReader::copy_from_block(uint64_t block, uint64_t beg, uint64_t len, std::string& out) {
+    if ( dir_.empty() ) return false;
+    int fd = ::open(block_path(block).c_str(), O_RDONLY);
+    if ( fd < 0 ) return false;
+    // a block is complete if it is full-sized or reaches the end of the archive
+    struct stat st;
+    uint64_t size = inner_->size_hint();
+    uint64_t expected = (size > 0 && (block + 1) * block_size_ > size) ? size - block * block_size_ : block_size_;
+    bool ok = fstat(fd, &st) == 0 && static_cast<uint64_t>(st.st_size) == expected && beg + len <= expected;
+    if ( ok ) {
+        size_t prev = out.size();
+        out.resize(prev + len);
+        uint64_t got = 0;
+        while ( got < len ) {
+            ssize_t rc = pread(fd, &out[prev + got], len - got, static_cast<off_t>(beg + got));
+            if ( rc < 0 && errno == EINTR ) continue;
+            if ( rc <= 0 ) break;
+            got += static_cast<uint64_t>(rc);
+        }
+        ok = (got == len);
+        if ( ok ) futimens(fd, NULL); // refresh the timestamp used for LRU eviction
+        else out.resize(prev);
+    }
+    ::close(fd);
+    return ok;
+}
+
+void FlexDiskCacheReader::insert_block(uint64_t block, const char* data, uint64_t len) {
+    if ( dir_.empty() ) return;
+    if ( write_file_atomic(block_path(block), data, len) ) {
+        bytes_since_trim_ += len;
+        if ( bytes_since_trim_ > max_bytes_ / 16 ) {
+            bytes_since_trim_ = 0;
+            trim();
+        }
+    }
+}
+
+// evict the least recently used blocks across all archives until the cache is within 90% of max_bytes,
+// and remove stale temporary files
+void FlexDiskCacheReader::trim() {
+    // only one process trims at a time; others skip instead of waiting
+    std::string lock_path = root_dir_ + "/.lock";
+    int lock_fd = ::open(lock_path.c_str(), O_RDWR | O_CREAT, 0666);
+    if ( lock_fd < 0 ) return;
+    if ( flock(lock_fd, LOCK_EX | LOCK_NB) != 0 ) {
+        ::close(lock_fd);
+        return;
+    }
+
+    struct cached_file_t { std::string path; uint64_t size; time_t mtime; };
+    std::vector<cached_file_t> files;
+    uint64_t total = 0;
+    time_t now = time(NULL);
+    size_t tmp_prefix_len = sizeof(DISK_CACHE_TMP_PREFIX) - 1;
+    DIR* root = opendir(root_dir_.c_str());
+    if ( root != NULL ) {
+        struct dirent* de;
+        while ( (de = readdir(root)) != NULL ) {
+            if ( de->d_name[0] == '.' ) continue;
+            std::string sub = root_dir_ + "/" + de->d_name;
+            DIR* d = opendir(sub.c_str());
+            if ( d == NULL ) continue;
+            struct dirent* fe;
+            while ( (fe = readdir(d)) != NULL ) {
+                bool is_tmp = strncmp(fe->d_name, DISK_CACHE_TMP_PREFIX, tmp_prefix_len) == 0;
+                if ( !is_tmp && fe->d_name[0] != 'b' ) continue; // block files and temporary files only
+                std::string path = sub + "/" + fe->d_name;
+                struct stat st;
+                if ( stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode) ) continue;
+                if ( is_tmp ) {
+                    // a file still being written is recent; an old one was abandoned by a crashed writer
+                    if ( now - st.st_mtime > DISK_CACHE_STALE_TMP_SECONDS ) unlink(path.c_str());
+                    continue;
+                }
+                files.push_back(cached_file_t{path, static_cast<uint64_t>(st.st_size), st.st_mtime});
+                total += static_cast<uint64_t>(st.st_size);
+            }
+            closedir(d);
+        }
+        closedir(root);
+    }
+    if ( total > max_bytes_ ) {
+        std::sort(files.begin(), files.end(), [](const cached_file_t& a, const cached_file_t& b) { return a.mtime < b.mtime; });
+        uint64_t target = max_bytes_ / 10 * 9;
+        for (size_t i = 0; i < files.size() && total > target; ++i) {
+            if ( unlink(files[i].path.c_str()) == 0 ) total -= files[i].size;
+        }
+    }
+    flock(lock_fd, LOCK_UN);
+    ::close(lock_fd);
+}
@@ -8,6 +8,13 @@
 #include <curl/curl.h>
 #include <thread>
 #include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <utility>
+#include <list>
+#include <unordered_map>
+#include <atomic>
 
 class FlexReader {
 public:
@@ -18,11 +25,29 @@ public:
     virtual uint64_t size_hint() const { return 0; }
     virtual bool is_open() const = 0;    
     virtual void close() = 0;
+    // true if read_at() may be called concurrently from multiple threads without external locking
+    virtual bool is_thread_safe() const { return false; }
+    // zero-copy access to [offset, offset+length); returns nullptr if unsupported or out of range
+    virtual const char* view_at(uint64_t offset, uint64_t length) const { return nullptr; }
+    // read several (offset, length) ranges; readers that can overlap requests override this
+    virtual bool read_ranges(const std::vector<std::pair<uint64_t, uint64_t> >& ranges, std::vector<std::string>& buffers) {
+        buffers.resize(ranges.size());
+        for (size_t i = 0; i < ranges.size(); ++i) {
+            if ( !read_at(ranges[i].first, ranges[i].second, buffers[i]) ) return false;
+        }
+        return true;
+    }
+    // limit on the number of requests in flight, for readers backed by a network connection
+    virtual void set_max_concurrency(int32_t n) {}
+    // identifies the version of remote content (e.g. an ETag); empty if unknown
+    virtual std::string version_tag() const { return ""; }
 };
 
+// Local file reader based on positional reads (pread), so that
+// read_at() does not touch a shared file offset and is safe to call concurrently
 class FlexFileReader : public FlexReader {
     std::string path_;
-    FILE* fp_ = nullptr;
+    int fd_ = -1;
     uint64_t size_ = 0;
 
 public:
@@ -31,31 +56,158 @@ public:
     bool open(const char* uri) override;
     bool read_at(uint64_t offset, uint64_t length, std::string& buffer) override;
     uint64_t size_hint() const override { return size_; }
-    bool is_open() const override { return fp_ != nullptr; }
-    void close() override { if ( is_open() ) { fclose(fp_); fp_ = nullptr; } }
+    bool is_open() const override { return fd_ >= 0; }
+    void close() override;
+    bool is_thread_safe() const override { return true; }
 };
 
+// Local file reader that maps the whole file into memory.
+// view_at() returns pointers into the mapping, so callers can consume bytes without copying
+class FlexMmapReader : public FlexReader {
+    std::string path_;
+    int fd_ = -1;
+    const char* map_ = nullptr;
+    uint64_t size_ = 0;
+
+public:
+    FlexMmapReader();
+    ~FlexMmapReader() override;
+    bool open(const char* uri) override;
+    bool read_at(uint64_t offset, uint64_t length, std::string& buffer) override;
+    uint64_t size_hint() const override { return size_; }
+    bool is_open() const override { return fd_ >= 0; }
+    void close() override;
+    bool is_thread_safe() const override { return true; }
+    const char* view_at(uint64_t offset, uint64_t length) const override {
+        if ( map_ == nullptr || offset > size_ || length > size_ - offset ) return nullptr;
+        return map_ + offset;
+    }
+};
+
+// HTTP(S) range reader. Easy handles are pooled so that concurrent read_at() calls
+// each reuse a keep-alive connection, and read_ranges() overlaps requests with curl_multi
 class FlexHttpReader : public FlexReader {
     std::string url_;
     CURL* curl_ = nullptr;
     uint64_t size_ = 0;
-    bool is_open_ = false;
+    std::atomic<bool> is_open_{false};
+    std::string etag_;
     static size_t write_to_string(void* p, size_t sz, size_t nm, void* ud);
+    static size_t parse_etag_header(char* p, size_t sz, size_t nm, void* ud);
     bool parse_head();
 
+    std::mutex pool_mtx_;
+    std::condition_variable pool_cv_;
+    std::vector<CURL*> idle_handles_;  // handles ready for reuse
+    int32_t n_handles_ = 0;            // handles created so far (idle or checked out)
+    int32_t max_connections_ = 8;      // maximum number of requests in flight
+    std::mutex multi_mtx_;
+    CURLM* multi_ = nullptr;
+    CURL* new_handle() const;
+    CURL* acquire_handle();
+    void release_handle(CURL* c);
+
 public:
     FlexHttpReader();
     ~FlexHttpReader() override; // { if (curl_) { curl_easy_cleanup(curl_); curl_ = nullptr; } }
     bool open(const char* uri) override;
     bool read_at(uint64_t offset, uint64_t length, std::string& buffer) override;
+    bool read_ranges(const std::vector<std::pair<uint64_t, uint64_t> >& ranges, std::vector<std::string>& buffers) override;
     uint64_t size_hint() const override { return size_; }
-    bool is_open() const override { return curl_ != nullptr; }
-    void close() override { if ( is_open() ) { curl_easy_cleanup(curl_); curl_ = nullptr; } }
+    bool is_open() const override { return is_open_; }
+    void close() override;
+    bool is_thread_safe() const override { return true; }
+    void set_max_concurrency(int32_t n) override;
+    std::string version_tag() const override { return etag_; }
+};
+
+// Base for decorators that serve reads from cached fixed-size aligned blocks of another reader.
+// Subclasses provide the block storage; missing blocks are fetched from the wrapped reader in contiguous runs
+class FlexBlockCacheReader : public FlexReader {
+protected:
+    std::unique_ptr<FlexReader> inner_;
+    std::mutex inner_mtx_;  // serializes inner reads if the inner reader is not thread-safe
+    uint64_t block_size_;
+    std::atomic<uint64_t> hits_;
+    std::atomic<uint64_t> misses_;
+
+    // append [beg, beg+len) of a cached block to out; returns false if the block is not cached
+    virtual bool copy_from_block(uint64_t block, uint64_t beg, uint64_t len, std::string& out) = 0;
+    virtual void insert_block(uint64_t block, const char* data, uint64_t len) = 0;
+
+public:
+    FlexBlockCacheReader(std::unique_ptr<FlexReader> inner, uint64_t block_size);
+    bool open(const char* uri) override { return inner_->open(uri); }
+    bool read_at(uint64_t offset, uint64_t length, std::string& buffer) override;
+    bool read_ranges(const std::vector<std::pair<uint64_t, uint64_t> >& ranges, std::vector<std::string>& buffers) override;
+    uint64_t size_hint() const override { return inner_->size_hint(); }
+    bool is_open() const override { return inner_->is_open(); }
+    void close() override { inner_->close(); }
+    bool is_thread_safe() const override { return true; }
+    void set_max_concurrency(int32_t n) override { inner_->set_max_concurrency(n); }
+    std::string version_tag() const override { return inner_->version_tag(); }
+    uint64_t hits() const { return hits_.load(); }
+    uint64_t misses() const { return misses_.load(); }
+};
+
+// In-memory block cache with LRU eviction.
+// Blocks are spread over independently locked shards, so concurrent readers rarely contend
+class FlexCachedReader : public FlexBlockCacheReader {
+    struct Shard {
+        std::mutex mtx;
+        std::list<uint64_t> lru; // block indices, most recently used first
+        std::unordered_map<uint64_t, std::pair<std::string, std::list<uint64_t>::iterator> > blocks;
+        uint64_t bytes = 0;
+    };
+    uint64_t shard_capacity_;
+    std::vector<std::unique_ptr<Shard> > shards_;
+
+    Shard& shard_of(uint64_t block) { return *shards_[block % shards_.size()]; }
+
+protected:
+    bool copy_from_block(uint64_t block, uint64_t beg, uint64_t len, std::string& out) override;
+    void insert_block(uint64_t block, const char* data, uint64_t len) override;
+
+public:
+    FlexCachedReader(std::unique_ptr<FlexReader> inner, uint64_t capacity_bytes, uint64_t block_size = 65536, int32_t n_shards = 16);
+    ~FlexCachedReader() override;
+};
+
+// Persistent block cache under a local directory, shared across runs and processes.
+// Each archive version gets its own subdirectory keyed by URL, version tag (ETag) and size,
+// so a changed remote archive never reuses stale blocks. Blocks are published with an atomic rename,
+// and the least recently used blocks of all archives are evicted once the directory exceeds max_bytes.
+// Temporary files left behind by crashed writers are removed after an hour
+class FlexDiskCacheReader : public FlexBlockCacheReader {
+    std::string root_dir_;  // cache root shared by all archives
+    std::string dir_;       // subdirectory for this archive version; empty if the cache is unusable
+    uint64_t max_bytes_;
+    std::atomic<uint64_t> bytes_since_trim_;
+
+    std::string block_path(uint64_t block) const;
+    void trim();
+
+protected:
+    bool copy_from_block(uint64_t block, uint64_t beg, uint64_t len, std::string& out) override;
+    void insert_block(uint64_t block, const char* data, uint64_t len) override;
+
+public:
+    FlexDiskCacheReader(std::unique_ptr<FlexReader> inner, const std::string& url, const std::string& cache_dir, uint64_t max_bytes, uint64_t block_size = 1048576);
+    ~FlexDiskCacheReader() override;
 };
 
 class FlexReaderFactory {
+    static std::string disk_cache_dir_;
+    static uint64_t disk_cache_max_bytes_;
+    static int32_t max_connections_;
+
 public:
-    static std::unique_ptr<FlexReader> create_reader(const char* path);
+    static const uint64_t DEFAULT_REMOTE_CACHE_BYTES = 128ULL << 20; // block cache budget for remote readers
+    // persist blocks of remote readers created afterwards under dir, keeping it below max_bytes
+    static void set_disk_cache(const char* dir, uint64_t max_bytes);
+    // limit the requests in flight of each remote reader created afterwards (n <= 0 keeps the reader default)
+    static void set_max_connections(int32_t n);
+    static std::unique_ptr<FlexReader> create_reader(const char* path, uint64_t remote_cache_bytes = DEFAULT_REMOTE_CACHE_BYTES);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,745 @@
+#include "mlt_codec.h"
+#include "mlt_varint.h"
+#include "qgenlib/qgen_error.h"
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+
+static inline uint64_t read_varint(const uint8_t *&p, const uint8_t *end)
+{
+    uint64_t val = 0;
+    int shift = 0;
+    while (p < end)
+    {
+        uint8_t b = *p++;
+        val |= (uint64_t)(b & 0x7F) << shift;
+        if ((b & 0x80) == 0)
+            break;
+        shift += 7;
+    }
+    return val;
+}
+
+static inline void write_varint(std::string &out, uint64_t v)
+{
+    do
+    {
+        uint8_t b = v & 0x7F;
+        v >>= 7;
+        if (v)
+            b |= 0x80;
+        out.push_back((char)b);
+    } while (v);
+}
+
+// header of a stream, with p advanced past its bytes
+struct mlt_stream_header
+{
+    uint8_t physical_type; // 0 = PRESENT, 1 = DATA, 3 = LENGTH
+    uint8_t logical_type;  // 3 = VERTEX for GEOMETRY DATA streams
+    uint64_t num_values;
+    mlt_stream stream;
+};
+
+static void read_stream(const uint8_t *&p, const uint8_t *end, mlt_stream_header &s)
+{
+    if (p + 2 > end)
+        error("Truncated stream header in an MLT tile");
+    s.physical_type = (p[0] >> 4) & 0x0F;
+    s.logical_type = p[0] & 0x0F;
+    s.stream.technique = p[1];
+    p += 2;
+    s.num_values = read_varint(p, end);
+    uint64_t byte_len = read_varint(p, end);
+    s.stream.runs = 0;
+    if (s.stream.logical() == MLT_LOGICAL_RLE)
+    {
+        // the number of runs, and the number of values after expanding them
+        s.stream.runs = (size_t)read_varint(p, end);
+        s.num_values = read_varint(p, end);
+    }
+    if (byte_len > (uint64_t)(end - p))
+        error("Truncated stream in an MLT tile");
+    s.stream.bytes.data = p;
+    s.stream.bytes.size = (size_t)byte_len;
+    p += byte_len;
+}
+
+static inline uint32_t zigzag_encode(int32_t v) { return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31); }
+static inline int32_t zigzag_decode(uint32_t u) { return (int32_t)((u >> 1) ^ (0 - (u & 1))); }
+
+#define MLT_PACKED_BLOCK 128 // number of values per bit-packed block
+
+// unpack n values of bit-packed blocks, returning the number of values decoded
+static size_t unpack_blocks(const uint8_t *data, size_t len, size_t n, uint32_t *out)
+{
+    const uint8_t *p = data;
+    const uint8_t *end = data + len;
+    size_t i = 0;
+    while (i < n && p < end)
+    {
+        uint32_t width = *p++;
+        if (width > 32)
+            error("Invalid bit width %u of a packed stream in an MLT tile", width);
+        size_t count = std::min((size_t)MLT_PACKED_BLOCK, n - i);
+        if ((count * width + 7) / 8 > (size_t)(end - p))
+            return i;
+        uint64_t mask = (width == 32) ? 0xFFFFFFFFULL : (((uint64_t)1 << width) - 1);
+        uint64_t buf = 0;
+        uint32_t nbits = 0;
+        for (size_t j = 0; j < count; ++j)
+        {
+            while (nbits < width)
+            {
+                buf |= (uint64_t)(*p++) << nbits;
+                nbits += 8;
+            }
+            out[i++] = (uint32_t)(buf & mask);
+            buf >>= width;
+            nbits -= width;
+        }
+    }
+    return i;
+}
+
+// decode n values of an integer stream; signed values are zigzag-decoded
+static void decode_int_stream(const mlt_stream &s, size_t n, bool is_signed, int32_t *out)
+{
+    if (n == 0) // out may be null for an empty column or a tile without features
+        return;
+    memset(out, 0, n * sizeof(int32_t));
+    mlt_logical_t logical = s.logical();
+    if (logical == MLT_LOGICAL_RLE)
+    {
+        // run lengths, then run values
+        std::vector<uint32_t> u(2 * s.runs, 0);
+        if (s.physical() == MLT_PHYSICAL_PACKED)
+            unpack_blocks(s.bytes.data, s.bytes.size, u.size(), u.data());
+        else
+            mlt_decode_varint32(s.bytes.data, s.bytes.size, u.size(), u.data());
+        size_t i = 0;
+        for (size_t r = 0; r < s.runs && i < n; ++r)
+        {
+            int32_t v = is_signed ? zigzag_decode(u[s.runs + r]) : (int32_t)u[s.runs + r];
+            for (size_t j = 0; j < u[r] && i < n; ++j)
+                out[i++] = v;
+        }
+        return;
+    }
+    bool deltas = (logical == MLT_LOGICAL_DELTA || logical == MLT_LOGICAL_COMPONENTWISE_DELTA);
+    if (s.physical() == MLT_PHYSICAL_PACKED)
+    {
+        unpack_blocks(s.bytes.data, s.bytes.size, n, (uint32_t *)out);
+        if (is_signed || deltas)
+        {
+            for (size_t i = 0; i < n; ++i)
+                out[i] = zigzag_decode((uint32_t)out[i]);
+        }
+    }
+    else if (is_signed || deltas)
+        mlt_decode_zigzag32(s.bytes.data, s.bytes.size, n, out);
+    else
+        mlt_decode_varint32(s.bytes.data, s.bytes.size, n, (uint32_t *)out);
+    if (deltas)
+    {
+        // prefix sums in 32-bit wrap-around arithmetic, separately for x and y of componentwise deltas
+        size_t stride = (logical == MLT_LOGICAL_COMPONENTWISE_DELTA) ? 2 : 1;
+        for (size_t i = stride; i < n; ++i)
+            out[i] = (int32_t)((uint32_t)out[i] + (uint32_t)out[i - stride]);
+    }
+}
+
+bool mlt_layer_reader::parse(const uint8_t *data, size_t size)
+{
+    name.clear();
+    extent = 0;
+    num_features = 0;
+    columns.clear();
+    vertices = mlt_stream();
+
+    const uint8_t *p = data;
+    const uint8_t *end = data + size;
+    while (p < end)
+    {
+        uint64_t layer_len = read_varint(p, end);
+        if (layer_len == 0 || p >= end)
+            break;
+        const uint8_t *layer_end = (layer_len > (uint64_t)(end - p)) ? end : p + layer_len;
+        if (*p++ != 1)
+        { // not a feature table
+            p = layer_end;
+            continue;
+        }
+
+        // metadata
+        uint64_t name_len = read_varint(p, layer_end);
+        if (name_len > (uint64_t)(layer_end - p))
+            error("Truncated layer name in an MLT tile");
+        name.assign((const char *)p, name_len);
+        p += name_len;
+        extent = (uint32_t)read_varint(p, layer_end);
+        uint64_t num_columns = read_varint(p, layer_end);
+        for (uint64_t c = 0; c < num_columns; ++c)
+        {
+            uint64_t type_code = read_varint(p, layer_end);
+            if (c == 0)
+                continue; // GEOMETRY, without a name
+            mlt_column_view col;
+            col.nullable = (type_code % 2 == 1);
+            uint64_t base = type_code - (type_code % 2);
+            if (base >= 12 && base <= 23) // INT_8 .. UINT_64
+                col.type = MLT_COL_INT;
+            else if (base >= 24 && base <= 27) // FLOAT, DOUBLE
+                col.type = MLT_COL_FLOAT;
+            else
+                col.type = MLT_COL_STRING;
+            if (type_code >= 10)
+            {
+                uint64_t cname_len = read_varint(p, layer_end);
+                if (cname_len > (uint64_t)(layer_end - p))
+                    error("Truncated column name in an MLT tile");
+                col.name.assign((const char *)p, cname_len);
+                p += cname_len;
+            }
+            columns.push_back(col);
+        }
+
+        // data of the GEOMETRY column
+        mlt_stream_header s;
+        uint64_t geom_num_streams = read_varint(p, layer_end);
+        for (uint64_t i = 0; i < geom_num_streams; ++i)
+        {
+            read_stream(p, layer_end, s);
+            if (s.physical_type == 1 && s.logical_type == 3)
+            { // VERTEX
+                num_features = (size_t)(s.num_values / 2);
+                vertices = s.stream;
+            }
+        }
+
+        // data of the attribute columns
+        for (mlt_column_view &col : columns)
+        {
+            uint64_t ns = (col.type == MLT_COL_STRING) ? read_varint(p, layer_end) : (col.nullable ? 2 : 1);
+            for (uint64_t i = 0; i < ns; ++i)
+            {
+                read_stream(p, layer_end, s);
+                if (s.physical_type == 0)
+                    col.present = s.stream.bytes;
+                else if (s.physical_type == 1)
+                {
+                    col.data = s.stream;
+                    if (col.type != MLT_COL_STRING) // string DATA streams have no value count
+                        col.num_values = (size_t)s.num_values;
+                    else if (s.logical_type == 1)   // SINGLE dictionary
+                        col.dictionary = true;
+                }
+                else if (s.physical_type == 2)
+                { // OFFSET, the dictionary indices
+                    col.offsets = s.stream;
+                    col.num_values = (size_t)s.num_values;
+                }
+                else if (s.physical_type == 3)
+                {
+                    if (s.logical_type == 7)
+                        col.prefixes = s.stream;
+                    else if (s.logical_type == 6)
+                    { // DICTIONARY
+                        col.lengths = s.stream;
+                        col.dict_size = (size_t)s.num_values;
+                    }
+                    else
+                    {
+                        col.lengths = s.stream;
+                        col.num_values = (size_t)s.num_values;
+                    }
+                }
+            }
+        }
+        return true; // only the first layer
+    }
+    return false;
+}
+
+void mlt_layer_reader::decode_vertices(std::vector<int32_t> &xy) const
+{
+    xy.resize(2 * num_features);
+    decode_int_stream(vertices, xy.size(), true, xy.data());
+}
+
+void mlt_layer_reader::decode_present(size_t c, std::vector<uint8_t> &bits) const
+{
+    size_t nbytes = (num_features + 7) / 8;
+    const mlt_span &rle = columns[c].present;
+    if (rle.data == NULL)
+    {
+        bits.assign(nbytes, 0xFF);
+        return;
+    }
+    // ORC-style byte RLE: a header >= 128 is followed by (256 - header) literal bytes,
+    // and a header < 128 by one byte repeated (header + 3) times
+    bits.clear();
+    bits.reserve(nbytes);
+    size_t i = 0;
+    while (i < rle.size && bits.size() < nbytes)
+    {
+        uint8_t header = rle.data[i++];
+        if (header >= 128)
+        {
+            size_t run_len = 256 - header;
+            for (size_t j = 0; j < run_len && i < rle.size && bits.size() < nbytes; ++j)
+                bits.push_back(rle.data[i++]);
+        }
+        else if (i < rle.size)
+        {
+            uint8_t byte = rle.data[i++];
+            for (size_t j = 0; j < (size_t)header + 3 && bits.size() < nbytes; ++j)
+                bits.push_back(byte);
+        }
+    }
+    bits.resize(nbytes, 0xFF); // features beyond the stream are present
+}
+
+void mlt_layer_reader::decode_ints(size_t c, std::vector<int32_t> &values) const
+{
+    const mlt_column_view &col = columns[c];
+    values.resize(col.num_values);
+    decode_int_stream(col.data, values.size(), true, values.data());
+}
+
+void mlt_layer_reader::decode_floats(size_t c, std::vector<float> &values) const
+{
+    const mlt_column_view &col = columns[c];
+    size_t n = col.num_values;
+    if (n > col.data.bytes.size / 4)
+        n = col.data.bytes.size / 4;
+    values.assign(col.num_values, 0);
+    const uint8_t *dp = col.data.bytes.data;
+    for (size_t i = 0; i < n; ++i, dp += 4)
+    {
+        uint32_t bits = (uint32_t)dp[0] | ((uint32_t)dp[1] << 8) | ((uint32_t)dp[2] << 16) | ((uint32_t)dp[3] << 24);
+        memcpy(&values[i], &bits, 4);
+    }
+}
+
+void mlt_layer_reader::decode_strings(size_t c, std::vector<std::pair<const char *, uint32_t> > &values) const
+{
+    const mlt_column_view &col = columns[c];
+    if (col.dictionary)
+        error("Column %s is dictionary-encoded", col.name.c_str());
+    std::vector<int32_t> lens(col.num_values);
+    decode_int_stream(col.lengths, lens.size(), false, lens.data());
+    values.clear();
+    values.reserve(lens.size());
+    size_t off = 0;
+    for (size_t i = 0; i < lens.size(); ++i)
+    {
+        if ((uint32_t)lens[i] > col.data.bytes.size - off)
+            error("String data is shorter than its lengths in an MLT tile");
+        values.emplace_back((const char *)col.data.bytes.data + off, lens[i]);
+        off += lens[i];
+    }
+}
+
+void mlt_layer_reader::decode_dictionary(size_t c, std::vector<std::string> &entries, std::vector<int32_t> &indices) const
+{
+    const mlt_column_view &col = columns[c];
+    if (!col.dictionary)
+        error("Column %s is not dictionary-encoded", col.name.c_str());
+    std::vector<int32_t> lens(col.dict_size), prefixes(col.dict_size, 0);
+    decode_int_stream(col.lengths, lens.size(), false, lens.data());
+    if (col.prefixes.bytes.data != NULL)
+        decode_int_stream(col.prefixes, prefixes.size(), false, prefixes.data());
+    entries.resize(col.dict_size);
+    size_t off = 0;
+    for (size_t i = 0; i < col.dict_size; ++i)
+    {
+        if ((uint32_t)lens[i] > col.data.bytes.size - off)
+            error("Dictionary data is shorter than its lengths in an MLT tile");
+        if (prefixes[i] != 0 && (i == 0 || (uint32_t)prefixes[i] > entries[i - 1].size()))
+            error("Invalid prefix length of a dictionary entry in an MLT tile");
+        if (prefixes[i] != 0)
+            entries[i].assign(entries[i - 1], 0, prefixes[i]);
+        else
+            entries[i].clear();
+        entries[i].append((const char *)col.data.bytes.data + off, lens[i]);
+        off += lens[i];
+    }
+    indices.resize(col.num_values);
+    decode_int_stream(col.offsets, indices.size(), false, indices.data());
+    for (int32_t idx : indices)
+    {
+        if ((uint32_t)idx >= col.dict_size)
+            error("Dictionary index out of range in an MLT tile");
+    }
+}
+
+size_t mlt_layer_writer::add_column(const std::string &col_name, mlt_col_type_t type, bool nullable)
+{
+    columns.emplace_back();
+    column_t &col = columns.back();
+    col.name = col_name;
+    col.type = type;
+    col.nullable = nullable;
+    return columns.size() - 1;
+}
+
+void mlt_layer_writer::add_point(int32_t x, int32_t y)
+{
+    vertices.push_back(x);
+    vertices.push_back(y);
+}
+
+void mlt_layer_writer::add_int(size_t c, int32_t v)
+{
+    column_t &col = columns[c];
+    if (col.nullable)
+        col.present.push_back(true);
+    col.ints.push_back(v);
+    ++col.num_values;
+}
+
+void mlt_layer_writer::add_float(size_t c, float v)
+{
+    column_t &col = columns[c];
+    if (col.nullable)
+        col.present.push_back(true);
+    uint32_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    col.data.push_back((char)(bits & 0xFF));
+    col.data.push_back((char)((bits >> 8) & 0xFF));
+    col.data.push_back((char)((bits >> 16) & 0xFF));
+    col.data.push_back((char)((bits >> 24) & 0xFF));
+    ++col.num_values;
+}
+
+void mlt_layer_writer::add_string(size_t c, const char *s, size_t len)
+{
+    column_t &col = columns[c];
+    if (col.nullable)
+        col.present.push_back(true);
+    col.lengths.push_back((int32_t)len);
+    col.data.append(s, len);
+    ++col.num_values;
+}
+
+void mlt_layer_writer::add_null(size_t c)
+{
+    column_t &col = columns[c];
+    if (col.nullable)
+        col.present.push_back(false);
+    else if (col.type == MLT_COL_INT)
+        add_int(c, 0);
+    else if (col.type == MLT_COL_FLOAT)
+        add_float(c, 0);
+    else
+        add_string(c, "", 0);
+}
+
+// header and bytes of a stream; technique 0x02 is VARINT and 0x00 is NONE
+static void write_stream(std::string &out, uint8_t header, uint8_t technique, uint64_t num_values, const std::string &bytes)
+{
+    out.push_back((char)header);
+    out.push_back((char)technique);
+    write_varint(out, num_values);
+    write_varint(out, bytes.size());
+    out.append(bytes);
+}
+
+static inline size_t varint_size(uint32_t v)
+{
+    size_t n = 1;
+    for (; v >= 0x80; v >>= 7)
+        ++n;
+    return n;
+}
+
+static inline uint32_t bit_width(uint32_t v)
+{
+    uint32_t w = 0;
+    for (; v; v >>= 1)
+        ++w;
+    return w;
+}
+
+// bit widths of the blocks of bit-packed values, returning the packed size in bytes
+static size_t block_widths(const std::vector<uint32_t> &u, std::vector<uint8_t> &widths)
+{
+    widths.clear();
+    size_t size = 0;
+    for (size_t i = 0; i < u.size(); i += MLT_PACKED_BLOCK)
+    {
+        size_t count = std::min((size_t)MLT_PACKED_BLOCK, u.size() - i);
+        uint32_t all = 0;
+        for (size_t j = 0; j < count; ++j)
+            all |= u[i + j];
+        widths.push_back((uint8_t)bit_width(all));
+        size += 1 + (count * widths.back() + 7) / 8;
+    }
+    return size;
+}
+
+static void write_packed(std::string &out, const std::vector<uint32_t> &u, const std::vector<uint8_t> &widths)
+{
+    for (size_t i = 0, b = 0; i < u.size(); i += MLT_PACKED_BLOCK, ++b)
+    {
+        size_t count = std::min((size_t)MLT_PACKED_BLOCK, u.size() - i);
+        uint32_t width = widths[b];
+        out.push_back((char)width);
+        uint64_t buf = 0;
+        uint32_t nbits = 0;
+        for (size_t j = 0; j < count; ++j)
+        {
+            buf |= (uint64_t)u[i + j] << nbits;
+            for (nbits += width; nbits >= 8; nbits -= 8)
+            {
+                out.push_back((char)(buf & 0xFF));
+                buf >>= 8;
+            }
+        }
+        if (nbits > 0)
+            out.push_back((char)(buf & 0xFF));
+    }
+}
+
+// Write an integer stream with the logical technique that minimizes its size, and bit-packed if allowed and smaller
+// stride is 2 for vertices, whose deltas are taken separately for x and y
+static void write_int_stream(std::string &out, uint8_t header, const std::vector<int32_t> &v, bool is_signed, size_t stride, bool packed)
+{
+    size_t n = v.size();
+    std::vector<uint32_t> best, u;
+    uint8_t best_logical = MLT_LOGICAL_NONE;
+    size_t runs = 0;
+    // plain values
+    best.resize(n);
+    for (size_t i = 0; i < n; ++i)
+        best[i] = is_signed ? zigzag_encode(v[i]) : (uint32_t)v[i];
+    size_t best_size = 0;
+    for (uint32_t x : best)
+        best_size += varint_size(x);
+    // zigzag-encoded deltas
+    if (n > stride)
+    {
+        u.resize(n);
+        for (size_t i = 0; i < n; ++i)
+            u[i] = zigzag_encode((int32_t)((uint32_t)v[i] - (i >= stride ? (uint32_t)v[i - stride] : 0)));
+        size_t size = 0;
+        for (uint32_t x : u)
+            size += varint_size(x);
+        if (size < best_size)
+        {
+            best.swap(u);
+            best_size = size;
+            best_logical = (stride == 2) ? MLT_LOGICAL_COMPONENTWISE_DELTA : MLT_LOGICAL_DELTA;
+        }
+    }
+    // run lengths, then run values
+    size_t num_runs = 0;
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (i == 0 || v[i] != v[i - 1])
+            ++num_runs;
+    }
+    if (num_runs * 2 < n)
+    {
+        u.assign(2 * num_runs, 0);
+        for (size_t i = 0, r = 0; i < n; ++i)
+        {
+            if (i > 0 && v[i] != v[i - 1])
+                ++r;
+            ++u[r];
+            u[num_runs + r] = is_signed ? zigzag_encode(v[i]) : (uint32_t)v[i];
+        }
+        size_t size = varint_size((uint32_t)num_runs) + varint_size((uint32_t)n);
+        for (uint32_t x : u)
+            size += varint_size(x);
+        if (size < best_size)
+        {
+            best.swap(u);
+            best_size = size;
+            best_logical = MLT_LOGICAL_RLE;
+            runs = num_runs;
+        }
+    }
+
+    std::vector<uint8_t> widths;
+    std::string bytes;
+    uint8_t physical = MLT_PHYSICAL_VARINT;
+    if (packed && block_widths(best, widths) < best_size)
+    {
+        physical = MLT_PHYSICAL_PACKED;
+        write_packed(bytes, best, widths);
+    }
+    else
+    {
+        bytes.reserve(best_size);
+        for (uint32_t x : best)
+            write_varint(bytes, x);
+    }
+    out.push_back((char)header);
+    out.push_back((char)((best_logical << 5) | physical));
+    write_varint(out, best.size());
+    write_varint(out, bytes.size());
+    if (best_logical == MLT_LOGICAL_RLE)
+    {
+        write_varint(out, runs);
+        write_varint(out, n);
+    }
+    out.append(bytes);
+}
+
+// Write the streams of a STRING column after its stream count and PRESENT stream,
+// dictionary-encoded if the dictionary and its indices are smaller than the plain strings
+static void write_string_column(std::string &layer, const std::string &data, const std::vector<int32_t> &lengths,
+                                bool nullable, const std::string &present_rle, size_t num_points, const mlt_write_options &opts)
+{
+    size_t n = lengths.size();
+    size_t plain_size = data.size();
+    for (int32_t len : lengths)
+        plain_size += varint_size((uint32_t)len);
+
+    // distinct values in sorted order, numbered after all values are seen
+    std::map<std::string, int32_t> dict;
+    std::vector<std::map<std::string, int32_t>::iterator> value_its(n);
+    for (size_t i = 0, off = 0; i < n; off += lengths[i], ++i)
+        value_its[i] = dict.emplace(std::string(data, off, lengths[i]), 0).first;
+    uint32_t max_index = dict.empty() ? 0 : (uint32_t)dict.size() - 1;
+    size_t dict_size = opts.packed_ints ? (n * bit_width(max_index) + 7) / 8 : n * varint_size(max_index);
+    for (const auto &kv : dict)
+        dict_size += kv.first.size() + varint_size((uint32_t)kv.first.size());
+
+    if (dict.empty() || dict_size >= plain_size)
+    {
+        write_varint(layer, nullable ? 3 : 2);
+        if (nullable)
+            write_stream(layer, 0x00, 0x02, num_points, present_rle);
+        write_int_stream(layer, 0x30, lengths, false, 1, opts.packed_ints);
+        write_stream(layer, 0x10, 0x00, 0, data); // raw bytes, without a value count
+        return;
+    }
+
+    // front coding of the sorted entries, used if allowed and the shared prefixes outweigh their lengths
+    std::vector<int32_t> prefixes, suffix_lengths;
+    std::string suffixes;
+    const std::string *prev = NULL;
+    size_t shared = 0, prefix_cost = 4; // stream header
+    int32_t k = 0;
+    for (auto &kv : dict)
+    {
+        kv.second = k++;
+        int32_t prefix = 0;
+        if (opts.front_coding && prev != NULL)
+        {
+            size_t max_len = std::min(prev->size(), kv.first.size());
+            while ((size_t)prefix < max_len && (*prev)[prefix] == kv.first[prefix])
+                ++prefix;
+        }
+        prefixes.push_back(prefix);
+        suffix_lengths.push_back((int32_t)kv.first.size() - prefix);
+        suffixes.append(kv.first, prefix, std::string::npos);
+        shared += prefix;
+        prefix_cost += varint_size((uint32_t)prefix);
+        prev = &kv.first;
+    }
+    bool front_coded = shared > prefix_cost;
+    std::vector<int32_t> indices(n);
+    for (size_t i = 0; i < n; ++i)
+        indices[i] = value_its[i]->second;
+
+    write_varint(layer, (nullable ? 1 : 0) + (front_coded ? 4 : 3));
+    if (nullable)
+        write_stream(layer, 0x00, 0x02, num_points, present_rle);
+    write_int_stream(layer, 0x22, indices, false, 1, opts.packed_ints); // OFFSET of STRING
+    if (front_coded)
+    {
+        write_int_stream(layer, 0x37, prefixes, false, 1, opts.packed_ints);
+        write_int_stream(layer, 0x36, suffix_lengths, false, 1, opts.packed_ints); // LENGTH of DICTIONARY
+        write_stream(layer, 0x11, 0x00, dict.size(), suffixes);  // DATA of SINGLE dictionary
+    }
+    else
+    {
+        std::vector<int32_t> entry_lengths;
+        std::string entries;
+        for (const auto &kv : dict)
+        {
+            entry_lengths.push_back((int32_t)kv.first.size());
+            entries.append(kv.first);
+        }
+        write_int_stream(layer, 0x36, entry_lengths, false, 1, opts.packed_ints);
+        write_stream(layer, 0x11, 0x00, dict.size(), entries);
+    }
+}
+
+// ORC-style boolean RLE of a PRESENT stream, as literal runs of up to 128 bytes of bits (LSB first)
+static std::string encode_bool_rle(const std::vector<bool> &present)
+{
+    size_t n = present.size();
+    size_t num_bytes = (n + 7) / 8;
+    std::vector<uint8_t> packed(num_bytes, 0);
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (present[i])
+            packed[i / 8] |= (uint8_t)(1 << (i % 8));
+    }
+    std::string result;
+    for (size_t offset = 0; offset < num_bytes;)
+    {
+        size_t chunk = std::min((size_t)128, num_bytes - offset);
+        result.push_back((char)(uint8_t)(256 - chunk));
+        result.append((const char *)packed.data() + offset, chunk);
+        offset += chunk;
+    }
+    return result;
+}
+
+std::string mlt_layer_writer::finish() const
+{
+    std::string layer;
+    // metadata
+    write_varint(layer, name.size());
+    layer.append(name);
+    write_varint(layer, extent);
+    write_varint(layer, 1 + columns.size());
+    write_varint(layer, 4); // GEOMETRY
+    for (const column_t &col : columns)
+    {
+        // INT_32 = 16, FLOAT = 24, STRING = 28, plus 1 if nullable
+        int type_code = col.type == MLT_COL_INT ? 16 : (col.type == MLT_COL_FLOAT ? 24 : 28);
+        write_varint(layer, type_code + (col.nullable ? 1 : 0));
+        write_varint(layer, col.name.size());
+        layer.append(col.name);
+    }
+
+    // GEOMETRY: geometry types (0 = POINT) and vertices
+    write_varint(layer, 2);
+    size_t num_vertices = num_points();
+    write_int_stream(layer, 0x10, std::vector<int32_t>(num_vertices, 0), false, 1, opts.packed_ints);
+    write_int_stream(layer, 0x13, vertices, true, 2, opts.packed_ints);
+
+    for (const column_t &col : columns)
+    {
+        if (col.nullable && col.present.size() != num_vertices)
+            error("Column %s has %zu values for %zu points", col.name.c_str(), col.present.size(), num_vertices);
+        if (!col.nullable && col.num_values != num_vertices)
+            error("Column %s has %zu values for %zu points", col.name.c_str(), col.num_values, num_vertices);
+        std::string present_rle = col.nullable ? encode_bool_rle(col.present) : std::string();
+        if (col.type == MLT_COL_STRING)
+        { // only STRING columns have a stream count
+            write_string_column(layer, col.data, col.lengths, col.nullable, present_rle, num_vertices, opts);
+            continue;
+        }
+        if (col.nullable)
+            write_stream(layer, 0x00, 0x02, num_vertices, present_rle);
+        if (col.type == MLT_COL_INT)
+            write_int_stream(layer, 0x10, col.ints, true, 1, opts.packed_ints);
+        else
+            write_stream(layer, 0x10, 0x00, col.num_values, col.data);
+    }
+
+    std::string out;
+    write_varint(out, 1 + layer.size());
+    out.push_back(1); // feature table tag
+    out.append(layer);
+    return out;
+}
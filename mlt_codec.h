@@ -0,0 +1,176 @@
+#ifndef __MLT_CODEC_H
+#define __MLT_CODEC_H
+
+// Reader and writer of the MLT (MapLibre Tile) point layers written by pmpoint
+// A layer is encoded as varint(1 + length), tag 0x01, then
+//   metadata: name, extent, number of columns, and (typeCode, name) of each attribute column
+//             after the GEOMETRY column (typeCode 4)
+//   data:     GEOMETRY streams (geometry types, and a VERTEX stream of x, y),
+//             then per attribute column an optional PRESENT stream (boolean RLE) followed by
+//             a DATA stream of integers (INT_32), little-endian float32 (FLOAT),
+//             or LENGTH and DATA streams (STRING), covering only the present values
+// Each stream starts with two header bytes, varint(number of values) and varint(byte length),
+// followed by varint(number of runs) and varint(number of decoded values) for RLE streams,
+// whose number of values is that of the run lengths and run values. The second header byte is
+//   (logical technique << 5) | physical technique
+// where the integer streams (geometry types, VERTEX and INT DATA) are written with the logical technique
+// that minimizes their size: NONE, DELTA, COMPONENTWISE_DELTA (x and y separately) or RLE
+// (run lengths, then run values), stored as varints.
+// Signed values (VERTEX, INT DATA, and all deltas) are zigzag-encoded.
+// With mlt_write_options::packed_ints, integer streams may instead be bit-packed in blocks of 128 values
+// (a bit-width byte and the packed bits) under physical technique 1. This is a pmpoint extension that
+// takes the place of FastPFOR, so such tiles can only be read by pmpoint.
+// STRING columns of few distinct values are dictionary-encoded, with an OFFSET stream of the dictionary
+// index of each present value, and the sorted dictionary in LENGTH (subtype DICTIONARY) and DATA
+// (subtype SINGLE) streams.
+// With mlt_write_options::front_coding, the dictionary may instead be front-coded, with an additional
+// LENGTH stream (subtype 7) of the prefix length shared with the previous entry, in which case the LENGTH
+// and DATA streams hold the remaining suffixes. This is a pmpoint extension that only pmpoint can read.
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+
+// attribute column types, ordered by specificity as in build-point's type detection
+enum mlt_col_type_t : uint8_t
+{
+    MLT_COL_STRING = 0,
+    MLT_COL_FLOAT = 1,
+    MLT_COL_INT = 2
+};
+
+// a range of bytes in a tile buffer
+struct mlt_span
+{
+    const uint8_t *data = NULL;
+    size_t size = 0;
+};
+
+// logical and physical techniques of the integer streams
+enum mlt_logical_t : uint8_t
+{
+    MLT_LOGICAL_NONE = 0,
+    MLT_LOGICAL_DELTA = 1,
+    MLT_LOGICAL_COMPONENTWISE_DELTA = 2,
+    MLT_LOGICAL_RLE = 3
+};
+enum mlt_physical_t : uint8_t
+{
+    MLT_PHYSICAL_NONE = 0,
+    MLT_PHYSICAL_PACKED = 1, // bit-packed blocks of 128 values (pmpoint extension, FastPFOR in the MLT specification)
+    MLT_PHYSICAL_VARINT = 2
+};
+
+// a stream in a tile buffer
+struct mlt_stream
+{
+    mlt_span bytes;
+    uint8_t technique = MLT_PHYSICAL_VARINT; // second header byte
+    size_t runs = 0;                         // number of runs of RLE streams
+
+    inline mlt_logical_t logical() const { return (mlt_logical_t)(technique >> 5); }
+    inline mlt_physical_t physical() const { return (mlt_physical_t)(technique & 0x03); }
+};
+
+// the streams of an attribute column, pointing into the tile buffer
+struct mlt_column_view
+{
+    std::string name;
+    mlt_col_type_t type;
+    bool nullable;
+    size_t num_values = 0; // number of present values
+    mlt_span present;      // boolean RLE, empty if the column is not nullable
+    mlt_stream data;       // integers, float32 values, or concatenated string bytes
+    mlt_stream lengths;    // string lengths
+    bool dictionary = false;
+    size_t dict_size = 0;  // number of dictionary entries
+    mlt_stream offsets;    // dictionary index of each present value
+    mlt_stream prefixes;   // shared prefix lengths of a front-coded dictionary, empty otherwise
+};
+
+// Zero-copy reader of the first layer of an MLT tile
+// parse() only locates the streams, so that the columns can be decoded selectively;
+// the tile buffer must outlive the reader and the string views it returns.
+class mlt_layer_reader
+{
+public:
+    std::string name;
+    uint32_t extent = 0;
+    size_t num_features = 0;
+    std::vector<mlt_column_view> columns;
+
+    // returns false if the tile has no layer
+    bool parse(const uint8_t *data, size_t size);
+    inline bool parse(const std::string &buf) { return parse((const uint8_t *)buf.data(), buf.size()); }
+
+    // tile-local coordinates of the features, interleaved as x, y
+    void decode_vertices(std::vector<int32_t> &xy) const;
+    // present bitmap of a column, with bit (i & 7) of byte (i >> 3) set if feature i has a value
+    void decode_present(size_t c, std::vector<uint8_t> &bits) const;
+    static inline bool is_present(const std::vector<uint8_t> &bits, size_t i) { return (bits[i >> 3] >> (i & 7)) & 1; }
+    // present values of a column, in feature order
+    void decode_ints(size_t c, std::vector<int32_t> &values) const;
+    void decode_floats(size_t c, std::vector<float> &values) const;
+    // string values of a column that is not dictionary-encoded, as views into the tile buffer
+    void decode_strings(size_t c, std::vector<std::pair<const char *, uint32_t> > &values) const;
+    // sorted dictionary of a dictionary-encoded column, and the dictionary index of each present value
+    void decode_dictionary(size_t c, std::vector<std::string> &entries, std::vector<int32_t> &indices) const;
+    // VERTEX stream of the geometry, e.g. to inspect its encoding
+    inline const mlt_stream &vertex_stream() const { return vertices; }
+
+private:
+    mlt_stream vertices;
+};
+
+// pmpoint-only encodings of mlt_layer_writer, which standard MLT decoders cannot read
+// All are off by default, so that the tiles follow the MLT specification
+struct mlt_write_options
+{
+    bool packed_ints = false;  // allow bit-packed integer streams
+    bool front_coding = false; // allow front-coded string dictionaries
+};
+
+// Writer of a single-layer MLT point tile
+// Columns are filled independently, each with one value (or null) per point in point order.
+class mlt_layer_writer
+{
+public:
+    mlt_layer_writer(const std::string &_name, uint32_t _extent, const mlt_write_options &_opts = mlt_write_options())
+        : name(_name), extent(_extent), opts(_opts) {}
+
+    // declare an attribute column, returning its index
+    size_t add_column(const std::string &col_name, mlt_col_type_t type, bool nullable);
+
+    void add_point(int32_t x, int32_t y);
+    void add_int(size_t c, int32_t v);
+    void add_float(size_t c, float v);
+    void add_string(size_t c, const char *s, size_t len);
+    // a missing value, stored as 0 or an empty string if the column is not nullable
+    void add_null(size_t c);
+
+    inline size_t num_points() const { return vertices.size() / 2; }
+    // encoded tile bytes
+    std::string finish() const;
+
+private:
+    struct column_t
+    {
+        std::string name;
+        mlt_col_type_t type;
+        bool nullable;
+        std::vector<bool> present;
+        size_t num_values = 0;
+        std::vector<int32_t> ints;    // MLT_COL_INT
+        std::string data;             // MLT_COL_FLOAT and MLT_COL_STRING
+        std::vector<int32_t> lengths; // MLT_COL_STRING
+    };
+    std::string name;
+    uint32_t extent;
+    mlt_write_options opts;
+    std::vector<int32_t> vertices; // interleaved x, y
+    std::vector<column_t> columns;
+};
+
+#endif
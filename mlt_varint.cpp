@@ -0,0 +1,155 @@
+#include "mlt_varint.h"
+
+#ifdef __SSE4_1__
+#include <smmintrin.h>
+#endif
+
+// scalar decoding of one varint, returning false if the stream ends in the middle of it
+static inline bool decode_one_varint(const uint8_t *&p, const uint8_t *end, uint32_t &v)
+{
+    uint64_t val = 0;
+    int shift = 0;
+    while (p < end)
+    {
+        uint8_t b = *p++;
+        if (shift < 64)
+            val |= (uint64_t)(b & 0x7F) << shift;
+        if ((b & 0x80) == 0)
+        {
+            v = (uint32_t)val;
+            return true;
+        }
+        shift += 7;
+    }
+    return false;
+}
+
+#ifdef __SSE4_1__
+// For each pattern of the continuation bits of 12 consecutive bytes, a shuffle that places
+// the leading 1- and 2-byte varints (at most 8) into 16-bit lanes as (low byte, high byte)
+struct varint_shuffle_table
+{
+    struct entry_t
+    {
+        uint8_t shuffle[16];
+        uint8_t count;    // number of varints decoded, 0 if the first varint is longer than 2 bytes
+        uint8_t consumed; // number of input bytes consumed
+    };
+    entry_t entries[1 << 12];
+
+    varint_shuffle_table()
+    {
+        for (uint32_t mask = 0; mask < (1 << 12); ++mask)
+        {
+            entry_t &e = entries[mask];
+            for (int i = 0; i < 16; ++i)
+                e.shuffle[i] = 0x80; // zero
+            uint8_t pos = 0, count = 0;
+            while (pos < 12 && count < 8)
+            {
+                if ((mask & (1 << pos)) == 0)
+                { // 1-byte varint
+                    e.shuffle[2 * count] = pos;
+                    pos += 1;
+                }
+                else if (pos + 1 < 12 && (mask & (1 << (pos + 1))) == 0)
+                { // 2-byte varint
+                    e.shuffle[2 * count] = pos;
+                    e.shuffle[2 * count + 1] = pos + 1;
+                    pos += 2;
+                }
+                else
+                    break; // longer or incomplete varint
+                ++count;
+            }
+            e.count = count;
+            e.consumed = pos;
+        }
+    }
+};
+
+static const varint_shuffle_table &get_varint_shuffle_table()
+{
+    static const varint_shuffle_table table;
+    return table;
+}
+
+static inline __m128i zigzag_decode_epi32(__m128i v)
+{
+    __m128i sign = _mm_sub_epi32(_mm_setzero_si128(), _mm_and_si128(v, _mm_set1_epi32(1)));
+    return _mm_xor_si128(_mm_srli_epi32(v, 1), sign);
+}
+#endif
+
+template <bool ZIGZAG>
+static size_t decode_varints(const uint8_t *data, size_t len, size_t n, uint32_t *out)
+{
+    const uint8_t *p = data;
+    const uint8_t *end = data + len;
+    size_t i = 0;
+#ifdef __SSE4_1__
+    const varint_shuffle_table::entry_t *entries = get_varint_shuffle_table().entries;
+    const __m128i low7 = _mm_set1_epi16(0x007F);
+    // each iteration reads 16 bytes and writes up to 16 values
+    while (p + 16 <= end && i + 16 <= n)
+    {
+        __m128i bytes = _mm_loadu_si128((const __m128i *)p);
+        uint32_t cont = (uint32_t)_mm_movemask_epi8(bytes);
+        if (cont == 0)
+        { // 16 1-byte varints
+            __m128i v[4];
+            v[0] = _mm_cvtepu8_epi32(bytes);
+            v[1] = _mm_cvtepu8_epi32(_mm_srli_si128(bytes, 4));
+            v[2] = _mm_cvtepu8_epi32(_mm_srli_si128(bytes, 8));
+            v[3] = _mm_cvtepu8_epi32(_mm_srli_si128(bytes, 12));
+            for (int k = 0; k < 4; ++k)
+                _mm_storeu_si128((__m128i *)(out + i + 4 * k), ZIGZAG ? zigzag_decode_epi32(v[k]) : v[k]);
+            p += 16;
+            i += 16;
+            continue;
+        }
+        const varint_shuffle_table::entry_t &e = entries[cont & 0xFFF];
+        if (e.count == 0)
+        { // a varint of 3 or more bytes
+            if (!decode_one_varint(p, end, out[i]))
+                return i;
+            if (ZIGZAG)
+                out[i] = (out[i] >> 1) ^ (0 - (out[i] & 1));
+            ++i;
+            continue;
+        }
+        __m128i lanes = _mm_shuffle_epi8(bytes, _mm_loadu_si128((const __m128i *)e.shuffle));
+        // (low & 0x7F) | (high << 7) in each 16-bit lane
+        __m128i v16 = _mm_or_si128(_mm_and_si128(lanes, low7), _mm_slli_epi16(_mm_srli_epi16(lanes, 8), 7));
+        __m128i lo = _mm_cvtepu16_epi32(v16);
+        __m128i hi = _mm_cvtepu16_epi32(_mm_srli_si128(v16, 8));
+        if (ZIGZAG)
+        {
+            lo = zigzag_decode_epi32(lo);
+            hi = zigzag_decode_epi32(hi);
+        }
+        _mm_storeu_si128((__m128i *)(out + i), lo);
+        _mm_storeu_si128((__m128i *)(out + i + 4), hi);
+        p += e.consumed;
+        i += e.count;
+    }
+#endif
+    for (; i < n; ++i)
+    {
+        if (!decode_one_varint(p, end, out[i]))
+            return i;
+        if (ZIGZAG)
+            out[i] = (out[i] >> 1) ^ (0 - (out[i] & 1));
+    }
+    return n;
+}
+
+size_t mlt_decode_varint32(const uint8_t *data, size_t len, size_t n, uint32_t *out)
+{
+    return decode_varints<false>(data, len, n, out);
+}
+
+size_t mlt_decode_zigzag32(const uint8_t *data, size_t len, size_t n, int32_t *out)
+{
+    return decode_varints<true>(data, len, n, (uint32_t *)out);
+}
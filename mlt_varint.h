@@ -0,0 +1,18 @@
+#ifndef __MLT_VARINT_H
+#define __MLT_VARINT_H
+
+// Bulk decoding of the LEB128 varint streams of MLT tiles (VERTEX, INT DATA and LENGTH streams)
+// With SSE4.1, runs of 1- and 2-byte varints are decoded 8 or 16 values at a time by a shuffle table
+// indexed by the continuation bits (as in Masked VByte); longer varints fall back to the scalar loop.
+// Values are truncated to 32 bits, as every MLT integer stream written by pmpoint holds 32-bit values.
+
+#include <cstdint>
+#include <cstddef>
+
+// decode n varints from data[0..len) into out, returning the number of values decoded,
+// which is less than n only if the stream is truncated
+size_t mlt_decode_varint32(const uint8_t *data, size_t len, size_t n, uint32_t *out);
+// same as mlt_decode_varint32, with each value zigzag-decoded
+size_t mlt_decode_zigzag32(const uint8_t *data, size_t len, size_t n, int32_t *out);
+
+#endif
@@ -101,10 +101,11 @@ bool mvt_polygons_filt::decode_polygons_df(const std::string &_buffer, uint8_t z
     }
 
     uint64_t npass = 0, nskip = 0;
-    double scale_factor = pmt_utils::epsg3857_scale_factor(zoom);
-    double offset_x, offset_y;
-    pmt_utils::tiletoepsg3857(tile_x, tile_y, zoom, &offset_x, &offset_y);
-    notice("tile_x = %ld, tile_y = %ld, zoom = %d, offset_x = %.5f, offset_y = %.5f", tile_x, tile_y, zoom, offset_x, offset_y);
+    pmt_utils::pmt_tile_transform_t transform(zoom, tile_x, tile_y);
+    notice("tile_x = %ld, tile_y = %ld, zoom = %d, offset_x = %.5f, offset_y = %.5f", tile_x, tile_y, zoom, transform.offset_x, transform.offset_y);
+    std::vector<int32_t> lxs, lys;
+    std::vector<Polygon *> candidates;
+    std::vector<double> gxs, gys;
     for (auto const &name : p_tile->layerNames())
     {
         const mapbox::vector_tile::layer layer = p_tile->getLayer(name);
@@ -142,35 +143,17 @@ bool mvt_polygons_filt::decode_polygons_df(const std::string &_buffer, uint8_t z
 
                 // obtain the polygons
                 pmt_utils::pmt_polygon_t poly(zoom);
-                // pmt_utils::pmt_pt_t ul, lr;
-                for (auto const &pt : geom[0]) {
-                    //  pmt_utils::pmt_pt_t pt(zoom, offset_x + scale_factor * geom[0][0].x, offset_y - scale_factor * geom[0][0].y);
-                    poly.add_global_coord(offset_x + scale_factor * pt.x, offset_y - scale_factor * pt.y);
-                    //poly.add_point(pmt_utils::pmt_pt_t(zoom, offset_x + scale_factor * pt.x, offset_y - scale_factor * pt.y));
-
-                    //notice("Adding point: %.5f, %.5f", poly.points.back().global_x, poly.points.back().global_y);
-                    //notice("Adding point: %d, %d, %.5f, %.5f, %.5f, (%.5f, %.5f)", pt.x, pt.y, offset_x, offset_y, scale_factor, poly.points.back().global_x, poly.points.back().global_y);
-
-                    // // update the bounding box 
-                    // if ( poly.points.size() == 1 ) {
-                    //     ul = poly.points[0];
-                    //     lr = poly.points[0];
-                    // }
-                    // else {
-                    //     if ( poly.points.back().global_x < ul.global_x ) {
-                    //         ul.global_x = poly.points.back().global_x;
-                    //     }
-                    //     if ( poly.points.back().global_y < ul.global_y ) {
-                    //         ul.global_y = poly.points.back().global_y;
-                    //     }
-                    //     if ( poly.points.back().global_x > lr.global_x ) {
-                    //         lr.global_x = poly.points.back().global_x;
-                    //     }
-                    //     if ( poly.points.back().global_y > lr.global_y ) {
-                    //         lr.global_y = poly.points.back().global_y;
-                    //     }
-                    // }
+                size_t nv = geom[0].size();
+                lxs.resize(nv);
+                lys.resize(nv);
+                gxs.resize(nv);
+                gys.resize(nv);
+                for (size_t v = 0; v < nv; ++v) {
+                    lxs[v] = geom[0][v].x;
+                    lys[v] = geom[0][v].y;
                 }
+                transform.to_global(lxs.data(), lys.data(), nv, gxs.data(), gys.data());
+                poly.add_global_coords(gxs.data(), gys.data(), nv);
 
                 // check the filtering criteria
                 if (p_min_pt != NULL)
@@ -192,11 +175,14 @@ bool mvt_polygons_filt::decode_polygons_df(const std::string &_buffer, uint8_t z
 
                 // Polygon filtering to be implemented later. 
                 // check overlaps based on the bounding box first, then check the actual polygon
-                if (polygons.size() > 0)
+                if (p_polygons != NULL)
                 {
                     //error("Polygon filtering is not implemented yet.");
+                    // only the polygons whose bounding boxes intersect that of the feature can match
+                    candidates.clear();
+                    p_polygons->query_rectangle(Rectangle(poly.bbox.ul.global_x, poly.bbox.ul.global_y, poly.bbox.lr.global_x, poly.bbox.lr.global_y), candidates);
                     bool found = false;
-                    for (auto &p_polygon : polygons)
+                    for (auto &p_polygon : candidates)
                     {
                         bool ul_in = p_polygon->contains_point(poly.bbox.ul.global_x, poly.bbox.ul.global_y);
                         bool lr_in = p_polygon->contains_point(poly.bbox.lr.global_x, poly.bbox.lr.global_y);
@@ -106,7 +106,7 @@ public:
 class mvt_polygons_filt
 {
 public:
-    std::vector<Polygon*> polygons;
+    const PolygonIndex *p_polygons = NULL; // polygons must overlap any of these polygons, if not NULL
     //std::vector<Rectangle> bboxes;
     //std::vector<pmt_utils::pmt_polygon_t> polygons;
     pmt_utils::pmt_pt_t *p_min_pt = NULL;
@@ -124,8 +124,8 @@ public:
     //inline void set_df(pt_dataframe *p) { p_df = p; }
     inline void set_min_filt(pmt_utils::pmt_pt_t *_min_pt) { p_min_pt = _min_pt; }
     inline void set_max_filt(pmt_utils::pmt_pt_t *_max_pt) { p_max_pt = _max_pt; }
-    inline void set_polygon_filt(std::vector<Polygon*> &_polygons) { 
-        polygons = _polygons; 
+    inline void set_polygon_filt(const PolygonIndex *_polygons) { 
+        p_polygons = _polygons; 
         // bboxes.clear();
         // for(int32_t i = 0; i < polygons.size(); ++i)
         // {
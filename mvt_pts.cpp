@@ -1,5 +1,6 @@
 #include <cstdio>
 #include <string>
+#include <cstring>
 #include <zlib.h>
 
 #include "mvt_pts.h"
@@ -56,322 +57,380 @@
 //     }
 // };
 
-int32_t mvt_pts::decode_points_xycnt_feature(const std::string &_buffer, const std::string& colname_cnt, const std::string& colname_feature, std::vector<int32_t>& xs, std::vector<int32_t>& ys, std::vector<int32_t>& cnts, std::vector<std::string>& features)
+void mvt_point_decoder::value_to_string(protozero::data_view value_view, std::string &out)
 {
-    // p_tile = new mapbox::vector_tile::buffer(_buffer);
-    // if (p_tile == NULL)
-    // {
-    //     return false;
-    // }
-
-    mapbox::vector_tile::buffer* local_p_tile = new mapbox::vector_tile::buffer(_buffer);
-    if (local_p_tile == NULL)
+    // the last field wins, and an empty message is a null value, as in mapbox::vector_tile::parseValue
+    out.assign("null");
+    char buf[64];
+    protozero::pbf_reader value_reader(value_view);
+    while (value_reader.next())
     {
-        return false;
+        switch (value_reader.tag())
+        {
+        case 1: // string
+        {
+            protozero::data_view v = value_reader.get_view();
+            out.assign(v.data(), v.size());
+            break;
+        }
+        case 2: // float
+            out.assign(buf, snprintf(buf, sizeof(buf), "%f", (double)value_reader.get_float()));
+            break;
+        case 3: // double
+            out.assign(buf, snprintf(buf, sizeof(buf), "%f", value_reader.get_double()));
+            break;
+        case 4: // int
+            out.assign(buf, snprintf(buf, sizeof(buf), "%lld", (long long)value_reader.get_int64()));
+            break;
+        case 5: // uint
+            out.assign(buf, snprintf(buf, sizeof(buf), "%llu", (unsigned long long)value_reader.get_uint64()));
+            break;
+        case 6: // sint
+            out.assign(buf, snprintf(buf, sizeof(buf), "%lld", (long long)value_reader.get_sint64()));
+            break;
+        case 7: // bool
+            out.assign(value_reader.get_bool() ? "true" : "false");
+            break;
+        default:
+            value_reader.skip();
+        }
     }
+}
 
-    // assuming that all objects are points with rectangular structure, try to decode the tile
-    std::vector<std::string> colnames;
-    colnames.push_back("X");
-    colnames.push_back("Y");
-    std::vector<std::vector<std::string>> columns(2);
-    int32_t n_points = 0;
-
-    for (auto const &name : local_p_tile->layerNames())
+pt_col_type_t mvt_point_decoder::value_to_typed(protozero::data_view value_view, int64_t &ival, double &dval)
+{
+    // the last field wins, as in value_to_string
+    pt_col_type_t type = PT_COL_STRING;
+    protozero::pbf_reader value_reader(value_view);
+    while (value_reader.next())
     {
-        const mapbox::vector_tile::layer layer = local_p_tile->getLayer(name);
-        std::size_t feature_count = layer.featureCount();
-        if (feature_count > 0)
+        switch (value_reader.tag())
         {
-            for (std::size_t i = 0; i < feature_count; ++i)
-            {
-                auto const feature = mapbox::vector_tile::feature(layer.getFeature(i), layer);
-
-                // make sure that the types are points
-                if (int(feature.getType()) != 1)
-                {
-                    error("Only points are supported in decode_points()");
-                }
-
-                // obtain vertex
-                mapbox::vector_tile::points_arrays_type geom = feature.getGeometries<mapbox::vector_tile::points_arrays_type>(1.0);
-                if (geom.size() != 1)
-                {
-                    error("Only single point per feature is supported in decode_points()");
-                }
-                xs.push_back(geom[0][0].x);
-                ys.push_back(geom[0][0].y);
-
-                // obtain properties;
-                auto props = feature.getProperties();
-                int32_t j = 2;
-                for (auto const &prop : props)
-                {
-                    if ( colname_cnt.compare(prop.first) == 0 ) {
-                        print_value printvisitor;
-                        std::string value = mapbox::util::apply_visitor(printvisitor, prop.second);
-                        try {
-                            cnts.push_back(std::stoi(value));
-                        } catch (std::invalid_argument& e) {
-                            notice("Invalid count value %s observed at %d/%d, considering as zero count", value.c_str(), geom[0][0].x, geom[0][0].y);
-                            cnts.push_back(0);
-                        }
-                    }
-                    else if ( colname_feature.compare(prop.first) == 0 ) {
-                        print_value printvisitor;
-                        std::string value = mapbox::util::apply_visitor(printvisitor, prop.second);
-                        features.push_back(value);
-                    }
-                }
-                if ( xs.size() != ys.size() || xs.size() != cnts.size() || xs.size() != features.size() ) {
-                    error("Inconsistent sizes of xs, ys, cnts, and features. xs=%zu, ys=%zu, cnts=%zu, features=%zu", xs.size(), ys.size(), cnts.size(), features.size());
-                }
-            }
+        case 2: // float
+            dval = value_reader.get_float();
+            type = PT_COL_FLOAT;
+            break;
+        case 3: // double
+            dval = value_reader.get_double();
+            type = PT_COL_DOUBLE;
+            break;
+        case 4: // int
+            ival = value_reader.get_int64();
+            type = PT_COL_INT64;
+            break;
+        case 5: // uint
+        {
+            uint64_t u = value_reader.get_uint64();
+            ival = (int64_t)u;
+            type = u > (uint64_t)INT64_MAX ? PT_COL_STRING : PT_COL_INT64;
+            break;
+        }
+        case 6: // sint
+            ival = value_reader.get_sint64();
+            type = PT_COL_INT64;
+            break;
+        default: // string, bool, or unknown
+            value_reader.skip();
+            type = PT_COL_STRING;
         }
-        n_points += feature_count;
     }
-    //delete p_tile;
-    //p_tile = NULL;
-    delete local_p_tile;
+    return type;
+}
 
-   return n_points;
+static inline bool view_equals(protozero::data_view v, const std::string &str)
+{
+    return v.size() == str.size() && memcmp(v.data(), str.data(), str.size()) == 0;
 }
 
-bool mvt_pts_filt::decode_points_df(const std::string &_buffer, uint8_t zoom, int64_t tile_x, int64_t tile_y, pt_dataframe& df)
+// true if the key of the tag pair at t already appeared earlier in the feature (the first occurrence wins)
+static inline bool is_duplicate_key(const uint32_t *tags, size_t t)
 {
-    mapbox::vector_tile::buffer* p_tile = new mapbox::vector_tile::buffer(_buffer);
-    if (p_tile == NULL)
+    for (size_t u = 0; u < t; u += 2)
     {
-        return false;
+        if (tags[u] == tags[t])
+            return true;
     }
+    return false;
+}
 
-    uint64_t npass = 0, nskip = 0;
-    double scale_factor = pmt_utils::epsg3857_scale_factor(zoom);
-    double offset_x, offset_y;
-    pmt_utils::tiletoepsg3857(tile_x, tile_y, zoom, &offset_x, &offset_y);
-    for (auto const &name : p_tile->layerNames())
+void mvt_predicate_eval::start_layer(const pt_predicate &pred, const mvt_point_decoder::layer_t &layer)
+{
+    clause_keys.assign(pred.clauses.size(), -1);
+    value_pass.resize(pred.clauses.size());
+    for (size_t c = 0; c < pred.clauses.size(); ++c)
     {
-        const mapbox::vector_tile::layer layer = p_tile->getLayer(name);
-        std::size_t feature_count = layer.featureCount();
-        if (feature_count > 0)
+        for (size_t k = 0; k < layer.keys.size(); ++k)
         {
-            for (std::size_t i = 0; i < feature_count; ++i)
+            if (view_equals(layer.keys[k], pred.clauses[c].column))
             {
-                auto const feature = mapbox::vector_tile::feature(layer.getFeature(i), layer);
-
-                // make sure that the types are points
-                if (int(feature.getType()) != 1)
-                {
-                    error("Only points are supported in decode_points()");
-                }
-
-                // obtain vertex
-                mapbox::vector_tile::points_arrays_type geom = feature.getGeometries<mapbox::vector_tile::points_arrays_type>(1.0);
-                if (geom.size() != 1)
-                {
-                    error("Only single point per feature is supported in decode_points()");
-                }
-
-                pmt_utils::pmt_pt_t pt(zoom, offset_x + scale_factor * geom[0][0].x, offset_y - scale_factor * geom[0][0].y);
-                //pmt_utils::pmt_pt_t pt(zoom, tile_x, tile_y, geom[0][0].x/scale_factor, geom[0][0].y/scale_factor);
-                //pmt_utils::pmt_pt_t pt(zoom, tile_x, tile_y, 0, 0);
-                //notice("Processing point (%.3f %.3f) at z=%u, (%llu, %llu), (%.3f, %.3f)", pt.global_x, pt.global_y, pt.zoom, pt.tile_x, pt.tile_y, pt.local_x, pt.local_y);
+                clause_keys[c] = (int32_t)k;
+                break;
+            }
+        }
+        value_pass[c].assign(layer.value_views.size(), 2);
+    }
+}
 
-                //notice("Adding point: %d, %d, %.5f, %.5f, %.5f, (%.5f, %.5f)", geom[0][0].x, geom[0][0].y, offset_x, offset_y, scale_factor, pt.global_x, pt.global_y);
+bool mvt_predicate_eval::eval(const pt_predicate &pred, const mvt_point_decoder::layer_t &layer, const uint32_t *tags, size_t n_tags)
+{
+    for (size_t c = 0; c < clause_keys.size(); ++c)
+    {
+        if (clause_keys[c] < 0)
+            return false;
+        size_t t = 0;
+        while (t < n_tags && tags[t] != (uint32_t)clause_keys[c])
+            t += 2;
+        if (t >= n_tags) // missing value
+            return false;
+        uint8_t &pass = value_pass[c][tags[t + 1]];
+        if (pass == 2)
+        {
+            protozero::data_view value_view = layer.value_views[tags[t + 1]];
+            int64_t ival = 0;
+            double dval = 0;
+            bool res;
+            switch (mvt_point_decoder::value_to_typed(value_view, ival, dval))
+            {
+            case PT_COL_INT64: res = pred.eval_number(c, (double)ival); break;
+            case PT_COL_FLOAT: res = pred.eval_float(c, (float)dval); break;
+            case PT_COL_DOUBLE: res = pred.eval_number(c, dval); break;
+            default:
+                mvt_point_decoder::value_to_string(value_view, value);
+                res = pred.eval_text(c, value.data(), value.size());
+            }
+            pass = res ? 1 : 0;
+        }
+        if (pass == 0)
+            return false;
+    }
+    return true;
+}
 
-                // check the filtering criteria
-                if (p_min_pt != NULL)
+int32_t mvt_pts::decode_points_xycnt_feature(const std::string &_buffer, const std::string& colname_cnt, const std::string& colname_feature, std::vector<int32_t>& xs, std::vector<int32_t>& ys, std::vector<int32_t>& cnts, std::vector<std::string>& features, const pt_predicate *p_predicate)
+{
+    // role of each key in the current layer: 1 for the count column, 2 for the feature column
+    std::vector<uint8_t> key_roles;
+    decoder.decode(_buffer.data(), _buffer.size(),
+        [&](const mvt_point_decoder::layer_t &layer)
+        {
+            if (p_predicate != NULL)
+                pred_eval.start_layer(*p_predicate, layer);
+            key_roles.assign(layer.keys.size(), 0);
+            for (size_t k = 0; k < layer.keys.size(); ++k)
+            {
+                if (view_equals(layer.keys[k], colname_cnt))
+                    key_roles[k] = 1;
+                else if (view_equals(layer.keys[k], colname_feature))
+                    key_roles[k] = 2;
+            }
+        },
+        [&](const mvt_point_decoder::layer_t &layer, int32_t x, int32_t y, const uint32_t *tags, size_t n_tags)
+        {
+            if (p_predicate != NULL && !pred_eval.eval(*p_predicate, layer, tags, n_tags))
+                return;
+            xs.push_back(x);
+            ys.push_back(y);
+            for (size_t t = 0; t < n_tags; t += 2)
+            {
+                uint8_t role = key_roles[tags[t]];
+                if (role == 0 || is_duplicate_key(tags, t))
+                    continue;
+                const std::string &value = layer.values[tags[t + 1]];
+                if (role == 1)
                 {
-                    //notice("(%.3f %.3f) > (%.3f %.3f)", pt.global_x, pt.global_y, p_min_pt->global_x, p_min_pt->global_y);
-                    if (pt.global_x < p_min_pt->global_x || pt.global_y < p_min_pt->global_y)
-                    {
-                        ++nskip;
-                        continue;
+                    try {
+                        cnts.push_back(std::stoi(value));
+                    } catch (std::invalid_argument& e) {
+                        notice("Invalid count value %s observed at %d/%d, considering as zero count", value.c_str(), x, y);
+                        cnts.push_back(0);
                     }
                 }
-                if (p_max_pt != NULL)
+                else
                 {
-                    //notice("(%.3f %.3f) < (%.3f %.3f)", pt.global_x, pt.global_y, p_max_pt->global_x, p_max_pt->global_y);
-                    if (pt.global_x > p_max_pt->global_x || pt.global_y > p_max_pt->global_y)
-                    {
-                        ++nskip;
-                        continue;
-                    }
+                    features.push_back(value);
                 }
-                if (polygons.size() > 0)
-                {
-                    bool found = false;
-                    for (auto &p_polygon : polygons)
-                    {
-                        if (p_polygon->contains_point(pt.global_x, pt.global_y))
-                        {
-                            found = true;
-                            break;
-                        }
-                    }
-                    if (!found)
-                    {
-                        ++nskip;
-                        continue;
-                    }
-                }
-
-                ++npass;
+            }
+            if ( xs.size() != ys.size() || xs.size() != cnts.size() || xs.size() != features.size() ) {
+                error("Inconsistent sizes of xs, ys, cnts, and features. xs=%zu, ys=%zu, cnts=%zu, features=%zu", xs.size(), ys.size(), cnts.size(), features.size());
+            }
+        });
 
-                df.points.push_back(pt);
+   return (int32_t)xs.size();
+}
 
-                // obtain properties;
-                auto props = feature.getProperties();
-                int32_t j = 0;
-                for (auto const &prop : props)
+// prepare the per-layer state used by add_point_features
+// with a column projection, each key is mapped to its output column in key_cols (-1 if not selected) and
+// the selected columns are created up front, so the output schema does not depend on the tile
+static inline void start_layer(const mvt_point_decoder::layer_t &layer, const std::vector<std::string> *p_columns, pt_dataframe &df, std::vector<std::string> &key_names, std::vector<int32_t> *p_key_cols, std::vector<std::vector<int32_t>> &dict_map, mvt_layer_values &values)
+{
+    key_names.resize(layer.keys.size());
+    for (size_t k = 0; k < layer.keys.size(); ++k)
+        key_names[k].assign(layer.keys[k].data(), layer.keys[k].size());
+    values.start_layer(layer);
+    if (p_columns != NULL)
+    {
+        std::vector<int32_t> &key_cols = *p_key_cols;
+        key_cols.assign(layer.keys.size(), -1);
+        for (size_t k = 0; k < layer.keys.size(); ++k)
+        {
+            for (size_t j = 0; j < p_columns->size(); ++j)
+            {
+                if (view_equals(layer.keys[k], (*p_columns)[j]))
                 {
-                    print_value printvisitor;
-                    std::string value = mapbox::util::apply_visitor(printvisitor, prop.second);
-                    df.add_feature(j, prop.first, value);
-                    ++j;
+                    key_cols[k] = (int32_t)j;
+                    break;
                 }
             }
-            //notice("npass = %llu, nskip = %llu", npass, nskip);
         }
+        for (size_t j = 0; j < p_columns->size(); ++j)
+            df.declare_column((int32_t)j, (*p_columns)[j]);
+        if (dict_map.size() < p_columns->size())
+            dict_map.resize(p_columns->size());
     }
-
-    delete p_tile;
-    //p_tile = NULL;
-    return true;
+    for (size_t j = 0; j < dict_map.size(); ++j)
+        dict_map[j].assign(layer.value_views.size(), -1);
 }
 
-bool mvt_pts::decode_points_df(const std::string &_buffer, uint8_t zoom, int64_t tile_x, int64_t tile_y, pt_dataframe& df)
+// append the properties of a point to df, in the order of its tags, or to the columns given by key_cols if not NULL
+// a column takes the type of the first value seen, and falls back to strings if its values have mixed types
+// MVT values are already a per-layer dictionary, so string columns store codes and stringify a value only once per tile
+static inline void add_point_features(pt_dataframe &df, const std::vector<std::string> &key_names, const std::vector<int32_t> *p_key_cols, std::vector<std::vector<int32_t>> &dict_map, mvt_layer_values &values, const mvt_point_decoder::layer_t &layer, const uint32_t *tags, size_t n_tags)
 {
-    mapbox::vector_tile::buffer* p_tile = new mapbox::vector_tile::buffer(_buffer);
-    if (p_tile == NULL)
+    char buf[64];
+    int32_t j = 0;
+    for (size_t t = 0; t < n_tags; t += 2)
     {
-        return false;
-    }
-
-    // assuming that all objects are points with rectangular structure, try to decode the tile
-    // std::vector<std::string> colnames;
-    // colnames.push_back("X");
-    // colnames.push_back("Y");
-    // std::vector<std::vector<std::string>> columns(2);
-    int32_t n_points = 0;
-    // char bufx[255], bufy[255];
-
-    // scale factor for EPSG:3857 to original coordinates
-    // double scale_factor = 2 * pmt_utils::EPSG_3857_bound / ( 1 << (z + 12) );
-    double scale_factor = pmt_utils::epsg3857_scale_factor(zoom);
-    double offset_x, offset_y;
-    pmt_utils::tiletoepsg3857(tile_x, tile_y, zoom, &offset_x, &offset_y);
-
-    for (auto const &name : p_tile->layerNames())
-    {
-        const mapbox::vector_tile::layer layer = p_tile->getLayer(name);
-        std::size_t feature_count = layer.featureCount();
-        if (feature_count > 0)
+        if (p_key_cols != NULL)
         {
-            for (std::size_t i = 0; i < feature_count; ++i)
+            j = (*p_key_cols)[tags[t]];
+            if (j < 0) // not selected
+                continue;
+        }
+        if (is_duplicate_key(tags, t))
+            continue;
+        uint32_t v = tags[t + 1];
+        pt_col_type_t vtype = values.type_of(layer, v);
+        pt_column &col = df.value_column_at(j, key_names[tags[t]], vtype);
+        switch (col.type)
+        {
+        case PT_COL_INT64:
+            col.append_int64(values.int_at(v));
+            break;
+        case PT_COL_FLOAT:
+            col.append_float((float)values.num_at(v));
+            break;
+        case PT_COL_DOUBLE:
+            col.append_double(values.num_at(v));
+            break;
+        default:
+        {
+            if (j >= (int32_t)dict_map.size())
+                dict_map.resize(j + 1, std::vector<int32_t>(layer.value_views.size(), -1));
+            int32_t &code = dict_map[j][v];
+            if (code < 0)
             {
-                auto const feature = mapbox::vector_tile::feature(layer.getFeature(i), layer);
-
-                // make sure that the types are points
-                if (int(feature.getType()) != 1)
-                {
-                    error("Only points are supported in decode_points()");
-                }
-
-                // obtain vertex
-                mapbox::vector_tile::points_arrays_type geom = feature.getGeometries<mapbox::vector_tile::points_arrays_type>(1.0);
-                if (geom.size() != 1)
-                {
-                    error("Only single point per feature is supported in decode_points()");
-                }
-                pmt_utils::pmt_pt_t pt(zoom, offset_x + scale_factor * geom[0][0].x, offset_y - scale_factor * geom[0][0].y);
-
-                df.points.push_back(pt);
-
-                // obtain properties;
-                auto props = feature.getProperties();
-                int32_t j = 0;
-                for (auto const &prop : props)
+                // numbers in a mixed-type column are formatted as in a numeric column
+                const char *s;
+                std::string value;
+                switch (vtype)
                 {
-                    print_value printvisitor;
-                    std::string value = mapbox::util::apply_visitor(printvisitor, prop.second);
-                    df.add_feature(j, prop.first, value);
-                    ++j;
+                case PT_COL_INT64: s = pt_column::format_int64(values.int_at(v), buf, sizeof(buf)); break;
+                case PT_COL_FLOAT: s = pt_column::format_float((float)values.num_at(v), buf, sizeof(buf)); break;
+                case PT_COL_DOUBLE: s = pt_column::format_double(values.num_at(v), buf, sizeof(buf)); break;
+                default:
+                    mvt_point_decoder::value_to_string(layer.value_views[v], value);
+                    s = value.c_str();
                 }
-
-                // snprintf(bufx, sizeof(bufx), "%.3f", x_offset + scale_factor * geom[0][0].x);
-                // snprintf(bufy, sizeof(bufy), "%.3f", y_offset - scale_factor * geom[0][0].y);
-                // columns[0].push_back(bufx);
-                // columns[1].push_back(bufy);
-
-                // obtain properties;
-                // auto props = feature.getProperties();
-                // int32_t j = 2;
-                // for (auto const &prop : props)
-                // {
-                //     print_value printvisitor;
-                //     std::string value = mapbox::util::apply_visitor(printvisitor, prop.second);
-                //     if (i == 0)
-                //     { // for first columns fill in column names
-                //         colnames.push_back(prop.first);
-                //         columns.resize(colnames.size());
-                //     }
-                //     else
-                //     {
-                //         if (colnames[j].compare(prop.first) != 0)
-                //         {
-                //             error("Mismatched column names - %s vs %s at index = %d, row = %d in decode_points()", colnames[i].c_str(), prop.first.c_str(), i, j);
-                //         }
-                //     }
-                //     columns[j].push_back(value);
-                //     ++j;
-                // }
+                code = (int32_t)col.add_dict(s, strlen(s));
             }
+            col.append_code((uint32_t)code);
         }
-        n_points += feature_count;
+        }
+        ++j;
     }
+}
 
-    // // print the decoded points
-    // printf("%s", colnames[0].c_str());
-    // for (int32_t i = 1; i < colnames.size(); ++i)
-    // {
-    //     printf("\t%s", colnames[i].c_str());
-    // }
-    // printf("\n");
-
-    // // print the values
-    // for (int32_t i = 0; i < n_points; ++i)
-    // {
-    //     printf("%s", columns[0][i].c_str());
-    //     for (int32_t j = 1; j < colnames.size(); ++j)
-    //     {
-    //         printf("\t%s", columns[j][i].c_str());
-    //     }
-    //     printf("\n");
-    // }
+bool mvt_pts_filt::decode_points_df(const std::string &_buffer, uint8_t zoom, int64_t tile_x, int64_t tile_y, pt_dataframe& df)
+{
+    uint64_t npass = 0, nskip = 0;
+    pmt_utils::pmt_tile_transform_t transform(zoom, tile_x, tile_y);
+    // the bounding box is compared in tile-local coordinates, so that rejected points are not transformed
+    bool has_bbox = p_min_pt != NULL || p_max_pt != NULL;
+    pmt_utils::pmt_local_rect_t local_bbox = transform.to_local(p_min_pt, p_max_pt);
+    const std::vector<std::string> *p_columns = columns.empty() ? NULL : &columns;
+    decoder.decode(_buffer.data(), _buffer.size(),
+        [&](const mvt_point_decoder::layer_t &layer)
+        {
+            start_layer(layer, p_columns, df, key_names, &key_cols, dict_map, values);
+            if (p_predicate != NULL)
+                pred_eval.start_layer(*p_predicate, layer);
+        },
+        [&](const mvt_point_decoder::layer_t &layer, int32_t x, int32_t y, const uint32_t *tags, size_t n_tags)
+        {
+            // the attribute predicate only compares value indices, so check it before the coordinates
+            if (p_predicate != NULL && !pred_eval.eval(*p_predicate, layer, tags, n_tags))
+            {
+                ++nskip;
+                return;
+            }
+            // check the filtering criteria
+            if (has_bbox && !local_bbox.contains(x, y))
+            {
+                ++nskip;
+                return;
+            }
+            double gx = transform.global_x(x);
+            double gy = transform.global_y(y);
+            if (p_polygons != NULL && !p_polygons->contains_point(gx, gy))
+            {
+                ++nskip;
+                return;
+            }
 
-    delete p_tile;
-    //p_tile = NULL;
+            ++npass;
+            add_point_features(df, key_names, p_columns ? &key_cols : NULL, dict_map, values, layer, tags, n_tags);
+            df.add_point(gx, gy);
+        });
+    //notice("npass = %llu, nskip = %llu", npass, nskip);
+    return true;
+}
 
-   return true;
+bool mvt_pts::decode_points_df(const std::string &_buffer, uint8_t zoom, int64_t tile_x, int64_t tile_y, pt_dataframe& df)
+{
+    // the rows are added with their tile-local coordinates, which are transformed at once after decoding
+    size_t first = df.num_points();
+    local_xs.clear();
+    local_ys.clear();
+    decoder.decode(_buffer.data(), _buffer.size(),
+        [&](const mvt_point_decoder::layer_t &layer)
+        {
+            start_layer(layer, NULL, df, key_names, NULL, dict_map, values);
+        },
+        [&](const mvt_point_decoder::layer_t &layer, int32_t x, int32_t y, const uint32_t *tags, size_t n_tags)
+        {
+            add_point_features(df, key_names, NULL, dict_map, values, layer, tags, n_tags);
+            local_xs.push_back(x);
+            local_ys.push_back(y);
+            df.add_point(0, 0);
+        });
+    if (!local_xs.empty())
+        pmt_utils::pmt_tile_transform_t(zoom, tile_x, tile_y).to_global(local_xs.data(), local_ys.data(), local_xs.size(), &df.xs[first], &df.ys[first]);
+    return true;
 }
 
 uint64_t mvt_pts::count_points(const std::string &_buffer)
 {
-    mapbox::vector_tile::buffer* p_tile = new mapbox::vector_tile::buffer(_buffer);
-    if (p_tile == NULL)
-    {
-        return false;
-    }
-
+    // count the features of each layer without decoding them
     uint64_t n_points = 0;
-    for (auto const &name : p_tile->layerNames())
+    protozero::pbf_reader tile_reader(_buffer);
+    while (tile_reader.next(3))
     {
-        const mapbox::vector_tile::layer layer = p_tile->getLayer(name);
-        std::size_t feature_count = layer.featureCount();
-        n_points += feature_count;
+        protozero::pbf_reader layer_reader = tile_reader.get_message();
+        while (layer_reader.next(2))
+        {
+            layer_reader.skip();
+            ++n_points;
+        }
     }
-
-    delete p_tile;
     return n_points;
 }
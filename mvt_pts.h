@@ -4,55 +4,461 @@
 // A class containing MVTiles object that contains a collection of points
 // Performs decoding of MVTiles and coordinate transformation
 // This implementation relies on the original mapbox implementation of vector_tile
+// for value types, and decodes tiles directly with protozero
 
 #include "mapbox/vector_tile.hpp"
+#include "protozero/pbf_reader.hpp"
 #include "qgenlib/qgen_error.h"
 #include "polygon.h"
 #include "pmt_utils.h"
+#include "pt_predicate.h"
 #include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 
-// MVTile points with filters
+// column types of pt_dataframe
+enum pt_col_type_t : uint8_t
+{
+    PT_COL_STRING = 0, // dictionary-encoded string
+    PT_COL_INT64 = 1,
+    PT_COL_FLOAT = 2,
+    PT_COL_DOUBLE = 3
+};
+
+// A typed attribute column of pt_dataframe
+// Strings are stored as codes into a dictionary that lives as long as the tile's values (cleared by clear()),
+// and nulls are tracked in a bitmap allocated only once the first null is appended
+class pt_column
+{
+public:
+    std::string name;
+    pt_col_type_t type;
+    bool has_values = false;         // true once a non-null value was appended; until then the type may change
+    std::vector<int64_t> ints;       // PT_COL_INT64
+    std::vector<float> floats;       // PT_COL_FLOAT
+    std::vector<double> doubles;     // PT_COL_DOUBLE
+    std::vector<uint32_t> codes;     // PT_COL_STRING, index into dict
+    std::vector<std::string> dict;   // PT_COL_STRING dictionary of the current tile
+    std::vector<uint64_t> null_bits; // bit i is set if row i is null
+    size_t nrows = 0;
+
+    pt_column(const std::string &_name, pt_col_type_t _type) : name(_name), type(_type) {}
+
+    inline bool is_null(size_t i) const
+    {
+        return (i >> 6) < null_bits.size() && ((null_bits[i >> 6] >> (i & 63)) & 1);
+    }
+    inline void append_int64(int64_t v) { ints.push_back(v); ++nrows; has_values = true; }
+    inline void append_float(float v) { floats.push_back(v); ++nrows; has_values = true; }
+    inline void append_double(double v) { doubles.push_back(v); ++nrows; has_values = true; }
+    inline void append_code(uint32_t code) { codes.push_back(code); ++nrows; has_values = true; }
+    inline uint32_t add_dict(const char *s, size_t len)
+    {
+        dict.emplace_back(s, len);
+        return (uint32_t)(dict.size() - 1);
+    }
+    // append a null row, with a placeholder value to keep the typed array aligned with the rows
+    inline void append_null()
+    {
+        if ((nrows >> 6) >= null_bits.size())
+            null_bits.resize((nrows >> 6) + 1, 0);
+        null_bits[nrows >> 6] |= (uint64_t)1 << (nrows & 63);
+        switch (type)
+        {
+        case PT_COL_INT64: ints.push_back(0); break;
+        case PT_COL_FLOAT: floats.push_back(0); break;
+        case PT_COL_DOUBLE: doubles.push_back(0); break;
+        default: codes.push_back(0); break;
+        }
+        ++nrows;
+    }
+    inline void clear()
+    {
+        ints.clear();
+        floats.clear();
+        doubles.clear();
+        codes.clear();
+        dict.clear();
+        null_bits.clear();
+        nrows = 0;
+    }
+    // change the type of a column whose rows are all null
+    inline void retype(pt_col_type_t _type)
+    {
+        ints.clear();
+        floats.clear();
+        doubles.clear();
+        codes.clear();
+        type = _type;
+        switch (type)
+        {
+        case PT_COL_INT64: ints.resize(nrows, 0); break;
+        case PT_COL_FLOAT: floats.resize(nrows, 0); break;
+        case PT_COL_DOUBLE: doubles.resize(nrows, 0); break;
+        default: codes.resize(nrows, 0); break;
+        }
+    }
+    // convert a numeric column into a string column holding the text representation of its rows
+    inline void convert_to_string()
+    {
+        if (type == PT_COL_STRING)
+            return;
+        char buf[64];
+        dict.clear();
+        codes.resize(nrows);
+        for (size_t i = 0; i < nrows; ++i)
+        {
+            if (is_null(i))
+            {
+                codes[i] = 0;
+                continue;
+            }
+            const char *s = format(i, buf, sizeof(buf));
+            codes[i] = add_dict(s, strlen(s));
+        }
+        ints.clear();
+        floats.clear();
+        doubles.clear();
+        type = PT_COL_STRING;
+    }
+
+    static inline const char *format_int64(int64_t v, char *buf, size_t bufsize)
+    {
+        snprintf(buf, bufsize, "%lld", (long long)v);
+        return buf;
+    }
+    static inline const char *format_float(float v, char *buf, size_t bufsize)
+    {
+        snprintf(buf, bufsize, "%.9g", (double)v);
+        return buf;
+    }
+    // the shorter of %.15g and %.17g that reads back as the same value
+    static inline const char *format_double(double v, char *buf, size_t bufsize)
+    {
+        snprintf(buf, bufsize, "%.15g", v);
+        if (strtod(buf, NULL) != v)
+            snprintf(buf, bufsize, "%.17g", v);
+        return buf;
+    }
+    // text representation of row i, either a dictionary string or written into buf
+    inline const char *format(size_t i, char *buf, size_t bufsize) const
+    {
+        if (is_null(i))
+            return "NA";
+        switch (type)
+        {
+        case PT_COL_INT64:
+            return format_int64(ints[i], buf, bufsize);
+        case PT_COL_FLOAT:
+            return format_float(floats[i], buf, bufsize);
+        case PT_COL_DOUBLE:
+            return format_double(doubles[i], buf, bufsize);
+        default:
+            return dict[codes[i]].c_str();
+        }
+    }
+};
+
+// Typed columnar dataframe of the points decoded from tiles
 class pt_dataframe
 {
 public:
-    std::vector<std::string> feature_names;
-    std::vector<std::vector<std::string>> feature_matrix;
-    std::vector<pmt_utils::pmt_pt_t> points;
+    std::vector<double> xs; // global x coordinates (EPSG:3857)
+    std::vector<double> ys; // global y coordinates (EPSG:3857)
+    std::vector<pt_column> columns;
+
+    inline size_t num_points() const { return xs.size(); }
 
+    // complete a row after its attribute values were appended; columns without a value get a null
+    inline void add_point(double gx, double gy)
+    {
+        xs.push_back(gx);
+        ys.push_back(gy);
+        for (size_t i = 0; i < columns.size(); ++i)
+        {
+            if (columns[i].nrows < xs.size())
+                columns[i].append_null();
+        }
+    }
+
+    // clear the rows of all columns, keeping the schema and the allocated capacity
     inline void clear_values()
     {
-        points.clear();
-        for (int32_t i = 0; i < feature_matrix.size(); ++i)
+        xs.clear();
+        ys.clear();
+        for (size_t i = 0; i < columns.size(); ++i)
         {
-            feature_matrix[i].clear();
+            columns[i].clear();
         }
     }
 
-    inline void add_feature(int32_t idx, const std::string &name, const std::string &value)
+    // idx-th column, which is created if it is the next one, and must otherwise match name and type
+    // a column that has no values yet (e.g. created up front for a projection) takes the type
+    inline pt_column &column_at(int32_t idx, const std::string &name, pt_col_type_t type)
     {
-        if (idx >= feature_names.size())
+        pt_column &col = column_or_create(idx, name, type);
+        if (col.type != type)
         {
-            feature_names.push_back(name);
-            feature_matrix.resize(feature_names.size());
+            error("Incompatible types for feature %s", name.c_str());
         }
-        else if (feature_names[idx] != name)
+        return col;
+    }
+
+    // same as column_at(), but a column holding values of another type falls back to PT_COL_STRING,
+    // for sources whose values are typed individually (e.g. MVT)
+    inline pt_column &value_column_at(int32_t idx, const std::string &name, pt_col_type_t type)
+    {
+        pt_column &col = column_or_create(idx, name, type);
+        if (col.type != type)
+            col.convert_to_string();
+        return col;
+    }
+
+    // idx-th column, created if it is the next one without constraining its type, which is set by its first value
+    inline pt_column &declare_column(int32_t idx, const std::string &name)
+    {
+        return column_or_create(idx, name, idx < (int32_t)columns.size() ? columns[idx].type : PT_COL_STRING);
+    }
+
+private:
+    inline pt_column &column_or_create(int32_t idx, const std::string &name, pt_col_type_t type)
+    {
+        if (idx >= (int32_t)columns.size())
+        {
+            // a column first seen after some rows is null for those rows
+            columns.emplace_back(name, type);
+            while (columns.back().nrows < xs.size())
+                columns.back().append_null();
+            return columns.back();
+        }
+        pt_column &col = columns[idx];
+        if (col.name != name)
+        {
+            error("Incompatible feature names. %s != %s", col.name.c_str(), name.c_str());
+        }
+        if (col.type != type && !col.has_values)
+            col.retype(type);
+        return col;
+    }
+};
+
+// Single-pass protozero decoder for the point layers of an MVT tile
+// The key/value tables are decoded once per layer, and each point is handed to the caller
+// as tile-local (x, y) with its packed tag indices, without allocating per feature
+class mvt_point_decoder
+{
+public:
+    struct layer_t
+    {
+        protozero::data_view name;
+        uint32_t extent = 4096;
+        std::vector<protozero::data_view> keys;
+        std::vector<protozero::data_view> value_views; // encoded value messages
+        std::vector<std::string> values; // stringified values, formatted in the same way as print_value (only if stringify_values)
+    };
+
+    // stringify all values of each layer up front; callers that need only some of them
+    // can turn this off and call value_to_string() on layer.value_views instead
+    bool stringify_values = true;
+
+    // on_layer(const layer_t&) is called once per layer before its points
+    // on_point(const layer_t&, int32_t x, int32_t y, const uint32_t* tags, size_t n_tags) is called for each point,
+    // where tags holds n_tags/2 (key index, value index) pairs; returns the number of points decoded
+    template <typename LayerFunc, typename PointFunc>
+    uint64_t decode(const char *data, size_t size, LayerFunc &&on_layer, PointFunc &&on_point);
+
+    // stringify an MVT value message
+    static void value_to_string(protozero::data_view value_view, std::string &out);
+
+    // column type of an MVT value message, with numbers decoded into ival or dval
+    // int/uint/sint map to PT_COL_INT64, float and double to PT_COL_FLOAT and PT_COL_DOUBLE,
+    // and strings, booleans, nulls and uints beyond the int64 range to PT_COL_STRING
+    static pt_col_type_t value_to_typed(protozero::data_view value_view, int64_t &ival, double &dval);
+
+private:
+    layer_t layer;
+    std::vector<protozero::data_view> feature_views; // reused across layers and tiles
+    std::vector<uint32_t> tags;
+};
+
+template <typename LayerFunc, typename PointFunc>
+uint64_t mvt_point_decoder::decode(const char *data, size_t size, LayerFunc &&on_layer, PointFunc &&on_point)
+{
+    uint64_t n_points = 0;
+    protozero::pbf_reader tile_reader(data, size);
+    while (tile_reader.next(3)) // layers
+    {
+        // features usually precede the key/value tables, so collect the views first
+        protozero::pbf_reader layer_reader = tile_reader.get_message();
+        layer.name = protozero::data_view();
+        layer.extent = 4096;
+        layer.keys.clear();
+        feature_views.clear();
+        layer.value_views.clear();
+        while (layer_reader.next())
+        {
+            switch (layer_reader.tag())
+            {
+            case 1:
+                layer.name = layer_reader.get_view();
+                break;
+            case 2:
+                feature_views.push_back(layer_reader.get_view());
+                break;
+            case 3:
+                layer.keys.push_back(layer_reader.get_view());
+                break;
+            case 4:
+                layer.value_views.push_back(layer_reader.get_view());
+                break;
+            case 5:
+                layer.extent = layer_reader.get_uint32();
+                break;
+            default:
+                layer_reader.skip();
+            }
+        }
+        if (stringify_values)
+        {
+            layer.values.resize(layer.value_views.size()); // keeps the capacity of previously decoded strings
+            for (size_t i = 0; i < layer.value_views.size(); ++i)
+            {
+                value_to_string(layer.value_views[i], layer.values[i]);
+            }
+        }
+        on_layer(layer);
+
+        for (const protozero::data_view &fv : feature_views)
         {
-            error("Incompatible feature names. %s != %s", feature_names[idx].c_str(), name.c_str());
+            protozero::pbf_reader feature_reader(fv);
+            uint32_t geom_type = 0;
+            uint32_t n_geom = 0;
+            int32_t x = 0, y = 0;
+            tags.clear();
+            while (feature_reader.next())
+            {
+                switch (feature_reader.tag())
+                {
+                case 2: // tags
+                {
+                    auto pi = feature_reader.get_packed_uint32();
+                    tags.insert(tags.end(), pi.begin(), pi.end());
+                    break;
+                }
+                case 3:
+                    geom_type = feature_reader.get_enum();
+                    break;
+                case 4: // geometry: a single MoveTo command
+                {
+                    auto pi = feature_reader.get_packed_uint32();
+                    auto it = pi.begin();
+                    while (it != pi.end())
+                    {
+                        uint32_t cmd_len = *it++;
+                        uint32_t count = cmd_len >> 3;
+                        if ((cmd_len & 7) != 1)
+                        {
+                            error("Only points are supported in decode_points()");
+                        }
+                        for (uint32_t k = 0; k < count && it != pi.end(); ++k)
+                        {
+                            x += protozero::decode_zigzag32(*it++);
+                            if (it == pi.end())
+                            {
+                                error("Truncated point geometry in decode_points()");
+                            }
+                            y += protozero::decode_zigzag32(*it++);
+                            ++n_geom;
+                        }
+                    }
+                    break;
+                }
+                default:
+                    feature_reader.skip();
+                }
+            }
+            if (geom_type != 1)
+            {
+                error("Only points are supported in decode_points()");
+            }
+            if (n_geom != 1)
+            {
+                error("Only single point per feature is supported in decode_points()");
+            }
+            if (tags.size() % 2 != 0)
+            {
+                error("Uneven number of feature tag ids in decode_points()");
+            }
+            for (size_t t = 0; t < tags.size(); t += 2)
+            {
+                if (tags[t] >= layer.keys.size() || tags[t + 1] >= layer.value_views.size())
+                {
+                    error("Feature tag ids out of range in decode_points()");
+                }
+            }
+            on_point(layer, x, y, tags.data(), tags.size());
+            ++n_points;
         }
-        feature_matrix[idx].push_back(value);
     }
+    return n_points;
+}
+
+// Evaluates a pt_predicate on the features of an MVT layer
+// Each clause is resolved to a key index once per layer, and evaluated at most once per entry of
+// the layer's values table, so that checking a feature only compares integer indices
+// Numeric values are compared as numbers, as in the MLT decoder, and only strings and booleans as text
+class mvt_predicate_eval
+{
+public:
+    void start_layer(const pt_predicate &pred, const mvt_point_decoder::layer_t &layer);
+    bool eval(const pt_predicate &pred, const mvt_point_decoder::layer_t &layer, const uint32_t *tags, size_t n_tags);
+
+private:
+    std::vector<int32_t> clause_keys;              // key index of each clause in the current layer (-1 if absent)
+    std::vector<std::vector<uint8_t>> value_pass;  // per clause, 1 if each value satisfies it, 0 if not, 2 if not evaluated yet
+    std::string value;
+};
+
+// Typed values of the values table of an MVT layer, each decoded on first use
+class mvt_layer_values
+{
+public:
+    inline void start_layer(const mvt_point_decoder::layer_t &layer)
+    {
+        types.assign(layer.value_views.size(), 0xff);
+        ints.resize(layer.value_views.size());
+        nums.resize(layer.value_views.size());
+    }
+    inline pt_col_type_t type_of(const mvt_point_decoder::layer_t &layer, uint32_t v)
+    {
+        if (types[v] == 0xff)
+            types[v] = mvt_point_decoder::value_to_typed(layer.value_views[v], ints[v], nums[v]);
+        return (pt_col_type_t)types[v];
+    }
+    inline int64_t int_at(uint32_t v) const { return ints[v]; }
+    inline double num_at(uint32_t v) const { return nums[v]; }
+
+private:
+    std::vector<uint8_t> types; // pt_col_type_t of each value, 0xff if not decoded yet
+    std::vector<int64_t> ints;  // value of PT_COL_INT64 entries
+    std::vector<double> nums;   // value of PT_COL_FLOAT and PT_COL_DOUBLE entries
 };
 
 class mvt_pts_filt
 {
 public:
-    std::vector<Polygon*> polygons;
+    const PolygonIndex *p_polygons = NULL; // points must be in any of the polygons, if not NULL
     pmt_utils::pmt_pt_t *p_min_pt = NULL;
     pmt_utils::pmt_pt_t *p_max_pt = NULL;
+    const pt_predicate *p_predicate = NULL;
     //mapbox::vector_tile::buffer *p_tile = NULL;
     //pt_dataframe *p_df;
 
-    mvt_pts_filt(pt_dataframe *p = NULL) {} //: p_df(p) {}
+    std::vector<std::string> columns; // columns to decode, in output order (empty: all columns)
+
+    mvt_pts_filt(pt_dataframe *p = NULL) { decoder.stringify_values = false; } //: p_df(p) {}
     ~mvt_pts_filt()
     {
         //if (p_tile)
@@ -62,7 +468,9 @@ public:
     //inline void set_df(pt_dataframe *p) { p_df = p; }
     inline void set_min_filt(pmt_utils::pmt_pt_t *_min_pt) { p_min_pt = _min_pt; }
     inline void set_max_filt(pmt_utils::pmt_pt_t *_max_pt) { p_max_pt = _max_pt; }
-    inline void set_polygon_filt(std::vector<Polygon*> &_polygons) { polygons = _polygons; }
+    inline void set_polygon_filt(const PolygonIndex *_polygons) { p_polygons = _polygons; }
+    inline void set_column_filt(const std::vector<std::string> &_columns) { columns = _columns; }
+    inline void set_predicate_filt(const pt_predicate *_predicate) { p_predicate = _predicate; }
     // inline void set_geojson_polygon_filt(const char *jsonf)
     // {
     //     int32_t npolygons = load_polygons_from_geojson(jsonf, polygons);
@@ -74,6 +482,14 @@ public:
     // }
 
     bool decode_points_df(const std::string &_buffer, uint8_t zoom, int64_t tile_x, int64_t tile_y, pt_dataframe& df);
+
+private:
+    mvt_point_decoder decoder;
+    std::vector<std::string> key_names;         // keys of the current layer
+    std::vector<int32_t> key_cols;              // output column of each key of the current layer (-1 if not selected)
+    std::vector<std::vector<int32_t>> dict_map; // per column, the dictionary code of each value of the current layer (-1 if not yet added)
+    mvt_layer_values values;
+    mvt_predicate_eval pred_eval;
 };
 
 class mvt_pts
@@ -91,7 +507,16 @@ public:
     uint64_t count_points(const std::string &_buffer); //, double x_offset, double y_offset, uint8_t z);
     //int decode_points_localxy(const std::string &_buffer, std::vector<int32_t>& xs, std::vector<int32_t>& ys);
     //int32_t decode_points_xycnt(const std::string &_buffer, const std::string& colname_cnt, std::vector<int32_t>& xs, std::vector<int32_t>& ys, std::vector<int32_t>& cnts);
-    int32_t decode_points_xycnt_feature(const std::string &_buffer, const std::string& colname_cnt, const std::string& colname_feature, std::vector<int32_t>& xs, std::vector<int32_t>& ys, std::vector<int32_t>& cnts, std::vector<std::string>& features);
+    // decode the points satisfying p_predicate (all points if NULL), returning the number of points decoded
+    int32_t decode_points_xycnt_feature(const std::string &_buffer, const std::string& colname_cnt, const std::string& colname_feature, std::vector<int32_t>& xs, std::vector<int32_t>& ys, std::vector<int32_t>& cnts, std::vector<std::string>& features, const pt_predicate *p_predicate = NULL);
+
+private:
+    mvt_point_decoder decoder;
+    std::vector<std::string> key_names;
+    std::vector<std::vector<int32_t>> dict_map;
+    mvt_layer_values values;
+    mvt_predicate_eval pred_eval;
+    std::vector<int32_t> local_xs, local_ys; // tile-local coordinates of the points of a tile
 };
 
 class print_value
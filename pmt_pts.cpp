@@ -1,6 +1,14 @@
 #include <cstdio>
 #include <string>
+#include <cstring>
+#include <algorithm>
 #include <zlib.h>
+#ifdef HAVE_LIBDEFLATE
+#include <libdeflate.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
 
 #include "pmt_utils.h"
 #include "pmt_pts.h"
@@ -9,79 +17,310 @@
 #include "ext/nlohmann/json.hpp"
 #include "qgenlib/qgen_error.h"
 
-void pmt_pts::init()
+// gzip stores the uncompressed size (mod 2^32) little-endian in its last 4 bytes
+static inline bool is_gzip_member(const char *data, size_t size)
 {
-  // define a lambda function to decompress the data, currently, only gzip is supported
-  decompress_func = [](const std::string &compressed_data, uint8_t compression_method) -> std::string
+  return size >= 18 && (uint8_t)data[0] == 0x1f && (uint8_t)data[1] == 0x8b;
+}
+
+static inline uint32_t gzip_isize(const char *data, size_t size)
+{
+  const uint8_t *p = (const uint8_t *)data + size - 4;
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+#ifdef HAVE_LIBDEFLATE
+// one libdeflate decompressor per thread, reused across calls
+static libdeflate_decompressor *thread_decompressor()
+{
+  struct holder
+  {
+    libdeflate_decompressor *d;
+    holder() : d(libdeflate_alloc_decompressor()) {}
+    ~holder() { libdeflate_free_decompressor(d); }
+  };
+  static thread_local holder h;
+  return h.d;
+}
+#endif
+
+#ifdef HAVE_ZSTD
+// one zstd context of each kind per thread, reused across calls
+static ZSTD_DCtx *thread_zstd_dctx()
+{
+  struct holder
+  {
+    ZSTD_DCtx *d;
+    holder() : d(ZSTD_createDCtx()) {}
+    ~holder() { ZSTD_freeDCtx(d); }
+  };
+  static thread_local holder h;
+  return h.d;
+}
+
+static ZSTD_CCtx *thread_zstd_cctx()
+{
+  struct holder
+  {
+    ZSTD_CCtx *c;
+    holder() : c(ZSTD_createCCtx()) {}
+    ~holder() { ZSTD_freeCCtx(c); }
+  };
+  static thread_local holder h;
+  return h.c;
+}
+#endif
+
+uint8_t pmt_pts::parse_compression(const std::string &name)
+{
+  if (name == "none")
+    return pmtiles::COMPRESSION_NONE;
+  if (name == "gzip")
+    return pmtiles::COMPRESSION_GZIP;
+  if (name == "zstd")
+    return pmtiles::COMPRESSION_ZSTD;
+  return pmtiles::COMPRESSION_UNKNOWN;
+}
+
+const char *pmt_pts::compression_name(uint8_t compression_method)
+{
+  switch (compression_method)
+  {
+  case pmtiles::COMPRESSION_NONE:
+    return "none";
+  case pmtiles::COMPRESSION_GZIP:
+    return "gzip";
+  case pmtiles::COMPRESSION_BROTLI:
+    return "brotli";
+  case pmtiles::COMPRESSION_ZSTD:
+    return "zstd";
+  default:
+    return "unknown";
+  }
+}
+
+bool pmt_pts::compress_bytes(const char *data, size_t size, uint8_t compression_method, int32_t level, std::string &out)
+{
+  if (compression_method == pmtiles::COMPRESSION_NONE)
+  {
+    out.assign(data, size);
+    return true;
+  }
+  else if (compression_method == pmtiles::COMPRESSION_GZIP)
+  {
+    z_stream deflate_s;
+    memset(&deflate_s, 0, sizeof(deflate_s));
+    if (deflateInit2(&deflate_s, level > 0 ? level : Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 | 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+    {
+      error("deflateInit2 failed");
+    }
+    out.resize(deflateBound(&deflate_s, size));
+    deflate_s.next_in = (Bytef *)data;
+    deflate_s.avail_in = size;
+    deflate_s.next_out = (Bytef *)&out[0];
+    deflate_s.avail_out = out.size();
+    int ret = deflate(&deflate_s, Z_FINISH);
+    out.resize(deflate_s.total_out);
+    deflateEnd(&deflate_s);
+    if (ret != Z_STREAM_END)
+    {
+      error("deflate failed");
+      return false;
+    }
+    return true;
+  }
+  else if (compression_method == pmtiles::COMPRESSION_ZSTD)
   {
-    if (compression_method == pmtiles::COMPRESSION_GZIP)
+#ifdef HAVE_ZSTD
+    out.resize(ZSTD_compressBound(size));
+    size_t ret = ZSTD_compressCCtx(thread_zstd_cctx(), &out[0], out.size(), data, size, level > 0 ? level : ZSTD_CLEVEL_DEFAULT);
+    if (ZSTD_isError(ret))
     {
-      z_stream inflate_s;
-      std::string decompressed_data;
-      inflate_s.zalloc = Z_NULL;
-      inflate_s.zfree = Z_NULL;
-      inflate_s.opaque = Z_NULL;
-      inflate_s.avail_in = 0;
-      inflate_s.next_in = Z_NULL;
-      if (inflateInit2(&inflate_s, 32 + 15) != Z_OK)
+      error("zstd compression failed: %s", ZSTD_getErrorName(ret));
+      return false;
+    }
+    out.resize(ret);
+    return true;
+#else
+    error("zstd compression requested, but pmpoint was built without zstd support");
+    return false;
+#endif
+  }
+  else
+  {
+    error("Unsupported compression method %s", compression_name(compression_method));
+    return false;
+  }
+}
+
+bool pmt_pts::decompress_bytes(const char *data, size_t size, uint8_t compression_method, std::string &out)
+{
+  if (compression_method == pmtiles::COMPRESSION_NONE)
+  {
+    out.assign(data, size);
+    return true;
+  }
+  else if (compression_method == pmtiles::COMPRESSION_GZIP)
+  {
+    // size the output from the ISIZE trailer; out keeps its capacity across calls, so a reused buffer rarely reallocates
+    size_t isize = is_gzip_member(data, size) ? gzip_isize(data, size) : 0;
+    if (isize > (uint64_t)size * 1032) // beyond deflate's maximum ratio, so the trailer cannot be trusted
+      isize = 0;
+#ifdef HAVE_LIBDEFLATE
+    if (isize > 0)
+    {
+      out.resize(isize);
+      size_t in_used = 0, out_used = 0;
+      libdeflate_result ret = libdeflate_gzip_decompress_ex(thread_decompressor(), data, size, &out[0], isize, &in_used, &out_used);
+      if (ret == LIBDEFLATE_SUCCESS && in_used == size)
       {
-        fprintf(stderr, "Decompression error: %s\n", inflate_s.msg);
+        out.resize(out_used);
+        return true;
       }
-      inflate_s.next_in = (Bytef *)compressed_data.data();
-      inflate_s.avail_in = compressed_data.size();
-      inflate_s.next_out = (Bytef *)decompressed_data.data();
-      inflate_s.avail_out = decompressed_data.size();
+      // multi-member streams or sizes above 4GB are left to zlib below
+    }
+#endif
+    z_stream inflate_s;
+    out.clear();
+    inflate_s.zalloc = Z_NULL;
+    inflate_s.zfree = Z_NULL;
+    inflate_s.opaque = Z_NULL;
+    inflate_s.avail_in = 0;
+    inflate_s.next_in = Z_NULL;
+    if (inflateInit2(&inflate_s, 32 + 15) != Z_OK)
+    {
+      fprintf(stderr, "Decompression error: %s\n", inflate_s.msg);
+    }
+    out.resize(isize > 0 ? isize : 2 * size + 100);
+    inflate_s.next_in = (Bytef *)data;
+    inflate_s.avail_in = size;
+    inflate_s.next_out = (Bytef *)&out[0];
+    inflate_s.avail_out = out.size();
 
-      while (true)
+    while (true)
+    {
+      if (inflate_s.avail_out == 0)
       {
-        size_t existing_output = inflate_s.next_out - (Bytef *)decompressed_data.data();
-
-        decompressed_data.resize(existing_output + 2 * inflate_s.avail_in + 100);
-        inflate_s.next_out = (Bytef *)decompressed_data.data() + existing_output;
-        inflate_s.avail_out = decompressed_data.size() - existing_output;
+        size_t existing_output = inflate_s.next_out - (Bytef *)out.data();
+        out.resize(existing_output + 2 * inflate_s.avail_in + 100);
+        inflate_s.next_out = (Bytef *)&out[0] + existing_output;
+        inflate_s.avail_out = out.size() - existing_output;
+      }
 
-        int ret = inflate(&inflate_s, 0);
-        if (ret < 0)
+      int ret = inflate(&inflate_s, 0);
+      if (ret < 0)
+      {
+        fprintf(stderr, "Decompression error: ");
+        if (ret == Z_DATA_ERROR)
         {
-          fprintf(stderr, "Decompression error: ");
-          if (ret == Z_DATA_ERROR)
-          {
-            fprintf(stderr, "data error");
-          }
-          if (ret == Z_STREAM_ERROR)
-          {
-            fprintf(stderr, "stream error");
-          }
-          if (ret == Z_MEM_ERROR)
-          {
-            fprintf(stderr, "out of memory");
-          }
-          if (ret == Z_BUF_ERROR)
-          {
-            fprintf(stderr, "no data in buffer");
-          }
-          fprintf(stderr, "\n");
-          return "";
+          fprintf(stderr, "data error");
         }
-
-        if (ret == Z_STREAM_END)
+        if (ret == Z_STREAM_ERROR)
         {
-          break;
+          fprintf(stderr, "stream error");
+        }
+        if (ret == Z_MEM_ERROR)
+        {
+          fprintf(stderr, "out of memory");
+        }
+        if (ret == Z_BUF_ERROR)
+        {
+          fprintf(stderr, "no data in buffer");
         }
+        fprintf(stderr, "\n");
+        inflateEnd(&inflate_s);
+        out.clear();
+        return false;
+      }
 
-        // ret must be Z_OK or Z_NEED_DICT;
-        // continue decompresing
+      if (ret == Z_STREAM_END)
+      {
+        // continue with the next gzip member, if any; other trailing bytes are ignored as before
+        if (is_gzip_member((const char *)inflate_s.next_in, inflate_s.avail_in) && inflateReset(&inflate_s) == Z_OK)
+          continue;
+        break;
       }
 
-      decompressed_data.resize(inflate_s.next_out - (Bytef *)decompressed_data.data());
-      inflateEnd(&inflate_s);
-      return decompressed_data;
+      // ret must be Z_OK or Z_NEED_DICT;
+      // continue decompresing
+    }
+
+    out.resize(inflate_s.next_out - (Bytef *)out.data());
+    inflateEnd(&inflate_s);
+    return true;
+  }
+  else if (compression_method == pmtiles::COMPRESSION_ZSTD)
+  {
+#ifdef HAVE_ZSTD
+    // pmtiles writers record the content size in the frame header; otherwise fall back to streaming
+    unsigned long long csize = ZSTD_getFrameContentSize(data, size);
+    if (csize == ZSTD_CONTENTSIZE_ERROR)
+    {
+      fprintf(stderr, "Decompression error: not a zstd frame\n");
+      out.clear();
+      return false;
+    }
+    if (csize != ZSTD_CONTENTSIZE_UNKNOWN)
+    {
+      out.resize(csize);
+      size_t ret = ZSTD_decompressDCtx(thread_zstd_dctx(), &out[0], csize, data, size);
+      if (!ZSTD_isError(ret))
+      {
+        out.resize(ret);
+        return true;
+      }
+      // concatenated frames carry more than the first header promises; retry by streaming
     }
-    else
+    ZSTD_DCtx *dctx = thread_zstd_dctx();
+    ZSTD_DCtx_reset(dctx, ZSTD_reset_session_only);
+    ZSTD_inBuffer in = {data, size, 0};
+    size_t existing_output = 0;
+    out.resize(2 * size + 100);
+    while (true)
     {
-      error("Unsupported compression method");
-      return "";
+      if (existing_output == out.size())
+        out.resize(existing_output + 2 * (in.size - in.pos) + 100);
+      ZSTD_outBuffer outb = {&out[0] + existing_output, out.size() - existing_output, 0};
+      size_t ret = ZSTD_decompressStream(dctx, &outb, &in);
+      if (ZSTD_isError(ret))
+      {
+        fprintf(stderr, "Decompression error: %s\n", ZSTD_getErrorName(ret));
+        out.clear();
+        return false;
+      }
+      existing_output += outb.pos;
+      if (in.pos == in.size && outb.pos < outb.size)
+      {
+        if (ret == 0)
+          break;
+        // all input consumed and output not full, yet the frame is incomplete
+        fprintf(stderr, "Decompression error: truncated zstd frame\n");
+        out.clear();
+        return false;
+      }
     }
+    out.resize(existing_output);
+    return true;
+#else
+    error("zstd-compressed data found, but pmpoint was built without zstd support");
+    return false;
+#endif
+  }
+  else
+  {
+    error("Unsupported compression method %s", compression_name(compression_method));
+    return false;
+  }
+}
+
+void pmt_pts::init()
+{
+  // define a lambda function to decompress the data, currently, none, gzip and zstd are supported
+  decompress_func = [](const std::string &compressed_data, uint8_t compression_method) -> std::string
+  {
+    std::string decompressed_data;
+    decompress_bytes(compressed_data.data(), compressed_data.size(), compression_method, decompressed_data);
+    return decompressed_data;
   };
 }
 
@@ -241,36 +480,339 @@ bool pmt_pts::read_header_meta_entries()
 
   //tile_entries = pmtiles::entries_tms(decompress_func, buffer_before_tiles);
 
+  // use the mapped bytes directly when the reader supports zero-copy views
   std::string str_before_tiles;
-  if (!flex_reader_ptr->read_at(0, hdr.tile_data_offset, str_before_tiles) || str_before_tiles.size() != hdr.tile_data_offset)
+  const char *p_before_tiles = flex_reader_ptr->view_at(0, hdr.tile_data_offset);
+  if (p_before_tiles == nullptr)
   {
-    return false;
+    if (!flex_reader_ptr->read_at(0, hdr.tile_data_offset, str_before_tiles) || str_before_tiles.size() != hdr.tile_data_offset)
+    {
+      return false;
+    }
+    p_before_tiles = str_before_tiles.data();
   }
-  tile_entries = pmtiles::entries_tms(decompress_func, str_before_tiles.c_str());
+  tile_entries = pmtiles::entries_tms(decompress_func, p_before_tiles);
 
   // read metadata information
   //std::string meta_compressed(buffer_before_tiles + hdr.json_metadata_offset, hdr.json_metadata_bytes);
-  std::string meta_compressed = str_before_tiles.substr(hdr.json_metadata_offset, hdr.json_metadata_bytes);
-  std::string meta_decompressed = decompress_func(meta_compressed, hdr.internal_compression);
+  std::string meta_decompressed;
+  decompress_bytes(p_before_tiles + hdr.json_metadata_offset, hdr.json_metadata_bytes, hdr.internal_compression, meta_decompressed);
 
   // load the metadata into a json object
   jmeta = nlohmann::json::parse(meta_decompressed);
 
   //delete[] buffer_before_tiles;
 
-  // build a map of tile entries
+  // build a lookup index of tile entries
   notice("A total of %zu tile entries are found", tile_entries.size());
-  for (int32_t i = 0; i < tile_entries.size(); i++)
+  build_tile_index();
+  hdr_read = true;
+  return (hdr.tile_type == pmtiles::TILETYPE_MVT || hdr.tile_type == 0x06);
+}
+
+// returns a pointer to [offset, offset+length), either from the reader's mapping or copied into buf
+const char *pmt_pts::view_or_read(uint64_t offset, uint64_t length, std::string &buf)
+{
+  const char *p = flex_reader_ptr->view_at(offset, length);
+  if (p != nullptr)
   {
-    const pmtiles::entry_zxy &e = tile_entries[i];
+    return p;
+  }
+  if (!flex_reader_ptr->read_at(offset, length, buf) || buf.size() != length)
+  {
+    return nullptr;
+  }
+  return buf.data();
+}
 
-    uint64_t tile_id = pmtiles::zxy_to_tileid(e.z, e.x, e.y);
-    tileid2idx[tile_id] = i;
+bool pmt_pts::read_header_meta_root()
+{
+  std::lock_guard<std::mutex> lock(mtx);
+  if (flex_reader_ptr == nullptr || !flex_reader_ptr->is_open()) {
+    return false;
+  }
+  if (hdr_read)
+  {
+    return true;
+  }
+
+  // the spec places the header and root directory within the first 16KB,
+  // so a single read usually covers the header, root directory and metadata
+  uint64_t prefix_len = 16384;
+  if (flex_reader_ptr->size_hint() > 0 && flex_reader_ptr->size_hint() < prefix_len)
+  {
+    prefix_len = flex_reader_ptr->size_hint();
   }
+  std::string prefix_str;
+  const char *p_prefix = view_or_read(0, prefix_len, prefix_str);
+  if (p_prefix == nullptr || prefix_len < 127)
+  {
+    error("Failed to read PMTiles header info");
+    return false;
+  }
+  hdr = pmtiles::deserialize_header(std::string(p_prefix, 127));
+  if (hdr.tile_type != pmtiles::TILETYPE_MVT && hdr.tile_type != 0x06)
+  {
+    notice("Unsupported tile type: %d", hdr.tile_type);
+  }
+
+  std::string buf;
+  const char *p_root = (hdr.root_dir_offset + hdr.root_dir_bytes <= prefix_len) ? p_prefix + hdr.root_dir_offset : view_or_read(hdr.root_dir_offset, hdr.root_dir_bytes, buf);
+  if (p_root == nullptr)
+  {
+    error("Failed to read the root directory");
+    return false;
+  }
+  std::string root_decompressed;
+  decompress_bytes(p_root, hdr.root_dir_bytes, hdr.internal_compression, root_decompressed);
+  root_dir_entries = pmtiles::deserialize_directory(root_decompressed);
+
+  if (hdr.json_metadata_bytes > 0)
+  {
+    const char *p_meta = (hdr.json_metadata_offset + hdr.json_metadata_bytes <= prefix_len) ? p_prefix + hdr.json_metadata_offset : view_or_read(hdr.json_metadata_offset, hdr.json_metadata_bytes, buf);
+    if (p_meta == nullptr)
+    {
+      error("Failed to read the metadata");
+      return false;
+    }
+    std::string meta_decompressed;
+    decompress_bytes(p_meta, hdr.json_metadata_bytes, hdr.internal_compression, meta_decompressed);
+    jmeta = nlohmann::json::parse(meta_decompressed);
+  }
+
+  notice("Loaded the root directory with %zu entries; leaf directories will be loaded on demand", root_dir_entries.size());
+  lazy_dirs = true;
   hdr_read = true;
   return (hdr.tile_type == pmtiles::TILETYPE_MVT || hdr.tile_type == 0x06);
 }
 
+bool pmt_pts::find_tile_entry(uint8_t z, uint32_t x, uint32_t y, pmtiles::entry_zxy &e)
+{
+  std::lock_guard<std::mutex> lock(mtx);
+  uint64_t tile_id = pmtiles::zxy_to_tileid(z, x, y);
+  const std::vector<pmtiles::entryv3> *p_dir = &root_dir_entries;
+  for (int32_t depth = 0; depth <= 3; ++depth)
+  {
+    pmtiles::entryv3 d = pmtiles::find_tile(*p_dir, tile_id);
+    if (d.length == 0)
+    {
+      return false;
+    }
+    if (d.run_length > 0)
+    {
+      e = pmtiles::entry_zxy(z, x, y, hdr.tile_data_offset + d.offset, d.length);
+      return true;
+    }
+    // descend into the leaf directory, loading it on first use
+    p_dir = &leaf_directory(hdr.leaf_dirs_offset + d.offset, d.length);
+  }
+  return false;
+}
+
+const std::vector<pmtiles::entryv3> &pmt_pts::leaf_directory(uint64_t offset, uint32_t length)
+{
+  std::unordered_map<uint64_t, std::vector<pmtiles::entryv3> >::iterator it = leaf_dir_cache.find(offset);
+  if (it == leaf_dir_cache.end())
+  {
+    std::string buf, leaf_decompressed;
+    const char *p_leaf = view_or_read(offset, length, buf);
+    if (p_leaf == nullptr)
+    {
+      error("Failed to read the leaf directory at offset %llu", (unsigned long long)offset);
+    }
+    decompress_bytes(p_leaf, length, hdr.internal_compression, leaf_decompressed);
+    it = leaf_dir_cache.emplace(offset, pmtiles::deserialize_directory(leaf_decompressed)).first;
+  }
+  return it->second;
+}
+
+// tile containing a WGS84 coordinate at zoom level z, clamped to the tiles of the zoom level
+static void lonlat_to_tile(double lon, double lat, uint8_t z, int64_t &tx, int64_t &ty)
+{
+  lat = std::max(-85.0511287798, std::min(85.0511287798, lat));
+  double x = lon * M_PI / 180.0 * 6378137.0;
+  double y = std::log(std::tan(M_PI / 4.0 + lat * M_PI / 360.0)) * 6378137.0;
+  double n = (double)(1LL << z);
+  int64_t max_tile = (1LL << z) - 1;
+  tx = std::max((int64_t)0, std::min(max_tile, (int64_t)std::floor((x + pmt_utils::EPSG_3857_bound) / (2 * pmt_utils::EPSG_3857_bound) * n)));
+  ty = std::max((int64_t)0, std::min(max_tile, (int64_t)std::floor((pmt_utils::EPSG_3857_bound - y) / (2 * pmt_utils::EPSG_3857_bound) * n)));
+}
+
+uint64_t pmt_pts::load_tile_entries(uint8_t z, uint32_t x_min, uint32_t x_max, uint32_t y_min, uint32_t y_max,
+                                    const std::function<bool(uint32_t, uint32_t, uint32_t)> &may_overlap)
+{
+  tile_entries.clear();
+
+  // clamp the range to the bounds in the header, unless they are unset (all zero) or invalid
+  bool has_bounds = hdr.min_lon_e7 != 0 || hdr.min_lat_e7 != 0 || hdr.max_lon_e7 != 0 || hdr.max_lat_e7 != 0;
+  if (has_bounds && hdr.min_lon_e7 <= hdr.max_lon_e7 && hdr.min_lat_e7 <= hdr.max_lat_e7 &&
+      hdr.min_lon_e7 >= -1800000000 && hdr.max_lon_e7 <= 1800000000 && hdr.min_lat_e7 >= -900000000 && hdr.max_lat_e7 <= 900000000)
+  {
+    // the bounds are truncated to 1e-7 degrees, so widen them slightly
+    int64_t bx0, by0, bx1, by1;
+    lonlat_to_tile(hdr.min_lon_e7 / 1e7 - 1e-6, hdr.max_lat_e7 / 1e7 + 1e-6, z, bx0, by0);
+    lonlat_to_tile(hdr.max_lon_e7 / 1e7 + 1e-6, hdr.min_lat_e7 / 1e7 - 1e-6, z, bx1, by1);
+    x_min = std::max(x_min, (uint32_t)bx0);
+    x_max = std::min(x_max, (uint32_t)bx1);
+    y_min = std::max(y_min, (uint32_t)by0);
+    y_max = std::min(y_max, (uint32_t)by1);
+  }
+
+  // Tile IDs of a zoom level follow a Hilbert curve, on which each aligned block of 4^k IDs covers an
+  // aligned 2^k x 2^k square of tiles. The ID range of each directory entry is split into such blocks,
+  // and leaf directories are loaded only if one of their blocks overlaps the range, so the cost
+  // depends on the directory entries and the tiles found rather than on the number of cells in the range.
+  uint64_t base = ((1ULL << (2 * z)) - 1) / 3; // tile ID of the first tile at zoom z
+  uint64_t count = 1ULL << (2 * z);            // number of tiles at zoom z
+  // whether the block of 4^k IDs at offset s from base may contain a wanted tile, setting its upper left tile
+  auto block_overlaps = [&](uint64_t s, int32_t k, uint32_t &x0, uint32_t &y0) -> bool
+  {
+    pmtiles::zxy t = pmtiles::tileid_to_zxy(base + s);
+    uint32_t span = (uint32_t)((1ULL << k) - 1);
+    x0 = t.x & ~span;
+    y0 = t.y & ~span;
+    if (x0 + span < x_min || x0 > x_max || y0 + span < y_min || y0 > y_max)
+    {
+      return false;
+    }
+    return !may_overlap || may_overlap(x0, y0, span + 1);
+  };
+  // split the offsets [lo, hi) into aligned blocks, calling fn(s, k) on each until it returns false
+  auto split_blocks = [&](uint64_t lo, uint64_t hi, const std::function<bool(uint64_t, int32_t)> &fn) -> bool
+  {
+    while (lo < hi)
+    {
+      int32_t k = 0;
+      while (k < z && (lo & ((4ULL << (2 * k)) - 1)) == 0 && lo + (4ULL << (2 * k)) <= hi)
+      {
+        ++k;
+      }
+      if (!fn(lo, k))
+      {
+        return false;
+      }
+      lo += 1ULL << (2 * k);
+    }
+    return true;
+  };
+  // add the wanted tiles of the block of 4^k IDs at offset s, which all point to the same tile data
+  std::function<void(uint64_t, int32_t, const pmtiles::entryv3 &)> add_block = [&](uint64_t s, int32_t k, const pmtiles::entryv3 &d)
+  {
+    uint32_t x0, y0;
+    if (!block_overlaps(s, k, x0, y0))
+    {
+      return;
+    }
+    if (k == 0)
+    {
+      tile_entries.push_back(pmtiles::entry_zxy(z, x0, y0, hdr.tile_data_offset + d.offset, d.length));
+      return;
+    }
+    for (uint64_t q = 0; q < 4; ++q)
+    {
+      add_block(s + q * (1ULL << (2 * (k - 1))), k - 1, d);
+    }
+  };
+  // visit the entries of a directory covering the tile IDs up to dir_end
+  std::function<void(const std::vector<pmtiles::entryv3> &, uint64_t, int32_t)> walk = [&](const std::vector<pmtiles::entryv3> &dir, uint64_t dir_end, int32_t depth)
+  {
+    for (size_t i = 0; i < dir.size(); ++i)
+    {
+      const pmtiles::entryv3 &d = dir[i];
+      uint64_t id_end = d.run_length > 0 ? d.tile_id + d.run_length : (i + 1 < dir.size() ? dir[i + 1].tile_id : dir_end);
+      uint64_t lo = std::max(d.tile_id, base);
+      uint64_t hi = std::min(id_end, base + count);
+      if (lo >= hi)
+      {
+        continue;
+      }
+      if (d.run_length > 0)
+      {
+        split_blocks(lo - base, hi - base, [&](uint64_t s, int32_t k)
+                     { add_block(s, k, d); return true; });
+      }
+      else if (depth < 3)
+      {
+        uint32_t x0, y0;
+        bool overlaps = !split_blocks(lo - base, hi - base, [&](uint64_t s, int32_t k)
+                                      { return !block_overlaps(s, k, x0, y0); });
+        if (overlaps)
+        {
+          walk(leaf_directory(hdr.leaf_dirs_offset + d.offset, d.length), id_end, depth + 1);
+        }
+      }
+    }
+  };
+  if (x_min <= x_max && y_min <= y_max)
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    walk(root_dir_entries, UINT64_MAX, 0);
+  }
+
+  // sort in TMS order (x ascending, y descending), matching entries_tms()
+  std::sort(tile_entries.begin(), tile_entries.end(), [](const pmtiles::entry_zxy &a, const pmtiles::entry_zxy &b)
+            { return a.x != b.x ? a.x < b.x : a.y > b.y; });
+  build_tile_index();
+  notice("Resolved %zu tile entries at zoom %d from %zu cached leaf directories", tile_entries.size(), z, leaf_dir_cache.size());
+  return tile_entries.size();
+}
+
+// tile_entries must be sorted by zoom level first (as entries_tms() and load_tile_entries() produce)
+void pmt_pts::build_tile_index()
+{
+  std::vector<std::pair<uint64_t, uint32_t> > id_idx(tile_entries.size());
+  for (uint32_t i = 0; i < (uint32_t)tile_entries.size(); ++i)
+  {
+    const pmtiles::entry_zxy &e = tile_entries[i];
+    id_idx[i] = std::make_pair(pmtiles::zxy_to_tileid(e.z, e.x, e.y), i);
+  }
+  std::sort(id_idx.begin(), id_idx.end());
+  sorted_tile_ids.resize(id_idx.size());
+  sorted_tile_idxs.resize(id_idx.size());
+  for (size_t i = 0; i < id_idx.size(); ++i)
+  {
+    sorted_tile_ids[i] = id_idx[i].first;
+    sorted_tile_idxs[i] = id_idx[i].second;
+  }
+
+  for (int32_t z = 0; z < MAX_ZOOM_LEVELS; ++z)
+  {
+    zoom_ranges[z] = std::make_pair(0, 0);
+  }
+  for (uint32_t i = 0; i < (uint32_t)tile_entries.size();)
+  {
+    uint8_t z = tile_entries[i].z;
+    uint32_t j = i + 1;
+    while (j < (uint32_t)tile_entries.size() && tile_entries[j].z == z)
+    {
+      ++j;
+    }
+    if (z < MAX_ZOOM_LEVELS)
+    {
+      zoom_ranges[z] = std::make_pair(i, j);
+    }
+    i = j;
+  }
+}
+
+int64_t pmt_pts::find_tile_index(uint64_t tile_id) const
+{
+  size_t n = sorted_tile_ids.size();
+  if (n == 0)
+  {
+    return -1;
+  }
+  // branchless binary search for the last element <= tile_id
+  const uint64_t *base = sorted_tile_ids.data();
+  while (n > 1)
+  {
+    size_t half = n / 2;
+    base = (base[half] <= tile_id) ? base + half : base;
+    n -= half;
+  }
+  return (*base == tile_id) ? (int64_t)sorted_tile_idxs[base - sorted_tile_ids.data()] : -1;
+}
+
 bool pmt_pts::read_metadata()
 {
   std::lock_guard<std::mutex> lock(mtx);
@@ -354,38 +896,155 @@ bool pmt_pts::read_metadata()
 size_t pmt_pts::fetch_tile_to_buffer(uint8_t z, uint32_t x, uint32_t y, std::string& buffer)
 {
   uint64_t tile_id = pmtiles::zxy_to_tileid(z, x, y);
-  if (tileid2idx.find(tile_id) == tileid2idx.end())
+  pmtiles::entry_zxy e(z, x, y, 0, 0);
+  int64_t idx = find_tile_index(tile_id);
+  if (idx >= 0)
+  {
+    e = tile_entries[idx];
+  }
+  else if (!lazy_dirs || !find_tile_entry(z, x, y, e))
   {
     error("Tile %u/%lu/%lu not found", z, x, y);
   }
-  const pmtiles::entry_zxy &e = tile_entries[tileid2idx[tile_id]];
-  // allocate memory for the tile data
-  //char *tile_data = new char[e.length];
-  // move to the tile data offset
-  std::string tile_comp_data_str;
+  // decompress straight from the mapped bytes when the reader supports zero-copy views
+  const char *p_tile = flex_reader_ptr->view_at(e.offset, e.length);
+  if (p_tile != nullptr)
   {
-    std::lock_guard<std::mutex> lock(mtx);
-    // if (cur_pos != e.offset)
-    // {
-    //   fseek(fp, e.offset, SEEK_SET);
-    //   cur_pos = e.offset;
-    // }
-    // // read the tile data
-    // if (fread(tile_data, 1, e.length, fp) != e.length)
-    // {
-    //   delete[] tile_data;
-    //   error("Failed to read tile data %u/%lu/%lu with length %", z, x, y);
-    // }
-    //cur_pos = e.offset;
-    if (!flex_reader_ptr->read_at(e.offset, e.length, tile_comp_data_str) || tile_comp_data_str.size() != e.length) {
+    decompress_bytes(p_tile, e.length, hdr.tile_compression, buffer);
+    return buffer.size();
+  }
+  // uncompressed tiles are read straight into the caller's buffer
+  bool uncompressed = hdr.tile_compression == pmtiles::COMPRESSION_NONE;
+  static thread_local std::string tile_comp_data_str; // reused across calls to avoid a fresh allocation per tile
+  std::string &raw = uncompressed ? buffer : tile_comp_data_str;
+  {
+    // positional readers (e.g. local files) serve concurrent reads without locking
+    std::unique_lock<std::mutex> lock(mtx, std::defer_lock);
+    if (!flex_reader_ptr->is_thread_safe())
+    {
+      lock.lock();
+    }
+    if (!flex_reader_ptr->read_at(e.offset, e.length, raw) || raw.size() != e.length) {
       error("Failed to read tile data %u/%lu/%lu with length %", z, x, y);
     }
   }
+  if (uncompressed)
+  {
+    return buffer.size();
+  }
   // uncompress the tile data
-  //std::string tile_comp_data_str(tile_data, e.length);
-  //delete[] tile_data;
-  buffer = decompress_func(tile_comp_data_str, hdr.tile_compression);
+  decompress_bytes(tile_comp_data_str.data(), tile_comp_data_str.size(), hdr.tile_compression, buffer);
 
   //return tile_data_str.size();
   return buffer.size();
-}
\ No newline at end of file
+}
+
+uint64_t pmt_pts::fetch_tiles(const std::vector<pmtiles::zxy> &tiles, const std::function<void(size_t, const pmtiles::entry_zxy &, std::string &)> &callback, uint64_t max_gap, uint64_t max_span)
+{
+  // resolve the requested tiles and order them by their position in the file
+  std::vector<pmtiles::entry_zxy> entries;
+  std::vector<size_t> order(tiles.size());
+  entries.reserve(tiles.size());
+  for (size_t i = 0; i < tiles.size(); ++i)
+  {
+    const pmtiles::zxy &t = tiles[i];
+    pmtiles::entry_zxy e(t.z, t.x, t.y, 0, 0);
+    int64_t idx = find_tile_index(pmtiles::zxy_to_tileid(t.z, t.x, t.y));
+    if (idx >= 0)
+    {
+      e = tile_entries[idx];
+    }
+    else if (!lazy_dirs || !find_tile_entry(t.z, t.x, t.y, e))
+    {
+      error("Tile %u/%lu/%lu not found", t.z, t.x, t.y);
+    }
+    entries.push_back(e);
+    order[i] = i;
+  }
+  std::sort(order.begin(), order.end(), [&entries](size_t a, size_t b) { return entries[a].offset < entries[b].offset; });
+
+  // merge nearby byte ranges so that each group is served by a single read
+  std::vector<size_t> group_begs; // first position in order for each group
+  std::vector<std::pair<uint64_t, uint64_t> > group_spans; // (offset, length) of each group
+  size_t i = 0;
+  while (i < order.size())
+  {
+    uint64_t span_beg = entries[order[i]].offset;
+    uint64_t span_end = span_beg + entries[order[i]].length;
+    size_t j = i + 1;
+    for (; j < order.size(); ++j)
+    {
+      const pmtiles::entry_zxy &e = entries[order[j]];
+      uint64_t new_end = std::max(span_end, e.offset + e.length);
+      if (e.offset > span_end + max_gap || new_end - span_beg > max_span)
+      {
+        break;
+      }
+      span_end = new_end;
+    }
+    group_begs.push_back(i);
+    group_spans.push_back(std::make_pair(span_beg, span_end - span_beg));
+    i = j;
+  }
+  group_begs.push_back(order.size());
+
+  // issue the reads of several groups together so that network readers can overlap them
+  const size_t max_batch_groups = 64;
+  const uint64_t max_batch_bytes = 4 * max_span;
+  std::vector<const char *> p_spans;
+  std::vector<std::pair<uint64_t, uint64_t> > read_spans;
+  std::vector<size_t> read_groups;
+  std::vector<std::string> read_bufs;
+  std::string tile_buf;
+  size_t g = 0;
+  while (g < group_spans.size())
+  {
+    size_t h = g;
+    uint64_t batch_bytes = 0;
+    p_spans.clear();
+    read_spans.clear();
+    read_groups.clear();
+    while (h < group_spans.size() && h - g < max_batch_groups && (h == g || batch_bytes + group_spans[h].second <= max_batch_bytes))
+    {
+      const char *p = flex_reader_ptr->view_at(group_spans[h].first, group_spans[h].second);
+      if (p == nullptr)
+      {
+        read_spans.push_back(group_spans[h]);
+        read_groups.push_back(h - g);
+        batch_bytes += group_spans[h].second;
+      }
+      p_spans.push_back(p);
+      ++h;
+    }
+    if (!read_spans.empty())
+    {
+      std::unique_lock<std::mutex> lock(mtx, std::defer_lock);
+      if (!flex_reader_ptr->is_thread_safe())
+      {
+        lock.lock();
+      }
+      if (!flex_reader_ptr->read_ranges(read_spans, read_bufs))
+      {
+        error("Failed to read tile data in %zu ranges starting at %llu", read_spans.size(), read_spans[0].first);
+      }
+      for (size_t r = 0; r < read_groups.size(); ++r)
+      {
+        p_spans[read_groups[r]] = read_bufs[r].data();
+      }
+    }
+
+    for (size_t k = g; k < h; ++k)
+    {
+      const char *p_span = p_spans[k - g];
+      uint64_t span_beg = group_spans[k].first;
+      for (size_t m = group_begs[k]; m < group_begs[k + 1]; ++m)
+      {
+        const pmtiles::entry_zxy &e = entries[order[m]];
+        decompress_bytes(p_span + (e.offset - span_beg), e.length, hdr.tile_compression, tile_buf);
+        callback(order[m], e, tile_buf);
+      }
+    }
+    g = h;
+  }
+  return entries.size();
+}
@@ -6,6 +6,7 @@
 #include "ext/PMTiles/pmtiles.hpp"
 #include "flex_io.h"
 #include <mutex>
+#include <unordered_map>
 #include <thread>
 
 
@@ -15,28 +16,59 @@
 class pmt_pts
 {
 public:
+    static const int32_t MAX_ZOOM_LEVELS = 32;
+
     //FILE *fp = NULL;                              // file pointer
     std::unique_ptr<FlexReader> flex_reader_ptr;  // pointer to a FlexReader object
     pmtiles::headerv3 hdr;                        // PMTiles v3 header
     nlohmann::json jmeta;                         // metadata as a JSON object
     //uint64_t cur_pos = 0;                         // current offset of the file
     std::vector<pmtiles::entry_zxy> tile_entries; // list of tile entries
-    std::map<uint64_t, uint32_t> tileid2idx;      // dictionary of the file entries based on the tile ID
+    std::vector<uint64_t> sorted_tile_ids;        // tile IDs of tile_entries in ascending order
+    std::vector<uint32_t> sorted_tile_idxs;       // index into tile_entries for each element of sorted_tile_ids
+    std::pair<uint32_t, uint32_t> zoom_ranges[MAX_ZOOM_LEVELS] = {}; // [begin, end) of tile_entries for each zoom level
     std::function<std::string(const std::string &, uint8_t)> decompress_func;
-    std::mutex mtx; // mutex for multi-threading
+    std::vector<pmtiles::entryv3> root_dir_entries; // root directory (lazy mode only)
+    std::unordered_map<uint64_t, std::vector<pmtiles::entryv3> > leaf_dir_cache; // leaf directories loaded on demand, keyed by file offset (lazy mode only)
+    std::mutex mtx; // mutex for multi-threading (tile reads are locked only if the reader is not thread-safe)
     //std::string tile_data_str; // string to store uncompressed tile data // removed due for multi-threading
 
     bool hdr_read = false;  // flag to indicate if the header is read
     bool meta_read = false; // flag to indicate if the metadata is read
+    bool lazy_dirs = false; // flag to indicate that leaf directories are loaded on demand
+
+    static bool decompress_bytes(const char *data, size_t size, uint8_t compression_method, std::string &out); // decompress a byte range into out
+    static bool compress_bytes(const char *data, size_t size, uint8_t compression_method, int32_t level, std::string &out); // compress a byte range into out (level <= 0 uses the library default)
+    static uint8_t parse_compression(const std::string &name);  // "none", "gzip" or "zstd" to a pmtiles compression code, COMPRESSION_UNKNOWN otherwise
+    static const char *compression_name(uint8_t compression_method);
 
     void init();                     // initialize default parameters
     bool open(const char *fname);    // open a PMTiles file
     void close();                    // close a PMTiles file
     bool read_header_meta_entries(); // read the header of a PMTiles file
+    bool read_header_meta_root();    // read the header, metadata and root directory only; leaf directories are loaded on demand
     bool read_metadata();            // read the metadata of a PMTiles file
+    bool find_tile_entry(uint8_t z, uint32_t x, uint32_t y, pmtiles::entry_zxy &e); // locate a tile by walking the directories (lazy mode)
+    const std::vector<pmtiles::entryv3> &leaf_directory(uint64_t offset, uint32_t length); // load a leaf directory on first use (lazy mode, mtx must be held)
+    // populate tile_entries with the tiles in a range, clamped to the bounds in the header, by walking the directory entries
+    // whose tile IDs cover the range (lazy mode); may_overlap, if given, prunes the aligned squares of tiles
+    // [x, x + size) x [y, y + size) that cannot contain a wanted tile
+    uint64_t load_tile_entries(uint8_t z, uint32_t x_min, uint32_t x_max, uint32_t y_min, uint32_t y_max,
+                               const std::function<bool(uint32_t, uint32_t, uint32_t)> &may_overlap = nullptr);
+    const char *view_or_read(uint64_t offset, uint64_t length, std::string &buf);
+    void build_tile_index();                          // build the sorted tile ID index and per-zoom ranges from tile_entries
+    int64_t find_tile_index(uint64_t tile_id) const;  // index into tile_entries, or -1 if not found
+    // [begin, end) of tile_entries at zoom level z
+    inline std::pair<uint32_t, uint32_t> zoom_range(int32_t z) const {
+        return (z >= 0 && z < MAX_ZOOM_LEVELS) ? zoom_ranges[z] : std::make_pair((uint32_t)0, (uint32_t)0);
+    }
     // bool get_tile_entries();      // get the tile entries of a PMTiles file
     //size_t fetch_tile(uint8_t z, uint32_t x, uint32_t y); // fetch the uncompressed tile data of a PMTiles file
     size_t fetch_tile_to_buffer(uint8_t z, uint32_t x, uint32_t y, std::string& buffer); // fetch the uncompressed tile data of a PMTiles file
+    // fetch many tiles in file order, coalescing byte ranges separated by at most max_gap bytes into reads of up to max_span bytes;
+    // callback receives the index into tiles, the tile entry, and the uncompressed tile data
+    uint64_t fetch_tiles(const std::vector<pmtiles::zxy> &tiles, const std::function<void(size_t, const pmtiles::entry_zxy &, std::string &)> &callback,
+                         uint64_t max_gap = 65536, uint64_t max_span = 16777216);
     // uint32_t parse_fetched_tile_as_mvt();                          // parse the fetched tile data as an MVTile object
     void print_header_info(FILE *fp);
     void print_metadata(FILE *fp);
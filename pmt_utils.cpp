@@ -1,5 +1,6 @@
 #include "pmt_utils.h"
 #include <cmath>
+#include <climits>
 #include "qgenlib/qgen_error.h"
 
 void pmt_utils::pmt_pt_t::set_global_coord(uint8_t _zoom, double _gx, double _gy)
@@ -120,4 +121,83 @@ void pmt_utils::tilecoordtoespg3857(int64_t tx, int64_t ty, double lx, double ly
     // Calculate the global coordinates from the tile coordinates and relative position
     *ox = tileOriginX + lx * (2 * EPSG_3857_bound / (numTiles * tileSize));
     *oy = tileOriginY - ly * (2 * EPSG_3857_bound / (numTiles * tileSize));
-}
\ No newline at end of file
+}
+
+pmt_utils::pmt_tile_transform_t::pmt_tile_transform_t(uint8_t zoom, int64_t tile_x, int64_t tile_y)
+{
+    scale_factor = epsg3857_scale_factor(zoom);
+    tiletoepsg3857(tile_x, tile_y, zoom, &offset_x, &offset_y);
+}
+
+// the loops below have no branches or calls, so that they are vectorized
+void pmt_utils::pmt_tile_transform_t::to_global(const int32_t *x, const int32_t *y, size_t n, double *gx, double *gy) const
+{
+    const double ox = offset_x, oy = offset_y, s = scale_factor;
+    for (size_t i = 0; i < n; ++i)
+    {
+        gx[i] = ox + s * x[i];
+        gy[i] = oy - s * y[i];
+    }
+}
+
+void pmt_utils::pmt_tile_transform_t::to_global(const int32_t *xy, size_t n, double *gx, double *gy) const
+{
+    const double ox = offset_x, oy = offset_y, s = scale_factor;
+    for (size_t i = 0; i < n; ++i)
+    {
+        gx[i] = ox + s * xy[2 * i];
+        gy[i] = oy - s * xy[2 * i + 1];
+    }
+}
+
+// the smallest integer in [INT32_MIN, INT32_MAX + 1] for which the monotonic pred holds,
+// starting the search from an estimate
+template <typename Pred>
+static int64_t first_local_coord(double estimate, Pred pred)
+{
+    int64_t v = !(estimate > INT32_MIN) ? INT32_MIN : (estimate > INT32_MAX ? (int64_t)INT32_MAX + 1 : (int64_t)estimate);
+    while (v > INT32_MIN && pred((int32_t)(v - 1)))
+        --v;
+    while (v <= INT32_MAX && !pred((int32_t)v))
+        ++v;
+    return v;
+}
+
+pmt_utils::pmt_local_rect_t pmt_utils::pmt_tile_transform_t::to_local(const pmt_pt_t *p_min, const pmt_pt_t *p_max) const
+{
+    // the bounds are found from the inverse transform, then adjusted so that they match the comparisons
+    // of the transformed coordinates exactly
+    double min_gx = (p_min != NULL && !std::isnan(p_min->global_x)) ? p_min->global_x : -INFINITY;
+    double min_gy = (p_min != NULL && !std::isnan(p_min->global_y)) ? p_min->global_y : -INFINITY;
+    double max_gx = (p_max != NULL && !std::isnan(p_max->global_x)) ? p_max->global_x : INFINITY;
+    double max_gy = (p_max != NULL && !std::isnan(p_max->global_y)) ? p_max->global_y : INFINITY;
+    int64_t x_lo = first_local_coord(std::ceil((min_gx - offset_x) / scale_factor), [&](int32_t x) { return global_x(x) >= min_gx; });
+    int64_t x_hi = first_local_coord(std::floor((max_gx - offset_x) / scale_factor) + 1, [&](int32_t x) { return global_x(x) > max_gx; }) - 1;
+    int64_t y_lo = first_local_coord(std::ceil((offset_y - max_gy) / scale_factor), [&](int32_t y) { return global_y(y) <= max_gy; });
+    int64_t y_hi = first_local_coord(std::floor((offset_y - min_gy) / scale_factor) + 1, [&](int32_t y) { return global_y(y) < min_gy; }) - 1;
+
+    pmt_local_rect_t rect;
+    if (x_lo > x_hi || y_lo > y_hi)
+    {
+        rect.x_lo = rect.y_lo = 1;
+        rect.x_hi = rect.y_hi = 0;
+    }
+    else
+    {
+        rect.x_lo = (int32_t)x_lo;
+        rect.x_hi = (int32_t)x_hi;
+        rect.y_lo = (int32_t)y_lo;
+        rect.y_hi = (int32_t)y_hi;
+    }
+    return rect;
+}
+
+void pmt_utils::pmt_local_rect_t::mask_outside(const int32_t *xy, size_t n, uint8_t *mask) const
+{
+    const int32_t xl = x_lo, xh = x_hi, yl = y_lo, yh = y_hi;
+    for (size_t i = 0; i < n; ++i)
+    {
+        int32_t x = xy[2 * i], y = xy[2 * i + 1];
+        mask[i] &= (uint8_t)((x >= xl) & (x <= xh) & (y >= yl) & (y <= yh));
+    }
+}
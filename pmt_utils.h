@@ -34,6 +34,16 @@ namespace pmt_utils
         }
     };
 
+    // a point in EPSG:3857 only, without the tile coordinates that pmt_pt_t derives
+    struct pmt_xy_t
+    {
+        double global_x;
+        double global_y;
+
+        pmt_xy_t() : global_x(0), global_y(0) {}
+        pmt_xy_t(double _gx, double _gy) : global_x(_gx), global_y(_gy) {}
+    };
+
     class pmt_rect_t {
     public:
         pmt_pt_t ul;
@@ -74,8 +84,8 @@ namespace pmt_utils
     class pmt_polygon_t {
     public:
         uint8_t zoom;
-        std::vector<pmt_pt_t> points;
-        pmt_rect_t bbox;
+        std::vector<pmt_xy_t> points;
+        pmt_rect_t bbox; // only the global coordinates are maintained
 
         void set_zoom(uint8_t _zoom) { zoom = _zoom; }
 
@@ -87,27 +97,33 @@ namespace pmt_utils
             double gx = points.back().global_x;
             double gy = points.back().global_y;
             if (points.size() == 1) {
-                bbox.set_global_coord(zoom, gx, gy, gx, gy);
+                bbox.ul.global_x = bbox.lr.global_x = gx;
+                bbox.ul.global_y = bbox.lr.global_y = gy;
+                bbox.ul.zoom = bbox.lr.zoom = zoom;
             } else {
-                double ulx = gx < bbox.ul.global_x ? gx : bbox.ul.global_x;
-                double uly = gy < bbox.ul.global_y ? gy : bbox.ul.global_y;
-                double lrx = gx > bbox.lr.global_x ? gx : bbox.lr.global_x;
-                double lry = gy > bbox.lr.global_y ? gy : bbox.lr.global_y;
-                bbox.set_global_coord(zoom, ulx, uly, lrx, lry);
+                if (gx < bbox.ul.global_x) bbox.ul.global_x = gx;
+                if (gy < bbox.ul.global_y) bbox.ul.global_y = gy;
+                if (gx > bbox.lr.global_x) bbox.lr.global_x = gx;
+                if (gy > bbox.lr.global_y) bbox.lr.global_y = gy;
             }
         }
 
         void add_global_coord(double _gx, double _gy) {
-            points.push_back(pmt_pt_t(zoom, _gx, _gy));
+            points.push_back(pmt_xy_t(_gx, _gy));
             update_bbox();
         }
+        // add n vertices at once, e.g. the output of pmt_tile_transform_t::to_global()
+        void add_global_coords(const double* gx, const double* gy, size_t n) {
+            points.reserve(points.size() + n);
+            for (size_t i = 0; i < n; ++i)
+                add_global_coord(gx[i], gy[i]);
+        }
         void add_tile_coord(int64_t _tx, int64_t _ty, int32_t _lx = 0, double _ly = 0) {
-            points.push_back(pmt_pt_t(zoom, _tx, _ty, _lx, _ly));
-            update_bbox();
+            pmt_pt_t pt(zoom, _tx, _ty, _lx, _ly);
+            add_global_coord(pt.global_x, pt.global_y);
         }
         void add_point(const pmt_pt_t& pt) {
-            points.push_back(pt);
-            update_bbox();
+            add_global_coord(pt.global_x, pt.global_y);
         }
     };
 
@@ -126,6 +142,43 @@ namespace pmt_utils
     void tiletoepsg3857(int64_t ix, int64_t iy, uint8_t zoom, double *ox, double *oy);
     void epsg3857totilecoord(double ix, double iy, uint8_t zoom, int64_t *tx, int64_t *ty, double *lx, double *ly);
     void tilecoordtoespg3857(int64_t tx, int64_t ty, double lx, double ly, uint8_t zoom, double *ox, double* oy);
+
+    // inclusive integer bounds of tile-local coordinates
+    struct pmt_local_rect_t
+    {
+        int32_t x_lo, y_lo, x_hi, y_hi; // x_lo > x_hi if no point is within the bounds
+
+        inline bool contains(int32_t x, int32_t y) const
+        {
+            return x >= x_lo && x <= x_hi && y >= y_lo && y <= y_hi;
+        }
+        // clear mask[i] of the points outside the bounds, among n points interleaved as x, y
+        void mask_outside(const int32_t *xy, size_t n, uint8_t *mask) const;
+    };
+
+    // transform of the tile-local (extent 4096) coordinates of a tile to EPSG:3857,
+    // with the tile offset and scale computed once per tile
+    class pmt_tile_transform_t
+    {
+    public:
+        double offset_x;
+        double offset_y;
+        double scale_factor;
+
+        pmt_tile_transform_t(uint8_t zoom, int64_t tile_x, int64_t tile_y);
+
+        inline double global_x(int32_t x) const { return offset_x + scale_factor * x; }
+        inline double global_y(int32_t y) const { return offset_y - scale_factor * y; }
+
+        // transform n points from separate x and y arrays
+        void to_global(const int32_t *x, const int32_t *y, size_t n, double *gx, double *gy) const;
+        // transform n points interleaved as x, y (as decoded from MLT VERTEX streams)
+        void to_global(const int32_t *xy, size_t n, double *gx, double *gy) const;
+
+        // tile-local bounds of the points whose global coordinates, as computed by global_x() and global_y(),
+        // are within the rectangle of p_min and p_max (unbounded on the sides of a NULL corner)
+        pmt_local_rect_t to_local(const pmt_pt_t *p_min, const pmt_pt_t *p_max) const;
+    };
 };
 
 #endif // __PMT_UTILS_H
\ No newline at end of file
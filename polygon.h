@@ -1,8 +1,11 @@
 #ifndef __POLYGON__H__
 #define __POLYGON__H__
 
+#include <algorithm>
 #include <climits>
+#include <cmath>
 #include <cstdint>
+#include <limits>
 #include <vector>
 #include <fstream>
 //#include <iostream>
@@ -51,6 +54,48 @@ public:
     }
 };
 
+// position of a rectangle relative to a polygon (or to a set of polygons)
+enum RectangleRelation
+{
+    RECT_OUTSIDE = 0,  // no point of the rectangle is inside
+    RECT_BOUNDARY = 1, // an edge reaches the rectangle, so each point must be tested
+    RECT_INSIDE = 2    // every point of the rectangle is inside
+};
+
+// whether the segment a-b intersects the closed rectangle r (Liang-Barsky clipping)
+inline bool segment_intersects_rectangle(const point_t &a, const point_t &b, const Rectangle &r)
+{
+    double dx = b.x - a.x, dy = b.y - a.y;
+    double p[4] = {-dx, dx, -dy, dy};
+    double q[4] = {a.x - r.p_min.x, r.p_max.x - a.x, a.y - r.p_min.y, r.p_max.y - a.y};
+    double t0 = 0, t1 = 1;
+    for (int k = 0; k < 4; ++k)
+    {
+        if (p[k] == 0)
+        {
+            if (q[k] < 0)
+                return false; // parallel to and outside of this side
+            continue;
+        }
+        double t = q[k] / p[k];
+        if (p[k] < 0)
+        {
+            if (t > t1)
+                return false;
+            if (t > t0)
+                t0 = t;
+        }
+        else
+        {
+            if (t < t0)
+                return false;
+            if (t < t1)
+                t1 = t;
+        }
+    }
+    return true;
+}
+
 class Polygon
 {
 public:
@@ -83,12 +128,29 @@ public:
         return contains_point(p.x, p.y);
     }
 
+    // RECT_BOUNDARY if any edge intersects the rectangle, and otherwise RECT_INSIDE or RECT_OUTSIDE
+    // by whether a corner is inside. The rectangle is slightly enlarged for the edge test,
+    // so that rounding errors can only turn an inside or outside rectangle into a boundary one.
+    RectangleRelation classify_rectangle(const Rectangle &r)
+    {
+        if (vertices.empty())
+            return RECT_OUTSIDE;
+        double eps = 1e-9 * std::max(std::max(r.p_max.x - r.p_min.x, r.p_max.y - r.p_min.y), 1.0);
+        Rectangle er(r.p_min.x - eps, r.p_min.y - eps, r.p_max.x + eps, r.p_max.y + eps);
+        for (size_t i = 0, j = vertices.size() - 1; i < vertices.size(); j = i++)
+        {
+            if (segment_intersects_rectangle(vertices[j], vertices[i], er))
+                return RECT_BOUNDARY;
+        }
+        return contains_point(r.p_min) ? RECT_INSIDE : RECT_OUTSIDE;
+    }
+
     Rectangle get_bounding_box()
     {
         double xmin = std::numeric_limits<double>::max();
         double ymin = std::numeric_limits<double>::max();
-        double xmax = std::numeric_limits<double>::min();
-        double ymax = std::numeric_limits<double>::min();
+        double xmax = std::numeric_limits<double>::lowest();
+        double ymax = std::numeric_limits<double>::lowest();
         for (auto &vertex : vertices)
         {
             //notice("Vertex: %lf, %lf, (%lg %lg %lg %lg)", vertex.x, vertex.y, xmin, ymin, xmax, ymax);
@@ -252,6 +314,147 @@ inline int32_t load_polygons_from_geojson(const char *filename, std::vector<Poly
 }
 
 
+// Static R-tree over the bounding boxes of polygons, packed by Sort-Tile-Recursive (STR):
+// each level is sorted into vertical slices by the x center and then by the y center within each slice,
+// and consecutive runs of NODE_CAPACITY boxes are grouped into the nodes of the level above.
+// The polygons must outlive the index.
+class PolygonIndex
+{
+public:
+    static const size_t NODE_CAPACITY = 16;
+
+    PolygonIndex() {}
+    explicit PolygonIndex(std::vector<Polygon> &polygons) { build(polygons); }
+
+    inline bool empty() const { return items.empty(); }
+    inline size_t size() const { return items.size(); }
+
+    void build(std::vector<Polygon> &polygons)
+    {
+        items.clear();
+        levels.clear();
+        std::vector<node_t> boxes;
+        for (size_t i = 0; i < polygons.size(); ++i)
+        {
+            if (polygons[i].vertices.empty())
+                continue;
+            Rectangle r = polygons[i].get_bounding_box();
+            boxes.push_back(node_t{r.p_min.x, r.p_min.y, r.p_max.x, r.p_max.y, (uint32_t)items.size(), 0});
+            items.push_back(&polygons[i]);
+        }
+        if (boxes.empty())
+            return;
+        // the entries of the bottom level refer to items, and those of the levels above to the level below
+        str_sort(boxes);
+        std::vector<Polygon *> sorted_items(items.size());
+        for (size_t i = 0; i < boxes.size(); ++i)
+        {
+            sorted_items[i] = items[boxes[i].first];
+            boxes[i].first = (uint32_t)i;
+        }
+        items.swap(sorted_items);
+        levels.push_back(boxes);
+        while (levels.back().size() > 1)
+        {
+            std::vector<node_t> &below = levels.back();
+            std::vector<node_t> above;
+            for (size_t i = 0; i < below.size(); i += NODE_CAPACITY)
+            {
+                size_t end = std::min(i + NODE_CAPACITY, below.size());
+                node_t node{below[i].xmin, below[i].ymin, below[i].xmax, below[i].ymax, (uint32_t)i, (uint32_t)(end - i)};
+                for (size_t j = i + 1; j < end; ++j)
+                {
+                    node.xmin = std::min(node.xmin, below[j].xmin);
+                    node.ymin = std::min(node.ymin, below[j].ymin);
+                    node.xmax = std::max(node.xmax, below[j].xmax);
+                    node.ymax = std::max(node.ymax, below[j].ymax);
+                }
+                above.push_back(node);
+            }
+            str_sort(above);
+            levels.push_back(above);
+        }
+    }
+
+    // polygons whose bounding boxes intersect r, appended to out
+    void query_rectangle(const Rectangle &r, std::vector<Polygon *> &out) const
+    {
+        visit(r.p_min.x, r.p_min.y, r.p_max.x, r.p_max.y, [&](Polygon *p) { out.push_back(p); return false; });
+    }
+
+    // RECT_INSIDE if any polygon contains the rectangle, RECT_BOUNDARY if an edge of any polygon
+    // intersects it, and RECT_OUTSIDE otherwise
+    RectangleRelation classify_rectangle(const Rectangle &r) const
+    {
+        RectangleRelation rel = RECT_OUTSIDE;
+        visit(r.p_min.x, r.p_min.y, r.p_max.x, r.p_max.y, [&](Polygon *p) {
+            RectangleRelation c = p->classify_rectangle(r);
+            if (c != RECT_OUTSIDE)
+                rel = c;
+            return c == RECT_INSIDE;
+        });
+        return rel;
+    }
+
+    // whether any polygon contains the point
+    bool contains_point(double x, double y) const
+    {
+        return visit(x, y, x, y, [&](Polygon *p) { return p->contains_point(x, y); });
+    }
+
+private:
+    struct node_t
+    {
+        double xmin, ymin, xmax, ymax;
+        uint32_t first; // index of the item (bottom level) or of the first child in the level below
+        uint32_t count; // number of children, 0 at the bottom level
+    };
+    std::vector<std::vector<node_t> > levels; // from the bottom level of items to the root
+    std::vector<Polygon *> items;
+
+    static void str_sort(std::vector<node_t> &boxes)
+    {
+        size_t n_nodes = (boxes.size() + NODE_CAPACITY - 1) / NODE_CAPACITY;
+        size_t n_slices = (size_t)std::ceil(std::sqrt((double)n_nodes));
+        size_t slice_size = n_slices * NODE_CAPACITY;
+        std::sort(boxes.begin(), boxes.end(), [](const node_t &a, const node_t &b) { return a.xmin + a.xmax < b.xmin + b.xmax; });
+        for (size_t i = 0; i < boxes.size(); i += slice_size)
+        {
+            std::sort(boxes.begin() + i, boxes.begin() + std::min(i + slice_size, boxes.size()),
+                      [](const node_t &a, const node_t &b) { return a.ymin + a.ymax < b.ymin + b.ymax; });
+        }
+    }
+
+    // call func on the items whose boxes intersect the query box, until it returns true
+    template <typename Func>
+    bool visit(double xmin, double ymin, double xmax, double ymax, Func &&func) const
+    {
+        if (levels.empty())
+            return false;
+        // depth-first, holding at most NODE_CAPACITY siblings per level, as the root level has a single node
+        std::pair<uint32_t, uint32_t> stack[NODE_CAPACITY * 16]; // (level, index)
+        size_t n_stack = 0;
+        stack[n_stack++] = std::make_pair((uint32_t)levels.size() - 1, 0);
+        while (n_stack > 0)
+        {
+            --n_stack;
+            uint32_t level = stack[n_stack].first;
+            const node_t &node = levels[level][stack[n_stack].second];
+            if (node.xmin > xmax || node.xmax < xmin || node.ymin > ymax || node.ymax < ymin)
+                continue;
+            if (level == 0)
+            {
+                if (func(items[node.first]))
+                    return true;
+                continue;
+            }
+            for (uint32_t c = node.first; c < node.first + node.count; ++c)
+                stack[n_stack++] = std::make_pair(level - 1, c);
+        }
+        return false;
+    }
+};
+
 inline bool polygons_contain_point(std::vector<Polygon> &polygons, double x, double y)
 {
     for (auto &polygon : polygons)
@@ -0,0 +1,212 @@
+#include "pt_predicate.h"
+#include "qgenlib/qgen_error.h"
+
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <strings.h>
+
+// parse a full string as a finite number
+static bool parse_number(const char *s, size_t len, double &v)
+{
+    if (len == 0 || len >= 64)
+        return false;
+    char buf[64];
+    memcpy(buf, s, len);
+    buf[len] = '\0';
+    char *end = NULL;
+    v = strtod(buf, &end);
+    return end == buf + len && v == v && v - v == 0; // rejects trailing characters, nan and inf
+}
+
+// tokenizer over a predicate expression
+// tokens are words, quoted strings, comparison operators, parentheses and commas
+class pt_pred_lexer
+{
+public:
+    pt_pred_lexer(const std::string &_expr) : expr(_expr), pos(0) {}
+
+    // read the next token into tok, returning false at the end of the expression
+    // quoted is set if the token was a quoted string, which is never an operator or a keyword
+    bool next(std::string &tok, bool &quoted)
+    {
+        quoted = false;
+        tok.clear();
+        while (pos < expr.size() && isspace((unsigned char)expr[pos]))
+            ++pos;
+        if (pos >= expr.size())
+            return false;
+        char ch = expr[pos];
+        if (ch == '\'' || ch == '"')
+        {
+            size_t close = expr.find(ch, pos + 1);
+            if (close == std::string::npos)
+                error("Unterminated quote in predicate '%s'", expr.c_str());
+            tok = expr.substr(pos + 1, close - pos - 1);
+            pos = close + 1;
+            quoted = true;
+        }
+        else if (ch == '(' || ch == ')' || ch == ',')
+        {
+            tok.assign(1, ch);
+            ++pos;
+        }
+        else if (ch == '=' || ch == '!' || ch == '<' || ch == '>')
+        {
+            tok.assign(1, ch);
+            ++pos;
+            if (pos < expr.size() && expr[pos] == '=')
+            {
+                tok.push_back('=');
+                ++pos;
+            }
+        }
+        else
+        {
+            size_t start = pos;
+            while (pos < expr.size() && !isspace((unsigned char)expr[pos]) && strchr("()=!<>,'\"", expr[pos]) == NULL)
+                ++pos;
+            tok = expr.substr(start, pos - start);
+        }
+        return true;
+    }
+
+private:
+    const std::string &expr;
+    size_t pos;
+};
+
+static inline bool is_keyword(const std::string &tok, bool quoted, const char *keyword)
+{
+    return !quoted && strcasecmp(tok.c_str(), keyword) == 0;
+}
+
+static void add_literal(pt_predicate::clause_t &clause, const std::string &tok)
+{
+    double v = 0;
+    bool numeric = parse_number(tok.data(), tok.size(), v);
+    clause.texts.push_back(tok);
+    clause.numbers.push_back(v);
+    clause.is_number.push_back(numeric);
+}
+
+void pt_predicate::parse(const std::string &expr)
+{
+    clauses.clear();
+    pt_pred_lexer lexer(expr);
+    std::string tok;
+    bool quoted;
+    while (lexer.next(tok, quoted))
+    {
+        clause_t clause;
+        clause.column = tok;
+
+        // operator
+        if (!lexer.next(tok, quoted))
+            error("Missing operator after '%s' in predicate '%s'", clause.column.c_str(), expr.c_str());
+        bool negated = false;
+        if (is_keyword(tok, quoted, "not"))
+        {
+            negated = true;
+            if (!lexer.next(tok, quoted) || !is_keyword(tok, quoted, "in"))
+                error("Expected 'in' after 'not' in predicate '%s'", expr.c_str());
+        }
+        if (is_keyword(tok, quoted, "in"))
+        {
+            clause.op = negated ? PT_PRED_NOT_IN : PT_PRED_IN;
+            if (!lexer.next(tok, quoted) || quoted || tok != "(")
+                error("Expected '(' after 'in' in predicate '%s'", expr.c_str());
+            while (true)
+            {
+                if (!lexer.next(tok, quoted) || (!quoted && (tok == "(" || tok == ")" || tok == ",")))
+                    error("Expected a value in the list of column %s in predicate '%s'", clause.column.c_str(), expr.c_str());
+                add_literal(clause, tok);
+                if (!lexer.next(tok, quoted) || quoted || (tok != "," && tok != ")"))
+                    error("Expected ',' or ')' in the list of column %s in predicate '%s'", clause.column.c_str(), expr.c_str());
+                if (tok == ")")
+                    break;
+            }
+        }
+        else
+        {
+            if (quoted)
+                error("Expected an operator after '%s' in predicate '%s'", clause.column.c_str(), expr.c_str());
+            if (tok == "=" || tok == "==")
+                clause.op = PT_PRED_EQ;
+            else if (tok == "!=")
+                clause.op = PT_PRED_NE;
+            else if (tok == "<")
+                clause.op = PT_PRED_LT;
+            else if (tok == "<=")
+                clause.op = PT_PRED_LE;
+            else if (tok == ">")
+                clause.op = PT_PRED_GT;
+            else if (tok == ">=")
+                clause.op = PT_PRED_GE;
+            else
+                error("Unknown operator '%s' in predicate '%s'", tok.c_str(), expr.c_str());
+            if (!lexer.next(tok, quoted))
+                error("Missing value after column %s in predicate '%s'", clause.column.c_str(), expr.c_str());
+            add_literal(clause, tok);
+            if (clause.op >= PT_PRED_LT && clause.op <= PT_PRED_GE && !clause.is_number[0])
+                error("Non-numeric value '%s' compared with %s in predicate '%s'", tok.c_str(), clause.column.c_str(), expr.c_str());
+        }
+        clauses.push_back(clause);
+
+        // clauses are joined by 'and'
+        if (!lexer.next(tok, quoted))
+            break;
+        if (!is_keyword(tok, quoted, "and"))
+            error("Expected 'and' instead of '%s' in predicate '%s'", tok.c_str(), expr.c_str());
+    }
+    if (clauses.empty())
+        error("Empty predicate '%s'", expr.c_str());
+}
+
+// compare a value with the numeric literals of a clause converted to the type of the value
+template <typename T>
+static bool eval_numeric(const pt_predicate::clause_t &clause, T v)
+{
+    switch (clause.op)
+    {
+    case PT_PRED_LT: return v < (T)clause.numbers[0];
+    case PT_PRED_LE: return v <= (T)clause.numbers[0];
+    case PT_PRED_GT: return v > (T)clause.numbers[0];
+    case PT_PRED_GE: return v >= (T)clause.numbers[0];
+    default:
+        break;
+    }
+    // a number never equals a non-numeric literal
+    bool found = false;
+    for (size_t i = 0; i < clause.texts.size() && !found; ++i)
+        found = clause.is_number[i] && (T)clause.numbers[i] == v;
+    return (clause.op == PT_PRED_EQ || clause.op == PT_PRED_IN) ? found : !found;
+}
+
+bool pt_predicate::eval_number(size_t c, double v) const
+{
+    return eval_numeric<double>(clauses[c], v);
+}
+
+bool pt_predicate::eval_float(size_t c, float v) const
+{
+    return eval_numeric<float>(clauses[c], v);
+}
+
+bool pt_predicate::eval_text(size_t c, const char *s, size_t len) const
+{
+    const clause_t &clause = clauses[c];
+    double v = 0;
+    bool numeric = parse_number(s, len, v);
+    if (clause.op >= PT_PRED_LT && clause.op <= PT_PRED_GE)
+        return numeric && eval_number(c, v);
+    bool found = false;
+    for (size_t i = 0; i < clause.texts.size() && !found; ++i)
+    {
+        if (numeric && clause.is_number[i])
+            found = clause.numbers[i] == v;
+        else
+            found = clause.texts[i].size() == len && memcmp(clause.texts[i].data(), s, len) == 0;
+    }
+    return (clause.op == PT_PRED_EQ || clause.op == PT_PRED_IN) ? found : !found;
+}
@@ -0,0 +1,56 @@
+#ifndef __PT_PREDICATE_H
+#define __PT_PREDICATE_H
+
+// Attribute predicate on points, such as "gene in (ACTB,GAPDH) and count>=2"
+// A predicate is a conjunction of clauses, each comparing one column to literal values.
+// Missing values do not satisfy any clause, including != and 'not in'.
+// Decoders evaluate a clause once per distinct value (e.g. per entry of the MVT values table
+// or of a string dictionary) and then check each point by the cached result.
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+enum pt_pred_op_t : uint8_t
+{
+    PT_PRED_EQ = 0, // == or =
+    PT_PRED_NE,     // !=
+    PT_PRED_LT,     // <
+    PT_PRED_LE,     // <=
+    PT_PRED_GT,     // >
+    PT_PRED_GE,     // >=
+    PT_PRED_IN,     // in (a,b,...)
+    PT_PRED_NOT_IN  // not in (a,b,...)
+};
+
+class pt_predicate
+{
+public:
+    struct clause_t
+    {
+        std::string column;
+        pt_pred_op_t op;
+        std::vector<std::string> texts; // literal values
+        std::vector<double> numbers;    // numeric literal values, in the same order as texts
+        std::vector<bool> is_number;    // whether each literal is numeric
+    };
+    std::vector<clause_t> clauses;
+
+    pt_predicate() {}
+    // parse an expression, exiting with an error if it is malformed
+    explicit pt_predicate(const std::string &expr) { parse(expr); }
+
+    void parse(const std::string &expr);
+    inline bool empty() const { return clauses.empty(); }
+
+    // evaluate a clause against a value in text form, which is compared numerically if it is a number
+    bool eval_text(size_t c, const char *s, size_t len) const;
+    // evaluate a clause against a numeric value
+    bool eval_number(size_t c, double v) const;
+    // evaluate a clause against a 32-bit float value, which is compared with the literals rounded to float,
+    // so that "x = 0.1" matches a stored 0.1f in every tile format
+    bool eval_float(size_t c, float v) const;
+};
+
+#endif
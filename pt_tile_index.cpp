@@ -0,0 +1,195 @@
+#include "pt_tile_index.h"
+#include "pmt_pts.h"
+#include "flex_io.h"
+#include "qgenlib/qgen_error.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <unistd.h>
+
+void pt_tile_index::add(const std::string &value, uint64_t tile_id, uint64_t count)
+{
+    std::vector<std::pair<uint64_t, uint64_t> > &tiles = postings[value];
+    if (!tiles.empty() && tiles.back().first >= tile_id)
+        error("Tiles of value %s are not added in ascending order", value.c_str());
+    tiles.emplace_back(tile_id, count);
+}
+
+void pt_tile_index::add_parent_zooms(uint8_t z_max, uint8_t min_zoom)
+{
+    std::map<uint64_t, uint64_t> parents;
+    for (auto &kv : postings)
+    {
+        std::vector<std::pair<uint64_t, uint64_t> > &tiles = kv.second;
+        parents.clear();
+        for (const auto &tc : tiles)
+        {
+            pmtiles::zxy t = pmtiles::tileid_to_zxy(tc.first);
+            if (t.z != z_max)
+                continue;
+            for (int32_t z = (int32_t)z_max - 1; z >= (int32_t)min_zoom; --z)
+            {
+                uint8_t shift = z_max - z;
+                parents[pmtiles::zxy_to_tileid((uint8_t)z, t.x >> shift, t.y >> shift)] += tc.second;
+            }
+        }
+        // tile IDs of lower zoom levels precede those of higher zoom levels
+        tiles.insert(tiles.begin(), parents.begin(), parents.end());
+        std::sort(tiles.begin(), tiles.end());
+    }
+}
+
+void pt_tile_index::set_archive(const pmtiles::headerv3 &hdr)
+{
+    tile_entries_count = hdr.tile_entries_count;
+    tile_data_bytes = hdr.tile_data_bytes;
+}
+
+void pt_tile_index::write(const std::string &path) const
+{
+    char buf[128];
+    std::string text("#column\t");
+    text += column;
+    snprintf(buf, sizeof(buf), "\ttile_entries_count=%llu\ttile_data_bytes=%llu\n", (unsigned long long)tile_entries_count, (unsigned long long)tile_data_bytes);
+    text += buf;
+    for (const auto &kv : postings)
+    {
+        text += kv.first;
+        for (size_t i = 0; i < kv.second.size(); ++i)
+        {
+            snprintf(buf, sizeof(buf), "%c%llu:%llu", i == 0 ? '\t' : ',', (unsigned long long)kv.second[i].first, (unsigned long long)kv.second[i].second);
+            text += buf;
+        }
+        text += "\n";
+    }
+    std::string compressed;
+    pmt_pts::compress_bytes(text.data(), text.size(), pmtiles::COMPRESSION_GZIP, 0, compressed);
+    FILE *fp = fopen(path.c_str(), "wb");
+    if (fp == NULL || fwrite(compressed.data(), 1, compressed.size(), fp) != compressed.size())
+        error("Cannot write the tile index %s", path.c_str());
+    fclose(fp);
+}
+
+bool pt_tile_index::read(const std::string &path, const pmtiles::headerv3 &hdr, bool required)
+{
+    std::unique_ptr<FlexReader> reader = FlexReaderFactory::create_reader(path.c_str(), 0);
+    std::string compressed, text;
+    if (!reader || !reader->read_at(0, reader->size_hint(), compressed))
+        error("Cannot read the tile index %s", path.c_str());
+    pmt_pts::decompress_bytes(compressed.data(), compressed.size(), pmtiles::COMPRESSION_GZIP, text);
+
+    column.clear();
+    postings.clear();
+    size_t pos = 0;
+    while (pos < text.size())
+    {
+        size_t eol = text.find('\n', pos);
+        if (eol == std::string::npos)
+            eol = text.size();
+        size_t tab = text.find('\t', pos);
+        if (tab == std::string::npos || tab > eol)
+            error("Malformed line in the tile index %s", path.c_str());
+        if (pos == 0)
+        {
+            if (text.compare(0, tab, "#column") != 0)
+                error("Missing the header of the tile index %s", path.c_str());
+            size_t next = text.find('\t', tab + 1);
+            if (next == std::string::npos || next > eol)
+                next = eol;
+            column = text.substr(tab + 1, next - tab - 1);
+            // key=value fields identifying the archive; indices without them belong to no archive
+            tile_entries_count = tile_data_bytes = 0;
+            while (next < eol)
+            {
+                size_t beg = next + 1;
+                next = text.find('\t', beg);
+                if (next == std::string::npos || next > eol)
+                    next = eol;
+                std::string field = text.substr(beg, next - beg);
+                if (field.compare(0, 19, "tile_entries_count=") == 0)
+                    tile_entries_count = strtoull(field.c_str() + 19, NULL, 10);
+                else if (field.compare(0, 16, "tile_data_bytes=") == 0)
+                    tile_data_bytes = strtoull(field.c_str() + 16, NULL, 10);
+            }
+        }
+        else
+        {
+            std::vector<std::pair<uint64_t, uint64_t> > &tiles = postings[text.substr(pos, tab - pos)];
+            const char *p = text.c_str() + tab + 1;
+            const char *end = text.c_str() + eol;
+            while (p < end)
+            {
+                char *q;
+                uint64_t tile_id = strtoull(p, &q, 10);
+                if (*q != ':')
+                    error("Malformed tile list in the tile index %s", path.c_str());
+                uint64_t count = strtoull(q + 1, &q, 10);
+                tiles.emplace_back(tile_id, count);
+                p = (*q == ',') ? q + 1 : q;
+                if (q == p && p < end)
+                    error("Malformed tile list in the tile index %s", path.c_str());
+            }
+        }
+        pos = eol + 1;
+    }
+    if (column.empty())
+        error("Missing the header of the tile index %s", path.c_str());
+
+    if (tile_entries_count != hdr.tile_entries_count || tile_data_bytes != hdr.tile_data_bytes)
+    {
+        if (required)
+            error("The tile index %s does not belong to the PMTiles file (%llu tile entries and %llu bytes of tile data in the index, %llu and %llu in the file). Rebuild the index with the PMTiles file",
+                  path.c_str(), (unsigned long long)tile_entries_count, (unsigned long long)tile_data_bytes, (unsigned long long)hdr.tile_entries_count, (unsigned long long)hdr.tile_data_bytes);
+        warning("Ignoring the tile index %s, which does not belong to the PMTiles file (e.g. left over from an earlier build)", path.c_str());
+        column.clear();
+        postings.clear();
+        return false;
+    }
+    return true;
+}
+
+bool pt_tile_index::select_tiles(const pt_predicate &pred, std::unordered_set<uint64_t> &tiles) const
+{
+    bool used = false;
+    std::unordered_set<uint64_t> clause_tiles;
+    tiles.clear();
+    for (const pt_predicate::clause_t &clause : pred.clauses)
+    {
+        if (clause.column != column || (clause.op != PT_PRED_EQ && clause.op != PT_PRED_IN))
+            continue;
+        // numeric values may match differently formatted strings, which are not looked up
+        if (std::find(clause.is_number.begin(), clause.is_number.end(), true) != clause.is_number.end())
+            continue;
+        clause_tiles.clear();
+        for (const std::string &value : clause.texts)
+        {
+            auto it = postings.find(value);
+            if (it == postings.end())
+                continue;
+            for (const auto &tc : it->second)
+            {
+                if (!used || tiles.count(tc.first))
+                    clause_tiles.insert(tc.first);
+            }
+        }
+        tiles.swap(clause_tiles); // intersection with the previous clauses
+        used = true;
+    }
+    return used;
+}
+
+std::string pt_tile_index::find_default(const std::string &pmtiles_path)
+{
+    if (pmtiles_path.find("://") != std::string::npos)
+        return std::string(); // remote sidecars are read only if given explicitly
+    std::string path = default_path(pmtiles_path);
+    return access(path.c_str(), R_OK) == 0 ? path : std::string();
+}
+
+void pt_tile_index::remove_default(const std::string &pmtiles_path)
+{
+    std::string path = default_path(pmtiles_path);
+    if (unlink(path.c_str()) == 0)
+        notice("Removed the tile index %s of an earlier build", path.c_str());
+}
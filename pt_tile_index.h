@@ -0,0 +1,57 @@
+#ifndef __PT_TILE_INDEX_H
+#define __PT_TILE_INDEX_H
+
+// Inverted index from the values of a categorical column (e.g. gene) to the tiles containing them
+// It is stored as a gzip-compressed sidecar of a PMTiles file (<pmtiles>.idx.gz), in the text format
+//   #column<TAB>gene<TAB>tile_entries_count=N<TAB>tile_data_bytes=M
+//   Actb<TAB>tile_id:count,tile_id:count,...
+// with one line per value and the tiles of each value in ascending order of tile ID
+// The tile entry count and tile data size of the PMTiles header identify the archive the index was built for,
+// so that a sidecar left over from an earlier version of the archive is not used
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include "pt_predicate.h"
+
+namespace pmtiles
+{
+    struct headerv3;
+}
+
+class pt_tile_index
+{
+public:
+    std::string column;
+    std::map<std::string, std::vector<std::pair<uint64_t, uint64_t> > > postings; // value -> (tile ID, number of points)
+    uint64_t tile_entries_count = 0; // fingerprint of the archive the index belongs to
+    uint64_t tile_data_bytes = 0;
+
+    // record the archive the index belongs to, before write()
+    void set_archive(const pmtiles::headerv3 &hdr);
+
+    // add the count of a value in a tile; each value must be added in ascending order of tile ID
+    void add(const std::string &value, uint64_t tile_id, uint64_t count);
+    // add the tiles of the lower zoom levels, as the parents of the tiles at z_max with their counts summed
+    void add_parent_zooms(uint8_t z_max, uint8_t min_zoom);
+
+    void write(const std::string &path) const;
+    // read an index from a local or remote path, and check that it belongs to the archive with header hdr
+    // an index of another archive is an error if required, and is otherwise skipped with a warning, returning false
+    bool read(const std::string &path, const pmtiles::headerv3 &hdr, bool required = true);
+
+    // the tiles that contain the values required by the predicate's '=' and 'in' clauses on the column
+    // returns false if the predicate has no such clause, so that every tile may match
+    bool select_tiles(const pt_predicate &pred, std::unordered_set<uint64_t> &tiles) const;
+
+    // sidecar path of a PMTiles file
+    static std::string default_path(const std::string &pmtiles_path) { return pmtiles_path + ".idx.gz"; }
+    // the sidecar of a local PMTiles file if it exists, and an empty string otherwise
+    static std::string find_default(const std::string &pmtiles_path);
+    // remove the sidecar of a PMTiles file written without an index, so that a stale one is not picked up
+    static void remove_default(const std::string &pmtiles_path);
+};
+
+#endif
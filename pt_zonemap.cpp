@@ -0,0 +1,290 @@
+#include "pt_zonemap.h"
+#include "qgenlib/qgen_error.h"
+
+#include <cstring>
+
+#define ZONE_MAP_BLOOM_HASHES 7      // number of hash functions of the Bloom filters
+#define ZONE_MAP_BLOOM_BITS_PER_VALUE 10 // ~1% false positive rate
+
+static const char *b64_chars = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static std::string base64_encode(const std::string &in)
+{
+    std::string out;
+    out.reserve((in.size() + 2) / 3 * 4);
+    size_t i = 0;
+    for (; i + 2 < in.size(); i += 3)
+    {
+        uint32_t v = ((uint8_t)in[i] << 16) | ((uint8_t)in[i + 1] << 8) | (uint8_t)in[i + 2];
+        out.push_back(b64_chars[(v >> 18) & 63]);
+        out.push_back(b64_chars[(v >> 12) & 63]);
+        out.push_back(b64_chars[(v >> 6) & 63]);
+        out.push_back(b64_chars[v & 63]);
+    }
+    if (i < in.size())
+    {
+        uint32_t v = (uint8_t)in[i] << 16;
+        if (i + 1 < in.size())
+            v |= (uint8_t)in[i + 1] << 8;
+        out.push_back(b64_chars[(v >> 18) & 63]);
+        out.push_back(b64_chars[(v >> 12) & 63]);
+        out.push_back(i + 1 < in.size() ? b64_chars[(v >> 6) & 63] : '=');
+        out.push_back('=');
+    }
+    return out;
+}
+
+static std::string base64_decode(const std::string &in)
+{
+    std::string out;
+    out.reserve(in.size() / 4 * 3);
+    uint32_t v = 0;
+    int nbits = 0;
+    for (char ch : in)
+    {
+        const char *p = (ch == '=' || ch == '\0') ? NULL : strchr(b64_chars, ch);
+        if (p == NULL)
+            break;
+        v = (v << 6) | (uint32_t)(p - b64_chars);
+        nbits += 6;
+        if (nbits >= 8)
+        {
+            nbits -= 8;
+            out.push_back((char)((v >> nbits) & 0xff));
+        }
+    }
+    return out;
+}
+
+// bit positions of a value in a Bloom filter of nbits bits, by double hashing of FNV-1a
+static inline void bloom_hashes(const char *s, size_t len, uint64_t &h1, uint64_t &h2)
+{
+    uint64_t h = 1469598103934665603ULL;
+    for (size_t i = 0; i < len; ++i)
+    {
+        h ^= (uint8_t)s[i];
+        h *= 1099511628211ULL;
+    }
+    h1 = h & 0xffffffffULL;
+    h2 = (h >> 32) | 1;
+}
+
+bool pt_zone_maps::bloom_may_contain(const std::string &bits, const char *s, size_t len)
+{
+    uint64_t nbits = (uint64_t)bits.size() * 8;
+    if (nbits == 0)
+        return false;
+    uint64_t h1, h2;
+    bloom_hashes(s, len, h1, h2);
+    for (int k = 0; k < ZONE_MAP_BLOOM_HASHES; ++k)
+    {
+        uint64_t b = (h1 + k * h2) % nbits;
+        if (((uint8_t)bits[b >> 3] & (1 << (b & 7))) == 0)
+            return false;
+    }
+    return true;
+}
+
+void pt_zone_maps::init(const std::vector<std::string> &names, const std::vector<bool> &numeric, const std::vector<uint64_t> &_tile_ids)
+{
+    tile_ids = _tile_ids;
+    tile_index.clear();
+    for (size_t i = 0; i < tile_ids.size(); ++i)
+        tile_index[tile_ids[i]] = i;
+    columns.resize(names.size());
+    for (size_t c = 0; c < names.size(); ++c)
+    {
+        column_t &col = columns[c];
+        col.name = names[c];
+        col.numeric = numeric[c];
+        col.has_values.assign(tile_ids.size(), 0);
+        col.mins.assign(numeric[c] ? tile_ids.size() : 0, 0);
+        col.maxs.assign(numeric[c] ? tile_ids.size() : 0, 0);
+        col.blooms.assign(numeric[c] ? 0 : tile_ids.size(), std::string());
+    }
+}
+
+void pt_zone_maps::set_numeric(size_t c, size_t i, double vmin, double vmax)
+{
+    columns[c].has_values[i] = 1;
+    columns[c].mins[i] = vmin;
+    columns[c].maxs[i] = vmax;
+}
+
+void pt_zone_maps::set_strings(size_t c, size_t i, const std::vector<std::string> &distinct_values)
+{
+    if (distinct_values.empty())
+        return;
+    // a multiple of 64 bits, sized by the number of distinct values in the tile
+    uint64_t nbits = ((uint64_t)distinct_values.size() * ZONE_MAP_BLOOM_BITS_PER_VALUE + 63) / 64 * 64;
+    std::string bits(nbits / 8, '\0');
+    for (const std::string &v : distinct_values)
+    {
+        uint64_t h1, h2;
+        bloom_hashes(v.data(), v.size(), h1, h2);
+        for (int k = 0; k < ZONE_MAP_BLOOM_HASHES; ++k)
+        {
+            uint64_t b = (h1 + k * h2) % nbits;
+            bits[b >> 3] |= (char)(1 << (b & 7));
+        }
+    }
+    columns[c].has_values[i] = 1;
+    columns[c].blooms[i].swap(bits);
+}
+
+nlohmann::json pt_zone_maps::to_json() const
+{
+    nlohmann::json jzm;
+    jzm["tile_ids"] = tile_ids;
+    jzm["bloom_hashes"] = ZONE_MAP_BLOOM_HASHES;
+    nlohmann::json jcols = nlohmann::json::array();
+    for (const column_t &col : columns)
+    {
+        nlohmann::json jcol;
+        jcol["name"] = col.name;
+        jcol["type"] = col.numeric ? "number" : "string";
+        if (col.numeric)
+        {
+            nlohmann::json jmins = nlohmann::json::array(), jmaxs = nlohmann::json::array();
+            for (size_t i = 0; i < tile_ids.size(); ++i)
+            {
+                jmins.push_back(col.has_values[i] ? nlohmann::json(col.mins[i]) : nlohmann::json());
+                jmaxs.push_back(col.has_values[i] ? nlohmann::json(col.maxs[i]) : nlohmann::json());
+            }
+            jcol["min"] = jmins;
+            jcol["max"] = jmaxs;
+        }
+        else
+        {
+            nlohmann::json jblooms = nlohmann::json::array();
+            for (size_t i = 0; i < tile_ids.size(); ++i)
+                jblooms.push_back(col.has_values[i] ? nlohmann::json(base64_encode(col.blooms[i])) : nlohmann::json());
+            jcol["bloom"] = jblooms;
+        }
+        jcols.push_back(jcol);
+    }
+    jzm["columns"] = jcols;
+    return jzm;
+}
+
+bool pt_zone_maps::load(const nlohmann::json &jmeta)
+{
+    tile_ids.clear();
+    columns.clear();
+    tile_index.clear();
+    if (!jmeta.is_object() || !jmeta.contains("zone_maps"))
+        return false;
+    const nlohmann::json &jzm = jmeta["zone_maps"];
+    if (!jzm.contains("tile_ids") || !jzm.contains("columns"))
+        return false;
+    if (jzm.value("bloom_hashes", ZONE_MAP_BLOOM_HASHES) != ZONE_MAP_BLOOM_HASHES)
+    {
+        notice("Ignoring zone maps with an unsupported number of Bloom filter hashes");
+        return false;
+    }
+    tile_ids = jzm["tile_ids"].get<std::vector<uint64_t>>();
+    for (size_t i = 0; i < tile_ids.size(); ++i)
+        tile_index[tile_ids[i]] = i;
+    size_t n = tile_ids.size();
+    for (const nlohmann::json &jcol : jzm["columns"])
+    {
+        column_t col;
+        col.name = jcol["name"].get<std::string>();
+        col.numeric = jcol["type"].get<std::string>() == "number";
+        col.has_values.assign(n, 0);
+        if (col.numeric)
+        {
+            const nlohmann::json &jmins = jcol["min"];
+            const nlohmann::json &jmaxs = jcol["max"];
+            if (jmins.size() != n || jmaxs.size() != n)
+                error("Inconsistent number of tiles in the zone maps of column %s", col.name.c_str());
+            col.mins.assign(n, 0);
+            col.maxs.assign(n, 0);
+            for (size_t i = 0; i < n; ++i)
+            {
+                if (jmins[i].is_null())
+                    continue;
+                col.has_values[i] = 1;
+                col.mins[i] = jmins[i].get<double>();
+                col.maxs[i] = jmaxs[i].get<double>();
+            }
+        }
+        else
+        {
+            const nlohmann::json &jblooms = jcol["bloom"];
+            if (jblooms.size() != n)
+                error("Inconsistent number of tiles in the zone maps of column %s", col.name.c_str());
+            col.blooms.assign(n, std::string());
+            for (size_t i = 0; i < n; ++i)
+            {
+                if (jblooms[i].is_null())
+                    continue;
+                col.has_values[i] = 1;
+                col.blooms[i] = base64_decode(jblooms[i].get<std::string>());
+            }
+        }
+        columns.push_back(col);
+    }
+    return true;
+}
+
+bool pt_zone_maps::may_match(uint64_t tile_id, const pt_predicate &pred) const
+{
+    auto it = tile_index.find(tile_id);
+    if (it == tile_index.end())
+        return true;
+    size_t i = it->second;
+    for (size_t c = 0; c < pred.clauses.size(); ++c)
+    {
+        const pt_predicate::clause_t &clause = pred.clauses[c];
+        const column_t *p_col = NULL;
+        for (const column_t &col : columns)
+        {
+            if (col.name == clause.column)
+            {
+                p_col = &col;
+                break;
+            }
+        }
+        if (p_col == NULL)
+            continue; // no statistics for the column
+        if (!p_col->has_values[i])
+            return false; // missing values do not satisfy any clause
+        bool match = true;
+        if (p_col->numeric)
+        {
+            double vmin = p_col->mins[i], vmax = p_col->maxs[i];
+            switch (clause.op)
+            {
+            case PT_PRED_LT: match = vmin < clause.numbers[0]; break;
+            case PT_PRED_LE: match = vmin <= clause.numbers[0]; break;
+            case PT_PRED_GT: match = vmax > clause.numbers[0]; break;
+            case PT_PRED_GE: match = vmax >= clause.numbers[0]; break;
+            case PT_PRED_EQ:
+            case PT_PRED_IN:
+                // numbers never equal non-numeric values
+                match = false;
+                for (size_t j = 0; j < clause.texts.size() && !match; ++j)
+                    match = clause.is_number[j] && clause.numbers[j] >= vmin && clause.numbers[j] <= vmax;
+                break;
+            default:
+                // fails only if every value of the tile is excluded
+                if (vmin == vmax)
+                {
+                    for (size_t j = 0; j < clause.texts.size() && match; ++j)
+                        match = !(clause.is_number[j] && clause.numbers[j] == vmin);
+                }
+            }
+        }
+        else if (clause.op == PT_PRED_EQ || clause.op == PT_PRED_IN)
+        {
+            // numeric literals may equal differently formatted strings, so only text literals are checked
+            match = false;
+            for (size_t j = 0; j < clause.texts.size() && !match; ++j)
+                match = clause.is_number[j] || bloom_may_contain(p_col->blooms[i], clause.texts[j].data(), clause.texts[j].size());
+        }
+        if (!match)
+            return false;
+    }
+    return true;
+}
@@ -0,0 +1,53 @@
+#ifndef __PT_ZONEMAP_H
+#define __PT_ZONEMAP_H
+
+// Per-tile statistics of attribute columns ("zone maps") for skipping tiles that cannot satisfy a predicate
+// Numeric columns keep the min/max of each tile, and string columns keep a Bloom filter of the distinct values of each tile.
+// They are stored in the JSON metadata under "zone_maps":
+//   {"tile_ids": [...], "bloom_hashes": 7,
+//    "columns": [{"name": "count", "type": "number", "min": [...], "max": [...]},
+//                {"name": "gene", "type": "string", "bloom": ["<base64>", ...]}]}
+// where the i-th element of each array belongs to tile_ids[i], and is null if the tile has no value for the column.
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "ext/nlohmann/json.hpp"
+#include "pt_predicate.h"
+
+class pt_zone_maps
+{
+public:
+    struct column_t
+    {
+        std::string name;
+        bool numeric;
+        std::vector<uint8_t> has_values; // per tile, whether any value is present (not vector<bool>, so that tiles can be set concurrently)
+        std::vector<double> mins;        // numeric columns
+        std::vector<double> maxs;
+        std::vector<std::string> blooms; // string columns, bits of the Bloom filter
+    };
+    std::vector<uint64_t> tile_ids;
+    std::vector<column_t> columns;
+
+    // prepare empty statistics for the given columns and tiles, to be filled by set_numeric() and set_strings()
+    void init(const std::vector<std::string> &names, const std::vector<bool> &numeric, const std::vector<uint64_t> &_tile_ids);
+    // set the statistics of the i-th tile; distinct tiles may be set from different threads
+    void set_numeric(size_t c, size_t i, double vmin, double vmax);
+    void set_strings(size_t c, size_t i, const std::vector<std::string> &distinct_values);
+
+    nlohmann::json to_json() const;
+    // load from the JSON metadata, returning false if there are no zone maps
+    bool load(const nlohmann::json &jmeta);
+
+    // false if no point of the tile can satisfy the predicate; tiles without statistics may match
+    bool may_match(uint64_t tile_id, const pt_predicate &pred) const;
+
+private:
+    std::unordered_map<uint64_t, size_t> tile_index;
+
+    static bool bloom_may_contain(const std::string &bits, const char *s, size_t len);
+};
+
+#endif
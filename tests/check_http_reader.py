@@ -0,0 +1,137 @@
+#!/usr/bin/env python3
+"""Check the HTTP range reader against a local HTTP server stand-in.
+
+Serves the directory of a local PMTiles file with a minimal range-capable HTTP server,
+then runs `pmpoint export` on the local path and on the http:// URL and compares the outputs.
+The remote export is repeated with a fresh --cache-dir (cold and warm), and optionally
+with a server that answers some requests with 503 to exercise the retries.
+
+Usage:
+    python3 tests/check_http_reader.py --pmpoint bin/pmpoint --in data/genes.pmtiles \
+        [--fail-every 7] [-- extra export arguments, e.g. --zoom 15 --xmin 0 --xmax 500 ...]
+"""
+
+import argparse
+import filecmp
+import http.server
+import os
+import re
+import subprocess
+import sys
+import tempfile
+import threading
+
+
+class RangeHandler(http.server.BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"  # keep-alive, so that pooled connections are reused
+    root = "."
+    fail_every = 0
+    lock = threading.Lock()
+    n_requests = 0
+    n_ranges = 0
+
+    def log_message(self, fmt, *args):
+        pass
+
+    def _file(self):
+        path = os.path.join(self.root, os.path.basename(self.path.split("?")[0]))
+        if not os.path.isfile(path):
+            self.send_error(404)
+            return None, 0
+        return path, os.path.getsize(path)
+
+    def _etag(self, path):
+        st = os.stat(path)
+        return '"%x-%x"' % (st.st_size, int(st.st_mtime))
+
+    def do_HEAD(self):
+        path, size = self._file()
+        if path is None:
+            return
+        self.send_response(200)
+        self.send_header("Content-Length", str(size))
+        self.send_header("Accept-Ranges", "bytes")
+        self.send_header("ETag", self._etag(path))
+        self.end_headers()
+
+    def do_GET(self):
+        path, size = self._file()
+        if path is None:
+            return
+        with RangeHandler.lock:
+            RangeHandler.n_requests += 1
+            n = RangeHandler.n_requests
+        if self.fail_every > 0 and n % self.fail_every == 0:
+            self.send_response(503)
+            self.send_header("Content-Length", "0")
+            self.end_headers()
+            return
+        m = re.match(r"bytes=(\d+)-(\d*)$", self.headers.get("Range", ""))
+        if m is None:
+            beg, end, code = 0, size - 1, 200
+        else:
+            beg = int(m.group(1))
+            end = min(int(m.group(2)) if m.group(2) else size - 1, size - 1)
+            code = 206
+            with RangeHandler.lock:
+                RangeHandler.n_ranges += 1
+        if beg > end:
+            self.send_response(416)
+            self.send_header("Content-Range", "bytes */%d" % size)
+            self.send_header("Content-Length", "0")
+            self.end_headers()
+            return
+        with open(path, "rb") as f:
+            f.seek(beg)
+            data = f.read(end - beg + 1)
+        self.send_response(code)
+        if code == 206:
+            self.send_header("Content-Range", "bytes %d-%d/%d" % (beg, end, size))
+        self.send_header("Content-Length", str(len(data)))
+        self.send_header("ETag", self._etag(path))
+        self.end_headers()
+        self.wfile.write(data)
+
+
+def run_export(pmpoint, src, out, extra):
+    cmd = [pmpoint, "export", "--in", src, "--out-tsv", out] + extra
+    print("+ " + " ".join(cmd), file=sys.stderr)
+    subprocess.run(cmd, check=True)
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("--pmpoint", required=True, help="pmpoint binary")
+    ap.add_argument("--in", dest="inp", required=True, help="local PMTiles file to serve")
+    ap.add_argument("--fail-every", type=int, default=0, help="answer every N-th GET with 503 (default: 0, never)")
+    ap.add_argument("extra", nargs="*", help="additional arguments passed to pmpoint export")
+    args = ap.parse_args()
+
+    RangeHandler.root = os.path.dirname(os.path.abspath(args.inp))
+    RangeHandler.fail_every = args.fail_every
+    server = http.server.ThreadingHTTPServer(("127.0.0.1", 0), RangeHandler)
+    threading.Thread(target=server.serve_forever, daemon=True).start()
+    url = "http://127.0.0.1:%d/%s" % (server.server_address[1], os.path.basename(args.inp))
+
+    ok = True
+    with tempfile.TemporaryDirectory() as tmp:
+        local_out = os.path.join(tmp, "local.tsv")
+        run_export(args.pmpoint, args.inp, local_out, args.extra)
+
+        cache_dir = os.path.join(tmp, "cache")
+        runs = [("remote", []),
+                ("remote-cold-cache", ["--cache-dir", cache_dir]),
+                ("remote-warm-cache", ["--cache-dir", cache_dir])]
+        for name, opts in runs:
+            before = RangeHandler.n_ranges
+            out = os.path.join(tmp, name + ".tsv")
+            run_export(args.pmpoint, url, out, args.extra + opts)
+            same = filecmp.cmp(local_out, out, shallow=False)
+            ok = ok and same
+            print("%-18s %s  (%d range requests)" % (name, "OK" if same else "DIFFERS", RangeHandler.n_ranges - before))
+    server.shutdown()
+    return 0 if ok else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,337 @@
+// Round-trip tests of the MLT point codec (mlt_codec and mlt_varint)
+// Covers every integer stream encoding (NONE, DELTA, COMPONENTWISE_DELTA and RLE, as varints or bit-packed),
+// plain, dictionary and front-coded string columns, empty and single-point tiles, the byte layout of
+// spec-compliant RLE streams, and the block boundaries of the SSE4.1 varint decoder.
+// Built as bin/mlt_codec_test and run by ctest; exits with a non-zero status if any check fails.
+
+#include "mlt_codec.h"
+#include "mlt_varint.h"
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+static int32_t n_checks = 0;
+static int32_t n_failures = 0;
+
+static void check(bool ok, const char *test, const char *what)
+{
+    ++n_checks;
+    if (!ok)
+    {
+        fprintf(stderr, "FAILED: %s: %s\n", test, what);
+        ++n_failures;
+    }
+}
+
+// the values of one point in a test tile; absent values are marked by the has_* flags
+struct test_point_t
+{
+    int32_t x, y;
+    bool has_int, has_str;
+    int32_t ival;
+    float fval;
+    std::string sval;
+};
+
+// encode points into a tile with a nullable INT column, a nullable STRING column and a FLOAT column
+static std::string encode_points(const std::vector<test_point_t> &pts, const mlt_write_options &opts)
+{
+    mlt_layer_writer writer("pts", 4096, opts);
+    writer.add_column("count", MLT_COL_INT, true);
+    writer.add_column("gene", MLT_COL_STRING, true);
+    writer.add_column("val", MLT_COL_FLOAT, false);
+    for (const test_point_t &pt : pts)
+    {
+        writer.add_point(pt.x, pt.y);
+        if (pt.has_int)
+            writer.add_int(0, pt.ival);
+        else
+            writer.add_null(0);
+        if (pt.has_str)
+            writer.add_string(1, pt.sval.data(), pt.sval.size());
+        else
+            writer.add_null(1);
+        writer.add_float(2, pt.fval);
+    }
+    return writer.finish();
+}
+
+// decode a tile written by encode_points and compare it with the points
+static void check_points(const char *test, const std::string &tile, const std::vector<test_point_t> &pts, mlt_layer_reader &reader)
+{
+    check(reader.parse(tile), test, "the tile has a layer");
+    check(reader.num_features == pts.size(), test, "number of features");
+    check(reader.columns.size() == 3, test, "number of columns");
+    if (reader.num_features != pts.size() || reader.columns.size() != 3)
+        return;
+
+    std::vector<int32_t> xy;
+    reader.decode_vertices(xy);
+    bool same = xy.size() == 2 * pts.size();
+    for (size_t i = 0; same && i < pts.size(); ++i)
+        same = xy[2 * i] == pts[i].x && xy[2 * i + 1] == pts[i].y;
+    check(same, test, "vertices");
+
+    std::vector<uint8_t> int_present, str_present;
+    std::vector<int32_t> ints;
+    reader.decode_present(0, int_present);
+    reader.decode_ints(0, ints);
+    reader.decode_present(1, str_present);
+    std::vector<std::string> strs;
+    if (reader.columns[1].dictionary)
+    {
+        std::vector<std::string> entries;
+        std::vector<int32_t> indices;
+        reader.decode_dictionary(1, entries, indices);
+        for (int32_t d : indices)
+            strs.push_back(d >= 0 && d < (int32_t)entries.size() ? entries[d] : std::string("<out of range>"));
+    }
+    else
+    {
+        std::vector<std::pair<const char *, uint32_t> > views;
+        reader.decode_strings(1, views);
+        for (const std::pair<const char *, uint32_t> &v : views)
+            strs.emplace_back(v.first, v.second);
+    }
+    std::vector<float> floats;
+    reader.decode_floats(2, floats);
+
+    bool ints_ok = true, strs_ok = true, floats_ok = floats.size() == pts.size();
+    size_t next_int = 0, next_str = 0;
+    for (size_t i = 0; i < pts.size(); ++i)
+    {
+        bool has_int = mlt_layer_reader::is_present(int_present, i);
+        ints_ok = ints_ok && has_int == pts[i].has_int;
+        if (has_int)
+            ints_ok = ints_ok && next_int < ints.size() && ints[next_int++] == pts[i].ival;
+        bool has_str = mlt_layer_reader::is_present(str_present, i);
+        strs_ok = strs_ok && has_str == pts[i].has_str;
+        if (has_str)
+            strs_ok = strs_ok && next_str < strs.size() && strs[next_str++] == pts[i].sval;
+        floats_ok = floats_ok && floats[i] == pts[i].fval;
+    }
+    check(ints_ok && next_int == ints.size(), test, "INT column");
+    check(strs_ok && next_str == strs.size(), test, "STRING column");
+    check(floats_ok, test, "FLOAT column");
+}
+
+// byte layout of a tile with an RLE geometry type stream, following the MLT specification:
+// header 0x10 (DATA), technique (RLE << 5) | VARINT, 2 values (run length and run value) in 2 bytes,
+// 1 run of 5 values, then the varints 5 and 0
+static void test_spec_layout()
+{
+    mlt_layer_writer writer("p", 4096);
+    for (int32_t i = 0; i < 5; ++i)
+        writer.add_point(i, 7);
+    std::string tile = writer.finish();
+    const uint8_t expected[] = {0x1e, 0x01, 0x01, 0x70, 0x80, 0x20, 0x01, 0x04, 0x02,
+                                0x10, 0x62, 0x02, 0x02, 0x01, 0x05, 0x05, 0x00,
+                                0x13, 0x02, 0x0a, 0x0a, 0x00, 0x0e, 0x02, 0x0e, 0x04, 0x0e, 0x06, 0x0e, 0x08, 0x0e};
+    check(tile.size() == sizeof(expected) && memcmp(tile.data(), expected, sizeof(expected)) == 0, "spec layout", "tile bytes");
+}
+
+static void test_empty_and_single(const mlt_write_options &opts)
+{
+    std::vector<test_point_t> pts;
+    mlt_layer_reader reader;
+    check_points("empty tile", encode_points(pts, opts), pts, reader);
+
+    test_point_t pt = {17, 4095, true, true, -3, 1.5f, "Actb"};
+    pts.push_back(pt);
+    check_points("single point", encode_points(pts, opts), pts, reader);
+
+    pts[0].has_int = false;
+    pts[0].has_str = false;
+    check_points("single point without values", encode_points(pts, opts), pts, reader);
+}
+
+// integer columns whose values favour each logical technique, and extreme values that wrap around in deltas
+static void test_int_encodings(const mlt_write_options &opts)
+{
+    std::mt19937 rng(11);
+    const char *names[] = {"constant", "sorted", "random", "extremes"};
+    mlt_logical_t expected[] = {MLT_LOGICAL_RLE, MLT_LOGICAL_DELTA, MLT_LOGICAL_NONE};
+    for (int32_t mode = 0; mode < 4; ++mode)
+    {
+        for (size_t n : {2, 127, 128, 129, 1000})
+        {
+            std::vector<test_point_t> pts(n);
+            for (size_t i = 0; i < n; ++i)
+            {
+                test_point_t &pt = pts[i];
+                // vertices sorted along x and y separately favour COMPONENTWISE_DELTA
+                pt.x = (int32_t)(i * 3);
+                pt.y = 1000000 + (int32_t)(i * 5);
+                pt.has_int = true;
+                pt.has_str = false;
+                switch (mode)
+                {
+                case 0: pt.ival = 7; break;
+                case 1: pt.ival = 100000 + (int32_t)i * 1000 + (int32_t)(rng() % 3); break;
+                case 2: pt.ival = (int32_t)(rng() % 121) - 60; break; // deltas take more bytes than the values
+                default: pt.ival = (i % 2) ? INT32_MIN + (int32_t)(rng() % 7) : INT32_MAX - (int32_t)(rng() % 7);
+                }
+                pt.fval = 0.25f * (float)i;
+            }
+            char test[64];
+            snprintf(test, sizeof(test), "%s ints n=%zu%s", names[mode], n, opts.packed_ints ? " packed" : "");
+            mlt_layer_reader reader;
+            check_points(test, encode_points(pts, opts), pts, reader);
+            if (n < 128) // few values may be cheaper without a logical technique
+                continue;
+            if (mode < 3)
+                check(reader.columns[0].data.logical() == expected[mode], test, "logical technique of the INT stream");
+            check(reader.vertex_stream().logical() == MLT_LOGICAL_COMPONENTWISE_DELTA, test, "logical technique of the VERTEX stream");
+            if (!opts.packed_ints)
+                check(reader.columns[0].data.physical() == MLT_PHYSICAL_VARINT && reader.vertex_stream().physical() == MLT_PHYSICAL_VARINT,
+                      test, "integer streams are varints unless packing is enabled");
+            else if (mode == 2) // 7-bit values pack into fewer bytes than 1-byte varints
+                check(reader.columns[0].data.physical() == MLT_PHYSICAL_PACKED, test, "random values are bit-packed");
+        }
+    }
+}
+
+// string columns of distinct values, of few values, and of few values sharing long prefixes
+static void test_string_encodings(const mlt_write_options &opts)
+{
+    std::mt19937 rng(13);
+    const char *names[] = {"distinct", "dictionary", "prefixed"};
+    for (int32_t mode = 0; mode < 3; ++mode)
+    {
+        std::vector<test_point_t> pts(600);
+        for (size_t i = 0; i < pts.size(); ++i)
+        {
+            test_point_t &pt = pts[i];
+            pt.x = (int32_t)(rng() % 4096);
+            pt.y = (int32_t)(rng() % 4096);
+            pt.has_int = (i % 5) != 0;
+            pt.ival = (int32_t)(rng() % 10);
+            pt.has_str = (i % 7) != 0;
+            char buf[64];
+            switch (mode)
+            {
+            case 0: snprintf(buf, sizeof(buf), "value_%zu_%u", i, (unsigned)rng()); break;
+            case 1: snprintf(buf, sizeof(buf), "gene%u", (unsigned)(rng() % 20)); break;
+            default: snprintf(buf, sizeof(buf), "ENSMUSG000000%05u", (unsigned)(rng() % 40)); break;
+            }
+            pt.sval = buf;
+            pt.fval = (float)(rng() % 1000) / 8.0f;
+        }
+        char test[64];
+        snprintf(test, sizeof(test), "%s strings%s", names[mode], opts.front_coding ? " front-coded" : "");
+        mlt_layer_reader reader;
+        check_points(test, encode_points(pts, opts), pts, reader);
+        if (reader.columns.size() != 3)
+            continue;
+        const mlt_column_view &col = reader.columns[1];
+        check(col.dictionary == (mode != 0), test, "dictionary encoding");
+        bool front_coded = col.prefixes.bytes.data != NULL;
+        if (!opts.front_coding || mode == 0)
+            check(!front_coded, test, "not front-coded");
+        else if (mode == 2)
+            check(front_coded, test, "front-coded");
+    }
+}
+
+// LEB128 encoding of a value, as written by mlt_layer_writer
+static void append_varint(std::vector<uint8_t> &out, uint32_t v)
+{
+    while (v >= 0x80)
+    {
+        out.push_back((uint8_t)(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back((uint8_t)v);
+}
+
+// decode values from an exactly sized buffer, so that reads past its end are caught by sanitizers
+static void check_varints(const char *test, const std::vector<uint32_t> &values)
+{
+    std::vector<uint8_t> bytes;
+    for (uint32_t v : values)
+        append_varint(bytes, v);
+    std::vector<uint8_t> exact(bytes);
+    std::vector<uint32_t> out(values.size() + 1, 0xdeadbeef);
+    size_t n = mlt_decode_varint32(exact.data(), exact.size(), values.size(), out.data());
+    bool same = n == values.size() && out[values.size()] == 0xdeadbeef;
+    for (size_t i = 0; same && i < values.size(); ++i)
+        same = out[i] == values[i];
+    check(same, test, "varint values");
+
+    std::vector<int32_t> zz(values.size());
+    n = mlt_decode_zigzag32(exact.data(), exact.size(), values.size(), zz.data());
+    same = n == values.size();
+    for (size_t i = 0; same && i < values.size(); ++i)
+        same = zz[i] == (int32_t)((values[i] >> 1) ^ (0 - (values[i] & 1)));
+    check(same, test, "zigzag values");
+
+    // a stream cut inside its last value yields one value less
+    if (!values.empty())
+    {
+        std::vector<uint8_t> cut(bytes.begin(), bytes.end() - 1);
+        n = mlt_decode_varint32(cut.data(), cut.size(), values.size(), out.data());
+        check(n == values.size() - 1, test, "truncated stream");
+    }
+}
+
+// the SSE4.1 decoder takes 16 one-byte values or up to 8 one- and two-byte values at a time,
+// so lengths and value sizes around these block boundaries are covered
+static void test_varint_boundaries()
+{
+    std::mt19937 rng(17);
+    const uint32_t edges[] = {0, 1, 127, 128, 255, 16383, 16384, 2097151, 2097152, 268435455, 268435456, 0x7fffffffu, 0xffffffffu};
+    char test[64];
+    for (size_t n = 0; n <= 40; ++n)
+    {
+        std::vector<uint32_t> small(n), mixed(n), wide(n);
+        for (size_t i = 0; i < n; ++i)
+        {
+            small[i] = rng() % 128;
+            mixed[i] = (rng() % 2) ? rng() % 128 : 128 + rng() % 16256;
+            wide[i] = edges[rng() % (sizeof(edges) / sizeof(edges[0]))];
+        }
+        snprintf(test, sizeof(test), "1-byte varints n=%zu", n);
+        check_varints(test, small);
+        snprintf(test, sizeof(test), "1/2-byte varints n=%zu", n);
+        check_varints(test, mixed);
+        snprintf(test, sizeof(test), "edge varints n=%zu", n);
+        check_varints(test, wide);
+    }
+    // a long value right after a block of short ones, at every position
+    for (size_t pos = 0; pos < 34; ++pos)
+    {
+        std::vector<uint32_t> values(34, 5);
+        values[pos] = 0xffffffffu;
+        snprintf(test, sizeof(test), "5-byte varint at %zu", pos);
+        check_varints(test, values);
+    }
+    check_varints("all edges", std::vector<uint32_t>(edges, edges + sizeof(edges) / sizeof(edges[0])));
+}
+
+int main()
+{
+    mlt_write_options spec_opts;
+    mlt_write_options packed_opts;
+    packed_opts.packed_ints = true;
+    mlt_write_options front_opts;
+    front_opts.front_coding = true;
+    mlt_write_options all_opts;
+    all_opts.packed_ints = true;
+    all_opts.front_coding = true;
+
+    test_spec_layout();
+    for (const mlt_write_options &opts : {spec_opts, packed_opts, front_opts, all_opts})
+    {
+        test_empty_and_single(opts);
+        test_int_encodings(opts);
+        test_string_encodings(opts);
+    }
+    test_varint_boundaries();
+
+    printf("%d checks, %d failures\n", n_checks, n_failures);
+    return n_failures == 0 ? 0 : 1;
+}